@@ -0,0 +1,341 @@
+// from_pb, from_default_pb and to_pb over synthetic schemas that vary in
+// width, depth, repeated and map sizes and string sizes, with both engines,
+// and JSON transcoding next to protobuf's json_util.
+// Reports ns/op, bytes/s of payload and, with glibc, the malloc calls per
+// op: operator new of any form, protobuf arena blocks and ValueArena blocks
+// alike. Each op decodes into an arena of its own.
+// Build with the top-level CMakeLists.txt; --benchmark_filter selects cases.
+#include <benchmark/benchmark.h>
+#include <google/protobuf/util/json_util.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "serializer/pb_json.h"
+#include "serializer/pb_serializer_value.h"
+#include "synthetic_schema.h"
+
+#if defined(__GLIBC__)
+namespace {
+std::atomic<uint64_t> g_mallocs{0};
+
+void CountMalloc() {
+  g_mallocs.fetch_add(1, std::memory_order_relaxed);
+}
+}  // namespace
+
+// Counts the allocating entry points of malloc, which operator new and the
+// arenas end in, forwarding to glibc's. free is left alone.
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* memory, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+
+void* malloc(std::size_t size) noexcept {
+  CountMalloc();
+  return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) noexcept {
+  CountMalloc();
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* memory, std::size_t size) noexcept {
+  CountMalloc();
+  return __libc_realloc(memory, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+  CountMalloc();
+  return __libc_memalign(alignment, size);
+}
+
+void* memalign(std::size_t alignment, std::size_t size) noexcept {
+  CountMalloc();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** memory,
+                   std::size_t alignment,
+                   std::size_t size) noexcept {
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  CountMalloc();
+  void* result = __libc_memalign(alignment, size);
+  if (!result) {
+    return ENOMEM;
+  }
+  *memory = result;
+  return 0;
+}
+}
+#endif
+
+namespace magic::bench {
+namespace {
+using pb::PBEngine;
+using pb::PBInfo;
+using pb::PBOptions;
+using pb::Value;
+using pb::ValueArena;
+
+// A schema with the long-lived state conversions run against.
+class Fixture {
+ public:
+  explicit Fixture(const SchemaShape& shape)
+      : schema_(shape),
+        runtime_{.descriptor_pool = schema_.pool(),
+                 .message_pool = &message_pool_,
+                 .plans = &plans_} {
+    auto decoded =
+        pb::from_pb(runtime_,
+                    PBInfo{.type = schema_.root_type(), .data = payload()},
+                    &arena_);
+    if (decoded.first) {
+      std::abort();
+    }
+    object_ = decoded.second;
+    CheckEngines();
+    if (pb::to_json(json_runtime(),
+                    PBInfo{.type = schema_.root_type(), .data = payload()},
+                    &json_)) {
+      std::abort();
+    }
+  }
+
+  const pb::PBRuntime<Value*>& runtime() const { return runtime_; }
+  const std::string& type() const { return schema_.root_type(); }
+  const std::string& payload() const { return schema_.payload(); }
+  Value* object() const { return object_; }
+
+  pb::JsonRuntime json_runtime() {
+    return {.descriptor_pool = schema_.pool(),
+            .message_pool = &message_pool_,
+            .plans = &json_plans_};
+  }
+  const std::string& json() const { return json_; }
+  const google::protobuf::Descriptor* descriptor() {
+    return schema_.pool()->FindMessageTypeByName(schema_.root_type());
+  }
+  pb::MessagePool* message_pool() { return &message_pool_; }
+
+ private:
+  // Both engines must encode the same bytes, or comparing them means
+  // nothing. Checked on the payload's object, and on a copy whose int32
+  // field holds a hex string under lenient_numbers.
+  void CheckEngines() {
+    Value* lenient = object_->Clone(&arena_);
+    lenient->Set(&arena_, "scalar_field_0", Value::NewString(&arena_, "0x10"));
+    PBOptions lenient_options;
+    lenient_options.lenient_numbers = true;
+    const std::pair<Value*, PBOptions> cases[] = {
+        {object_, PBOptions{}},
+        {lenient, lenient_options},
+    };
+    for (const auto& [object, options] : cases) {
+      std::vector<uint8_t> encoded[2];
+      const PBEngine engines[] = {PBEngine::kReflection,
+                                  PBEngine::kWireFormat};
+      for (int i = 0; i < 2; ++i) {
+        PBOptions engine_options = options;
+        engine_options.engine = engines[i];
+        auto result = pb::to_pb<Value*>(object, runtime_, type(), nullptr,
+                                        engine_options);
+        if (result.first) {
+          std::abort();
+        }
+        encoded[i] = std::move(result.second);
+      }
+      if (encoded[0] != encoded[1]) {
+        std::abort();
+      }
+    }
+  }
+
+  SyntheticSchema schema_;
+  pb::MessagePool message_pool_;
+  pb::PlanCache<Value*> plans_;
+  pb::PBRuntime<Value*> runtime_;
+  pb::JsonPlanCache json_plans_;
+  ValueArena arena_;
+  Value* object_ = nullptr;
+  std::string json_;
+};
+
+PBOptions EngineOptions(PBEngine engine) {
+  PBOptions options;
+  options.engine = engine;
+  return options;
+}
+
+// Runs |op| once untimed so plans and pools are warm, then measures it.
+// |bytes| is the payload size one op converts.
+template <typename Op>
+void Measure(benchmark::State& state, std::size_t bytes, Op op) {
+  if (auto error_code = op().first) {
+    state.SkipWithError(error_code.message().c_str());
+    return;
+  }
+#if defined(__GLIBC__)
+  const auto mallocs = g_mallocs.load(std::memory_order_relaxed);
+#endif
+  for (auto _ : state) {
+    auto result = op();
+    benchmark::DoNotOptimize(result);
+  }
+  if (bytes) {
+    state.SetBytesProcessed(state.iterations() * bytes);
+  }
+#if defined(__GLIBC__)
+  state.counters["mallocs"] = benchmark::Counter(
+      g_mallocs.load(std::memory_order_relaxed) - mallocs,
+      benchmark::Counter::kAvgIterations);
+#endif
+}
+
+void FromPb(benchmark::State& state, const Fixture* fixture, PBEngine engine) {
+  const auto options = EngineOptions(engine);
+  const PBInfo info{.type = fixture->type(), .data = fixture->payload()};
+  Measure(state, fixture->payload().size(), [&] {
+    ValueArena arena;
+    return pb::from_pb(fixture->runtime(), info, &arena, options);
+  });
+}
+
+void FromDefaultPb(benchmark::State& state, const Fixture* fixture) {
+  Measure(state, 0, [&] {
+    ValueArena arena;
+    return pb::from_default_pb(fixture->runtime(), fixture->type(), &arena);
+  });
+}
+
+void ToPb(benchmark::State& state, const Fixture* fixture, PBEngine engine) {
+  const auto options = EngineOptions(engine);
+  Measure(state, fixture->payload().size(), [&] {
+    return pb::to_pb<Value*>(fixture->object(), fixture->runtime(),
+                             fixture->type(), nullptr, options);
+  });
+}
+
+// Each op writes into a buffer reused across ops, as a service would.
+void ToJson(benchmark::State& state, Fixture* fixture) {
+  const auto runtime = fixture->json_runtime();
+  const PBInfo info{.type = fixture->type(), .data = fixture->payload()};
+  std::string json;
+  Measure(state, fixture->payload().size(), [&] {
+    return std::make_pair(pb::to_json(runtime, info, &json), json.size());
+  });
+}
+
+void ToJsonProtobuf(benchmark::State& state, Fixture* fixture) {
+  const auto* descriptor = fixture->descriptor();
+  std::string json;
+  Measure(state, fixture->payload().size(), [&] {
+    auto message = fixture->message_pool()->Acquire(descriptor);
+    json.clear();
+    ErrorCode error_code = CommonError::SUCCESS;
+    if (!message->ParseFromString(fixture->payload()) ||
+        !google::protobuf::util::MessageToJsonString(*message, &json).ok()) {
+      error_code = pb::PBError::kPBParseError;
+    }
+    return std::make_pair(error_code, json.size());
+  });
+}
+
+void FromJson(benchmark::State& state, Fixture* fixture) {
+  const auto runtime = fixture->json_runtime();
+  std::string pb;
+  Measure(state, fixture->json().size(), [&] {
+    return std::make_pair(
+        pb::from_json(runtime, fixture->json(), fixture->type(), &pb),
+        pb.size());
+  });
+}
+
+void FromJsonProtobuf(benchmark::State& state, Fixture* fixture) {
+  const auto* descriptor = fixture->descriptor();
+  std::string pb;
+  Measure(state, fixture->json().size(), [&] {
+    auto message = fixture->message_pool()->Acquire(descriptor);
+    pb.clear();
+    ErrorCode error_code = CommonError::SUCCESS;
+    if (!google::protobuf::util::JsonStringToMessage(fixture->json(),
+                                                     message.get())
+             .ok() ||
+        !message->SerializeToString(&pb)) {
+      error_code = pb::PBError::kPBParseError;
+    }
+    return std::make_pair(error_code, pb.size());
+  });
+}
+
+std::vector<SchemaShape> Shapes() {
+  std::vector<SchemaShape> shapes;
+  for (int width : {8, 64, 512}) {
+    shapes.push_back({.width = width});
+  }
+  for (int depth : {8, 32}) {
+    shapes.push_back({.depth = depth});
+  }
+  for (int repeated : {16, 1024}) {
+    shapes.push_back({.repeated = repeated});
+  }
+  for (int map : {16, 1024}) {
+    shapes.push_back({.map = map});
+  }
+  for (int string_size : {1024, 65536}) {
+    shapes.push_back({.string_size = string_size});
+  }
+  return shapes;
+}
+
+void RegisterAll(std::vector<std::unique_ptr<Fixture>>* fixtures) {
+  const std::pair<PBEngine, const char*> engines[] = {
+      {PBEngine::kReflection, "reflection"},
+      {PBEngine::kWireFormat, "wire"},
+  };
+  for (const auto& shape : Shapes()) {
+    auto* fixture =
+        fixtures->emplace_back(std::make_unique<Fixture>(shape)).get();
+    const auto name = shape.Name();
+    for (const auto& [engine, engine_name] : engines) {
+      benchmark::RegisterBenchmark(
+          ("from_pb/" + std::string(engine_name) + "/" + name).c_str(),
+          FromPb, fixture, engine);
+      benchmark::RegisterBenchmark(
+          ("to_pb/" + std::string(engine_name) + "/" + name).c_str(), ToPb,
+          fixture, engine);
+    }
+    benchmark::RegisterBenchmark(("from_default_pb/" + name).c_str(),
+                                 FromDefaultPb, fixture);
+    benchmark::RegisterBenchmark(("to_json/transcode/" + name).c_str(),
+                                 ToJson, fixture);
+    benchmark::RegisterBenchmark(("to_json/protobuf/" + name).c_str(),
+                                 ToJsonProtobuf, fixture);
+    benchmark::RegisterBenchmark(("from_json/transcode/" + name).c_str(),
+                                 FromJson, fixture);
+    benchmark::RegisterBenchmark(("from_json/protobuf/" + name).c_str(),
+                                 FromJsonProtobuf, fixture);
+  }
+}
+}  // namespace
+}  // namespace magic::bench
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  std::vector<std::unique_ptr<magic::bench::Fixture>> fixtures;
+  magic::bench::RegisterAll(&fixtures);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,72 @@
+// Numeric string coercion, detail::string_to_number against the stringstream
+// version it replaced. That version tested ss.good(), which is false once
+// the whole input is read, so it rejected every well-formed number; it is
+// measured here with the check it meant, that the input parsed and nothing
+// followed it. Build from the repository root with
+//   c++ -std=c++20 -O2 -I src bench/string_to_number_bench.cc
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "magic/serializer.h"
+
+namespace {
+template <typename T>
+std::optional<T> stringstream_to_number(std::string_view str) {
+  T v{};
+  std::stringstream ss;
+  ss << str;
+  ss >> v;
+  return !ss.fail() && ss.eof() ? std::optional<T>(v) : std::optional<T>();
+}
+
+template <typename T, typename Fn>
+void Run(const char* name,
+         const std::vector<std::string>& inputs,
+         int rounds,
+         Fn fn) {
+  std::size_t parsed = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (const auto& input : inputs) {
+      parsed += fn(input).has_value();
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << name << ": "
+            << elapsed.count() / (double(rounds) * inputs.size())
+            << " ns/value, parsed " << parsed << "\n";
+}
+
+template <typename T>
+void Compare(const char* type, const std::vector<std::string>& inputs) {
+  constexpr int kRounds = 200;
+  std::cout << type << "\n";
+  Run<T>("  stringstream", inputs, kRounds, stringstream_to_number<T>);
+  Run<T>("  from_chars", inputs, kRounds, [](std::string_view str) {
+    return magic::detail::string_to_number<T>(str);
+  });
+}
+}  // namespace
+
+int main() {
+  std::vector<std::string> integers;
+  std::vector<std::string> doubles;
+  uint64_t seed = 88172645463325252ull;
+  for (int i = 0; i < 10000; ++i) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    integers.push_back(std::to_string(int64_t(seed)));
+    doubles.push_back(std::to_string(double(seed % 1000000) / 1000.0));
+  }
+  Compare<int64_t>("int64", integers);
+  Compare<double>("double", doubles);
+  return 0;
+}
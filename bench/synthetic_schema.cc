@@ -0,0 +1,191 @@
+#include "synthetic_schema.h"
+
+#include <google/protobuf/descriptor.pb.h>
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+namespace magic::bench {
+namespace {
+using google::protobuf::DescriptorProto;
+using google::protobuf::DynamicMessageFactory;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::FieldDescriptorProto;
+using google::protobuf::FileDescriptorProto;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+constexpr FieldDescriptorProto::Type kScalarTypes[] = {
+    FieldDescriptorProto::TYPE_INT32,    FieldDescriptorProto::TYPE_INT64,
+    FieldDescriptorProto::TYPE_UINT32,   FieldDescriptorProto::TYPE_UINT64,
+    FieldDescriptorProto::TYPE_SINT32,   FieldDescriptorProto::TYPE_SINT64,
+    FieldDescriptorProto::TYPE_FIXED32,  FieldDescriptorProto::TYPE_FIXED64,
+    FieldDescriptorProto::TYPE_SFIXED32, FieldDescriptorProto::TYPE_SFIXED64,
+    FieldDescriptorProto::TYPE_FLOAT,    FieldDescriptorProto::TYPE_DOUBLE,
+    FieldDescriptorProto::TYPE_BOOL,     FieldDescriptorProto::TYPE_ENUM,
+};
+
+std::string LevelName(int level) {
+  return "Level" + std::to_string(level);
+}
+
+FieldDescriptorProto* AddField(DescriptorProto* message,
+                               const std::string& name,
+                               int number,
+                               FieldDescriptorProto::Type type) {
+  auto* field = message->add_field();
+  field->set_name(name);
+  field->set_number(number);
+  field->set_type(type);
+  field->set_label(FieldDescriptorProto::LABEL_OPTIONAL);
+  return field;
+}
+
+// Non-zero, so proto3 writes every field.
+int64_t ScalarValue(int index, int level) {
+  return 1 + index * 7919 + level * 104729;
+}
+}  // namespace
+
+std::string SchemaShape::Name() const {
+  // Appended piecewise, operator+ chains trip GCC 12's -Wrestrict.
+  std::string name;
+  for (auto [prefix, value] : {std::pair{"w", width},
+                               {"_d", depth},
+                               {"_r", repeated},
+                               {"_m", map},
+                               {"_s", string_size}}) {
+    name += prefix;
+    name += std::to_string(value);
+  }
+  return name;
+}
+
+SyntheticSchema::SyntheticSchema(const SchemaShape& shape)
+    : shape_(shape), root_type_("bench." + LevelName(0)) {
+  FileDescriptorProto file;
+  file.set_name("bench_" + shape.Name() + ".proto");
+  file.set_package("bench");
+  file.set_syntax("proto3");
+
+  auto* kind = file.add_enum_type();
+  kind->set_name("Kind");
+  for (const char* name : {"KIND_ZERO", "KIND_ONE", "KIND_TWO"}) {
+    auto* value = kind->add_value();
+    value->set_name(name);
+    value->set_number(kind->value_size() - 1);
+  }
+
+  for (int level = 0; level <= shape.depth; ++level) {
+    auto* message = file.add_message_type();
+    message->set_name(LevelName(level));
+    int number = 0;
+    for (int i = 0; i < shape.width; ++i) {
+      auto type = kScalarTypes[i % std::size(kScalarTypes)];
+      auto* field = AddField(message, "scalar_field_" + std::to_string(i),
+                             ++number, type);
+      if (type == FieldDescriptorProto::TYPE_ENUM) {
+        field->set_type_name(".bench.Kind");
+      }
+    }
+    AddField(message, "text_value", ++number,
+             FieldDescriptorProto::TYPE_STRING);
+    AddField(message, "blob_value", ++number,
+             FieldDescriptorProto::TYPE_BYTES);
+    if (level < shape.depth) {
+      AddField(message, "child", ++number, FieldDescriptorProto::TYPE_MESSAGE)
+          ->set_type_name(".bench." + LevelName(level + 1));
+    }
+    if (level != 0) {
+      continue;
+    }
+    auto* items = AddField(message, "items", ++number,
+                           FieldDescriptorProto::TYPE_MESSAGE);
+    items->set_label(FieldDescriptorProto::LABEL_REPEATED);
+    items->set_type_name(".bench." + LevelName(shape.depth));
+    AddField(message, "numbers", ++number, FieldDescriptorProto::TYPE_INT64)
+        ->set_label(FieldDescriptorProto::LABEL_REPEATED);
+
+    auto* entry = message->add_nested_type();
+    entry->set_name("CountsEntry");
+    entry->mutable_options()->set_map_entry(true);
+    AddField(entry, "key", 1, FieldDescriptorProto::TYPE_STRING);
+    AddField(entry, "value", 2, FieldDescriptorProto::TYPE_INT64);
+    auto* counts = AddField(message, "counts", ++number,
+                            FieldDescriptorProto::TYPE_MESSAGE);
+    counts->set_label(FieldDescriptorProto::LABEL_REPEATED);
+    counts->set_type_name(".bench." + LevelName(0) + ".CountsEntry");
+  }
+  pool_.BuildFile(file);
+
+  DynamicMessageFactory factory(&pool_);
+  std::unique_ptr<Message> root(
+      factory.GetPrototype(pool_.FindMessageTypeByName(root_type_))->New());
+  Fill(root.get(), 0, true);
+  payload_ = root->SerializeAsString();
+}
+
+void SyntheticSchema::Fill(Message* message, int level, bool root) {
+  const auto* descriptor = message->GetDescriptor();
+  const auto* ref = message->GetReflection();
+  for (int i = 0; i < shape_.width; ++i) {
+    const auto* field = descriptor->field(i);
+    const auto value = ScalarValue(i, level);
+    switch (field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        ref->SetInt32(message, field, static_cast<int32_t>(-value));
+        break;
+      case FieldDescriptor::CPPTYPE_INT64:
+        ref->SetInt64(message, field, -value * 1000003);
+        break;
+      case FieldDescriptor::CPPTYPE_UINT32:
+        ref->SetUInt32(message, field, static_cast<uint32_t>(value));
+        break;
+      case FieldDescriptor::CPPTYPE_UINT64:
+        ref->SetUInt64(message, field, uint64_t(value) << 20);
+        break;
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        ref->SetFloat(message, field, value / 8.0f);
+        break;
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        ref->SetDouble(message, field, value / 3.0);
+        break;
+      case FieldDescriptor::CPPTYPE_BOOL:
+        ref->SetBool(message, field, true);
+        break;
+      case FieldDescriptor::CPPTYPE_ENUM:
+        ref->SetEnumValue(message, field, 1 + value % 2);
+        break;
+      default:
+        break;
+    }
+  }
+  ref->SetString(message, descriptor->FindFieldByName("text_value"),
+                 std::string(shape_.string_size, 'a' + level % 26));
+  ref->SetString(message, descriptor->FindFieldByName("blob_value"),
+                 std::string(shape_.string_size, '\x80' + level % 64));
+  if (level < shape_.depth) {
+    Fill(ref->MutableMessage(message, descriptor->FindFieldByName("child")),
+         level + 1, false);
+  }
+  if (!root) {
+    return;
+  }
+  const auto* items = descriptor->FindFieldByName("items");
+  const auto* numbers = descriptor->FindFieldByName("numbers");
+  const auto* counts = descriptor->FindFieldByName("counts");
+  for (int i = 0; i < shape_.repeated; ++i) {
+    Fill(ref->AddMessage(message, items), shape_.depth, false);
+    ref->AddInt64(message, numbers, ScalarValue(i, 0) * 1000003);
+  }
+  for (int i = 0; i < shape_.map; ++i) {
+    auto* entry = ref->AddMessage(message, counts);
+    const auto* entry_ref = entry->GetReflection();
+    entry_ref->SetString(entry, entry->GetDescriptor()->field(0),
+                         "key_" + std::to_string(i));
+    entry_ref->SetInt64(entry, entry->GetDescriptor()->field(1),
+                        ScalarValue(i, 0));
+  }
+}
+}  // namespace magic::bench
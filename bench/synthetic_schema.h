@@ -0,0 +1,56 @@
+#ifndef CONVERT_BENCH_SYNTHETIC_SCHEMA_H_
+#define CONVERT_BENCH_SYNTHETIC_SCHEMA_H_
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/dynamic_message.h>
+
+#include <memory>
+#include <string>
+
+namespace magic::bench {
+// Dimensions of a generated schema, each varied on its own.
+struct SchemaShape {
+  // Scalar fields per message, cycling through every scalar type.
+  int width = 8;
+  // Messages nested below the root, each with its own scalar fields.
+  int depth = 1;
+  // Elements of the repeated message and packed repeated int64 fields.
+  int repeated = 0;
+  // Entries of the map<string, int64> field.
+  int map = 0;
+  // Bytes in each string and bytes field.
+  int string_size = 16;
+
+  std::string Name() const;
+};
+
+// A proto3 schema built from a SchemaShape in its own DescriptorPool, and a
+// payload for its root message with every field set.
+//
+//   message Level<i> {
+//     <width scalar fields>
+//     string text; bytes blob;
+//     Level<i + 1> child;                 // up to |depth|
+//     repeated Level<depth> items;        // root only
+//     repeated int64 numbers;             // root only
+//     map<string, int64> counts;          // root only
+//   }
+class SyntheticSchema {
+ public:
+  explicit SyntheticSchema(const SchemaShape& shape);
+
+  google::protobuf::DescriptorPool* pool() { return &pool_; }
+  const std::string& root_type() const { return root_type_; }
+  const std::string& payload() const { return payload_; }
+
+ private:
+  void Fill(google::protobuf::Message* message, int level, bool root);
+
+  SchemaShape shape_;
+  google::protobuf::DescriptorPool pool_;
+  std::string root_type_;
+  std::string payload_;
+};
+}  // namespace magic::bench
+
+#endif  // CONVERT_BENCH_SYNTHETIC_SCHEMA_H_
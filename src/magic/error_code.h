@@ -64,7 +64,7 @@ enum class CommonError;
 
 namespace std {
 template <>
-struct std::is_error_code_enum<magic::CommonError> : true_type {};
+struct is_error_code_enum<magic::CommonError> : true_type {};
 }  // namespace std
 
 namespace magic {
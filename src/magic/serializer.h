@@ -1,8 +1,15 @@
 #ifndef CONVERT_SRC_MAGIC_SERIALIZER_H_
 #define CONVERT_SRC_MAGIC_SERIALIZER_H_
 
+#include <cerrno>
 #include <charconv>
-#include <sstream>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace magic::detail {
 auto from_fn(auto&&... args) {
@@ -24,14 +31,145 @@ struct Serializer {
   }
 };
 
+// Forms string_to_number accepts besides plain decimals like "-12",
+// "+7" and, for floating point, "2.5e-3".
+enum NumberForms : unsigned {
+  kNumberDecimal = 0,
+  // "0x1F", "-0x1f" integers.
+  kNumberHex = 1u << 0,
+  // "1e3" integers, as long as the result is in range.
+  kNumberExponent = 1u << 1,
+};
+
 template <typename T>
-  requires(std::is_arithmetic_v<T>)
-std::optional<T> string_to_number(std::string_view str) {
+std::optional<T> integer_from_magnitude(uint64_t magnitude, bool negative) {
+  if (!negative) {
+    if (magnitude > uint64_t(std::numeric_limits<T>::max())) {
+      return std::nullopt;
+    }
+    return T(magnitude);
+  }
+  if constexpr (std::is_unsigned_v<T>) {
+    return magnitude == 0 ? std::optional<T>(0) : std::nullopt;
+  } else {
+    if (magnitude > uint64_t(std::numeric_limits<T>::max()) + 1) {
+      return std::nullopt;
+    }
+    return T(int64_t(0 - magnitude));
+  }
+}
+
+inline std::optional<uint64_t> string_to_magnitude(std::string_view str,
+                                                   unsigned forms) {
+  int base = 10;
+  if ((forms & kNumberHex) && str.size() > 2 && str[0] == '0' &&
+      (str[1] == 'x' || str[1] == 'X')) {
+    base = 16;
+    str.remove_prefix(2);
+  }
+  const char* end = str.data() + str.size();
+  uint64_t magnitude = 0;
+  auto [ptr, ec] = std::from_chars(str.data(), end, magnitude, base);
+  if (ec != std::errc()) {
+    return std::nullopt;
+  }
+  if (ptr != end) {
+    if (base != 10 || !(forms & kNumberExponent) ||
+        (*ptr != 'e' && *ptr != 'E')) {
+      return std::nullopt;
+    }
+    if (++ptr != end && *ptr == '+') {
+      ++ptr;
+    }
+    unsigned exponent = 0;
+    auto [exponent_end, exponent_ec] = std::from_chars(ptr, end, exponent);
+    if (exponent_ec != std::errc() || exponent_end != end) {
+      return std::nullopt;
+    }
+    for (; exponent > 0 && magnitude != 0; --exponent) {
+      if (magnitude > std::numeric_limits<uint64_t>::max() / 10) {
+        return std::nullopt;
+      }
+      magnitude *= 10;
+    }
+  }
+  return magnitude;
+}
+
+template <typename T>
+std::optional<T> string_to_floating(std::string_view str) {
+  // Digits first keeps out "inf", "nan" and hex floats.
+  if (str.empty() || (str[0] != '.' && (str[0] < '0' || str[0] > '9')) ||
+      str.find_first_of("xX") != std::string_view::npos) {
+    return std::nullopt;
+  }
   T v{};
-  std::stringstream ss;
-  ss << str;
-  ss >> v;
-  return ss.good() ? std::optional<T>(v) : std::optional<T>();
+#if defined(__cpp_lib_to_chars)
+  auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), v);
+  if (ec != std::errc() || ptr != str.data() + str.size()) {
+    return std::nullopt;
+  }
+#else
+  // Standard libraries without floating point from_chars; strtod needs a
+  // terminated copy, which fits on the stack for any sane input.
+  char buffer[64];
+  std::string long_copy;
+  const char* begin = buffer;
+  if (str.size() < sizeof(buffer)) {
+    str.copy(buffer, str.size());
+    buffer[str.size()] = '\0';
+  } else {
+    long_copy.assign(str);
+    begin = long_copy.c_str();
+  }
+  char* end = nullptr;
+  errno = 0;
+  if constexpr (std::is_same_v<T, float>) {
+    v = std::strtof(begin, &end);
+  } else {
+    v = std::strtod(begin, &end);
+  }
+  if (errno == ERANGE || end != begin + str.size()) {
+    return std::nullopt;
+  }
+#endif
+  return v;
+}
+
+// Parses the whole of |str| as a T, nullopt for anything else including
+// values out of T's range. No whitespace, locale or allocation involved.
+template <typename T>
+  requires(std::is_arithmetic_v<T>)
+std::optional<T> string_to_number(std::string_view str,
+                                  unsigned forms = kNumberDecimal) {
+  if constexpr (std::is_same_v<T, bool>) {
+    if (str == "true" || str == "1") {
+      return true;
+    }
+    if (str == "false" || str == "0") {
+      return false;
+    }
+    return std::nullopt;
+  } else {
+    bool negative = false;
+    if (!str.empty() && (str[0] == '-' || str[0] == '+')) {
+      negative = str[0] == '-';
+      str.remove_prefix(1);
+    }
+    if constexpr (std::is_integral_v<T>) {
+      auto magnitude = string_to_magnitude(str, forms);
+      if (!magnitude) {
+        return std::nullopt;
+      }
+      return integer_from_magnitude<T>(*magnitude, negative);
+    } else {
+      auto v = string_to_floating<T>(str);
+      if (v && negative) {
+        *v = -*v;
+      }
+      return v;
+    }
+  }
 }
 }
 
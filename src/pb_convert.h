@@ -5,13 +5,76 @@ NS_ASSUME_NONNULL_BEGIN
 @interface PBConvert : NSObject
 - (instancetype)initWithPBDescPath:(NSString*)pbDescPath;
 
+// Seconds init spent mapping and indexing the descriptor set. Types are
+// built on first use, so this is the cold-start cost.
+- (NSTimeInterval)startupTime;
+
+// Switches to another descriptor set from any thread without pausing
+// conversions, those already running finish on the previous set. Returns
+// NO and keeps the current set if pbDescPath cannot be loaded. Like init,
+// the new set builds each type on its first use.
+- (BOOL)reloadWithPBDescPath:(NSString*)pbDescPath;
+
+// Like reloadWithPBDescPath:, but builds messageTypes on a worker pool
+// before the switch, so their first conversions on the new set are not
+// slower than the ones after.
+- (BOOL)reloadWithPBDescPath:(NSString*)pbDescPath
+            warmMessageTypes:(NSArray<NSString*>*)messageTypes;
+
 - (NSData*)encode:(id)object messageType:(NSString*)messageType;
 
+// Encodes into the caller's bytes without allocating. Returns the encoded
+// size, written only if it is at most capacity, or -1 on failure.
+- (NSInteger)encode:(id)object
+        messageType:(NSString*)messageType
+          intoBytes:(void*)bytes
+           capacity:(NSUInteger)capacity;
+
+// Replaces the contents of data, reusing its storage. Returns NO on failure.
+- (BOOL)encode:(id)object
+    messageType:(NSString*)messageType
+       intoData:(NSMutableData*)data;
+
+// Capacity likely to fit the next messageType message, learned from the
+// sizes encoded so far.
+- (NSUInteger)estimatedSizeForMessageType:(NSString*)messageType;
+
+// Encodes every object as messageType into one buffer of varint length
+// prefixed records, failed objects are empty records. errorCodes receives
+// one NSNumber per object, 0 on success.
+- (NSData*)encodeBatch:(NSArray*)objects
+           messageType:(NSString*)messageType
+            errorCodes:(NSArray<NSNumber*>* _Nullable* _Nullable)errorCodes;
+
 - (id)decode:(NSData*)data
      messageType:(NSString*)messageType
     useCamelcase:(BOOL)useCamelcase;
 
+// Like decode, but strings and bytes in the result point into data instead
+// of being copied, and keep it alive. Mutable data is copied once first.
+- (id)decodeNoCopy:(NSData*)data
+       messageType:(NSString*)messageType
+      useCamelcase:(BOOL)useCamelcase;
+
+// Decodes dataArray[i] as messageTypes[i] on a worker pool. Failed items
+// are NSNull, errorCodes receives one NSNumber per item, 0 on success.
+- (NSArray*)decodeBatch:(NSArray<NSData*>*)dataArray
+            messageTypes:(NSArray<NSString*>*)messageTypes
+            useCamelcase:(BOOL)useCamelcase
+              errorCodes:(NSArray<NSNumber*>* _Nullable* _Nullable)errorCodes;
+
 - (id)create:(NSString*)messageType useCamelcase:(BOOL)useCamelcase;
+
+// JSON form of data, a messageType message, transcoded without objects in
+// between. nil on failure.
+- (nullable NSString*)jsonFromData:(NSData*)data
+                       messageType:(NSString*)messageType
+                      useCamelcase:(BOOL)useCamelcase;
+
+// Wire format of json, a messageType message, transcoded without objects
+// in between. Unknown keys are skipped. nil on failure.
+- (nullable NSData*)dataFromJson:(NSString*)json
+                     messageType:(NSString*)messageType;
 @end
 
 NS_ASSUME_NONNULL_END
@@ -15,10 +15,71 @@
   return self.impl ? self : nil;
 }
 
+- (NSTimeInterval)startupTime {
+  return std::chrono::duration<double>(self.impl->descriptor_stats().open_time)
+      .count();
+}
+
+- (BOOL)reloadWithPBDescPath:(NSString*)pbDescPath {
+  return [self reloadWithPBDescPath:pbDescPath warmMessageTypes:@[]];
+}
+
+- (BOOL)reloadWithPBDescPath:(NSString*)pbDescPath
+            warmMessageTypes:(NSArray<NSString*>*)messageTypes {
+  std::vector<std::string> types(messageTypes.count);
+  for (NSUInteger i = 0; i < messageTypes.count; i++) {
+    types[i] = [messageTypes[i] UTF8String];
+  }
+  if (!self.impl->Reload([pbDescPath UTF8String], types)) {
+    return NO;
+  }
+  self.pbDescPath = pbDescPath;
+  return YES;
+}
+
 - (NSData*)encode:(id)object messageType:(NSString*)messageType {
   return self.impl->Encode(object, [messageType UTF8String]);
 }
 
+- (NSInteger)encode:(id)object
+        messageType:(NSString*)messageType
+          intoBytes:(void*)bytes
+           capacity:(NSUInteger)capacity {
+  auto [error_code, size] = self.impl->EncodeInto(
+      object, [messageType UTF8String],
+      std::span<uint8_t>(static_cast<uint8_t*>(bytes), capacity));
+  return !error_code ? static_cast<NSInteger>(size) : -1;
+}
+
+- (BOOL)encode:(id)object
+    messageType:(NSString*)messageType
+       intoData:(NSMutableData*)data {
+  return !self.impl->EncodeInto(object, [messageType UTF8String], data);
+}
+
+- (NSUInteger)estimatedSizeForMessageType:(NSString*)messageType {
+  return self.impl->EstimateSize([messageType UTF8String]);
+}
+
+- (NSData*)encodeBatch:(NSArray*)objects
+           messageType:(NSString*)messageType
+            errorCodes:(NSArray<NSNumber*>* _Nullable* _Nullable)errorCodes {
+  std::vector<magic::PlatformObject> items(objects.count);
+  for (NSUInteger i = 0; i < objects.count; i++) {
+    items[i] = objects[i];
+  }
+  auto batch = self.impl->EncodeBatch(items, [messageType UTF8String]);
+  if (errorCodes) {
+    NSMutableArray<NSNumber*>* codes =
+        [NSMutableArray arrayWithCapacity:objects.count];
+    for (const auto& error_code : batch.error_codes) {
+      [codes addObject:@(error_code.value())];
+    }
+    *errorCodes = codes;
+  }
+  return batch.data;
+}
+
 - (id)decode:(NSData*)data
      messageType:(NSString*)messageType
     useCamelcase:(BOOL)useCamelcase {
@@ -29,8 +90,75 @@
       magic::PBOptions{.use_camelcase = useCamelcase});
 }
 
+- (id)decodeNoCopy:(NSData*)data
+       messageType:(NSString*)messageType
+      useCamelcase:(BOOL)useCamelcase {
+  auto owner = std::make_shared<NSData*>([data copy]);
+  return self.impl->Decode(
+      magic::PBInfo{.type = [messageType UTF8String],
+                    .data = {reinterpret_cast<const char*>((*owner).bytes),
+                             (*owner).length},
+                    .owner = owner},
+      magic::PBOptions{.use_camelcase = useCamelcase, .borrow_bytes = true});
+}
+
+- (NSArray*)decodeBatch:(NSArray<NSData*>*)dataArray
+            messageTypes:(NSArray<NSString*>*)messageTypes
+            useCamelcase:(BOOL)useCamelcase
+              errorCodes:(NSArray<NSNumber*>* _Nullable* _Nullable)errorCodes {
+  NSUInteger count = MIN(dataArray.count, messageTypes.count);
+  std::vector<magic::PBInfo> pb_infos;
+  pb_infos.reserve(count);
+  for (NSUInteger i = 0; i < count; i++) {
+    NSData* data = dataArray[i];
+    pb_infos.push_back(magic::PBInfo{
+        .type = [messageTypes[i] UTF8String],
+        .data = {reinterpret_cast<const char*>(data.bytes), data.length}});
+  }
+  auto results = self.impl->DecodeBatch(
+      pb_infos, magic::PBOptions{.use_camelcase = useCamelcase});
+
+  NSMutableArray* objects = [NSMutableArray arrayWithCapacity:count];
+  NSMutableArray<NSNumber*>* codes = [NSMutableArray arrayWithCapacity:count];
+  for (auto& [error_code, object] : results) {
+    [objects addObject:!error_code && object ? object : [NSNull null]];
+    [codes addObject:@(error_code.value())];
+  }
+  if (errorCodes) {
+    *errorCodes = codes;
+  }
+  return objects;
+}
+
 - (id)create:(NSString*)messageType useCamelcase:(BOOL)useCamelcase {
   return self.impl->Create([messageType UTF8String],
                            magic::PBOptions { .use_camelcase = useCamelcase });
 }
+
+- (NSString*)jsonFromData:(NSData*)data
+              messageType:(NSString*)messageType
+             useCamelcase:(BOOL)useCamelcase {
+  std::string json;
+  if (self.impl->ToJson(
+          magic::PBInfo{
+              .type = [messageType UTF8String],
+              .data = {reinterpret_cast<const char*>(data.bytes),
+                       data.length}},
+          &json, magic::PBOptions{.use_camelcase = useCamelcase})) {
+    return nil;
+  }
+  return [[NSString alloc] initWithBytes:json.data()
+                                  length:json.size()
+                                encoding:NSUTF8StringEncoding];
+}
+
+- (NSData*)dataFromJson:(NSString*)json
+            messageType:(NSString*)messageType {
+  std::string pb;
+  if (self.impl->FromJson([json UTF8String], [messageType UTF8String],
+                          &pb)) {
+    return nil;
+  }
+  return [NSData dataWithBytes:pb.data() length:pb.size()];
+}
 @end
@@ -40,6 +40,7 @@ NSObject* to_oc(double cpp_v);
 NSObject* to_oc(bool cpp_v);
 NSObject* to_oc(const char* cpp_v);
 NSObject* to_oc(const std::string& cpp_v);
+NSObject* to_oc(std::string_view cpp_v);
 NSObject* to_oc(std::span<const uint8_t> cpp_v);
 NSObject* to_oc(const std::vector<uint8_t>& cpp_v);
 
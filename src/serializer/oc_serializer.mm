@@ -91,6 +91,12 @@ NSObject* to_oc(const std::string& cpp_v) {
   return to_oc(cpp_v.data());
 }
 
+NSObject* to_oc(std::string_view cpp_v) {
+  return [[NSString alloc] initWithBytes:cpp_v.data()
+                                  length:cpp_v.size()
+                                encoding:NSUTF8StringEncoding];
+}
+
 NSObject* to_oc(std::span<const uint8_t> cpp_v) {
   return [NSData dataWithBytes:cpp_v.data() length:cpp_v.size()];
 }
@@ -0,0 +1,89 @@
+#include "serializer/pb_arena.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace magic::pb {
+namespace {
+google::protobuf::ArenaOptions MakeOptions(const ArenaConfig& config,
+                                           char* block,
+                                           std::size_t block_size) {
+  google::protobuf::ArenaOptions options;
+  options.start_block_size =
+      std::max(config.initial_block_size, options.start_block_size);
+  options.initial_block = block;
+  options.initial_block_size = block_size;
+  return options;
+}
+}  // namespace
+
+ThreadArena::Lease::Lease(Lease&& other) noexcept
+    : owner_(std::exchange(other.owner_, nullptr)),
+      arena_(std::exchange(other.arena_, nullptr)),
+      transient_(std::move(other.transient_)) {}
+
+ThreadArena::Lease& ThreadArena::Lease::operator=(Lease&& other) noexcept {
+  if (this != &other) {
+    Release();
+    owner_ = std::exchange(other.owner_, nullptr);
+    arena_ = std::exchange(other.arena_, nullptr);
+    transient_ = std::move(other.transient_);
+  }
+  return *this;
+}
+
+ThreadArena::Lease::~Lease() {
+  Release();
+}
+
+void ThreadArena::Lease::Release() {
+  if (owner_) {
+    owner_->Release();
+  }
+  owner_ = nullptr;
+  arena_ = nullptr;
+  transient_.reset();
+}
+
+ThreadArena::Lease ThreadArena::Acquire(const ArenaConfig& config) {
+  thread_local ThreadArena current;
+  Lease lease;
+  if (current.leased_) {
+    lease.transient_ =
+        std::make_unique<Arena>(MakeOptions(config, nullptr, 0));
+    lease.arena_ = lease.transient_.get();
+    return lease;
+  }
+  if (!current.arena_ || current.config_ != config) {
+    current.config_ = config;
+    current.Rebuild(
+        std::min(config.initial_block_size, config.max_retained_size));
+  }
+  current.leased_ = true;
+  lease.owner_ = &current;
+  lease.arena_ = current.arena_.get();
+  return lease;
+}
+
+// The arena has to go before the block it was built on.
+void ThreadArena::Rebuild(std::size_t block_size) {
+  arena_.reset();
+  if (block_size != block_size_) {
+    block_.reset(block_size ? new char[block_size] : nullptr);
+    block_size_ = block_size;
+  }
+  arena_ = std::make_unique<Arena>(MakeOptions(config_, block_.get(),
+                                               block_size_));
+}
+
+void ThreadArena::Release() {
+  leased_ = false;
+  std::size_t allocated = arena_->SpaceAllocated();
+  if (allocated > block_size_ && block_size_ < config_.max_retained_size) {
+    Rebuild(std::min(std::bit_ceil(allocated), config_.max_retained_size));
+  } else {
+    arena_->Reset();
+  }
+}
+}  // namespace magic::pb
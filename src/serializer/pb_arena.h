@@ -0,0 +1,67 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_ARENA_H_
+#define CONVERT_SRC_SERIALIZER_PB_ARENA_H_
+
+#include <google/protobuf/arena.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace magic::pb {
+using google::protobuf::Arena;
+
+struct ArenaConfig {
+  // Size of the block a thread's arena starts from. The block grows to fit
+  // the largest conversion seen on the thread, up to |max_retained_size|;
+  // anything beyond that is returned to the system after each call.
+  std::size_t initial_block_size = 16 * 1024;
+  std::size_t max_retained_size = 1024 * 1024;
+
+  bool operator==(const ArenaConfig&) const = default;
+};
+
+// One Arena per thread, Reset() between conversions so steady-state calls
+// only touch memory the thread already owns.
+class ThreadArena {
+ public:
+  // Exclusive use of the calling thread's arena until destroyed. A nested
+  // lease on the same thread gets a private arena instead.
+  class Lease {
+   public:
+    Lease() = default;
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&& other) noexcept;
+    ~Lease();
+
+    Arena* get() const { return arena_; }
+
+   private:
+    friend class ThreadArena;
+
+    void Release();
+
+    ThreadArena* owner_ = nullptr;
+    Arena* arena_ = nullptr;
+    std::unique_ptr<Arena> transient_;
+  };
+
+  ThreadArena(const ThreadArena&) = delete;
+  ThreadArena& operator=(const ThreadArena&) = delete;
+
+  static Lease Acquire(const ArenaConfig& config);
+
+ private:
+  ThreadArena() = default;
+
+  void Rebuild(std::size_t block_size);
+
+  void Release();
+
+  ArenaConfig config_;
+  std::size_t block_size_ = 0;
+  std::unique_ptr<char[]> block_;
+  std::unique_ptr<Arena> arena_;
+  bool leased_ = false;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_ARENA_H_
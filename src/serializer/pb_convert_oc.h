@@ -1,27 +1,155 @@
 #ifndef CONVERT_SRC_SERIALIZER_PB_CONVERT_OC_H_
 #define CONVERT_SRC_SERIALIZER_PB_CONVERT_OC_H_
 
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "serializer/pb_descriptor_set.h"
+#include "serializer/pb_json.h"
+#include "serializer/pb_push_parser.h"
+#include "serializer/pb_rcu_ptr.h"
+#include "serializer/pb_record_reader.h"
 #include "serializer/pb_serializer_oc.h"
+#include "serializer/pb_worker_pool.h"
 
 namespace magic {
+using DescriptorSet = pb::DescriptorSet;
+using PushParser = pb::PushParser<PlatformObject>;
+using RecordReader = pb::RecordReader<PlatformObject>;
+
+enum class BatchLayout {
+  // Every item is a varint length followed by its bytes, failed items are
+  // empty records.
+  kLengthDelimited,
+  // Items are concatenated, EncodedBatch::offsets delimits them.
+  kOffsets,
+};
+
+struct EncodedBatch {
+  NSData* data = nil;
+  // kOffsets only, item i is [offsets[i], offsets[i + 1]) of |data|.
+  std::vector<std::size_t> offsets;
+  std::vector<ErrorCode> error_codes;
+  std::vector<WarnningFields> warnning_fields;
+};
+
 class PBConvert {
  public:
   ~PBConvert();
 
-  static std::unique_ptr<PBConvert> New(const std::string& pb_desc_path);
+  static std::unique_ptr<PBConvert> New(const std::string& pb_desc_path,
+                                        const ArenaConfig& arena = {});
+
+  // Switches to another descriptor set, loaded on the calling thread while
+  // conversions go on. Calls already running, and parsers, record readers
+  // and lazy objects made before, keep the previous set until they are
+  // done with it. Returns false and keeps the current set if
+  // |pb_desc_path| cannot be loaded.
+  //
+  // The new set starts with empty caches, so the first conversion of each
+  // type after the switch builds its descriptors, prototype and plans, as
+  // after New. |warm_types| and the types they contain are built on the
+  // worker pool before the switch, with the field names |options| selects.
+  bool Reload(const std::string& pb_desc_path,
+              std::span<const std::string> warm_types = {},
+              const PBOptions& options = {});
+
+  NSData* Encode(PlatformObject object,
+                 std::string_view pb_type,
+                 const PBOptions& options = {});
+
+  // Encodes into |out| without allocating, see pb::to_pb_into. Returns the
+  // encoded size, which exceeds out.size() when nothing was written.
+  std::pair<ErrorCode, std::size_t> EncodeInto(PlatformObject object,
+                                               std::string_view pb_type,
+                                               std::span<uint8_t> out,
+                                               const PBOptions& options = {});
+
+  // Replaces the contents of |data|, reusing its storage when large enough.
+  ErrorCode EncodeInto(PlatformObject object,
+                       std::string_view pb_type,
+                       NSMutableData* data,
+                       const PBOptions& options = {});
+
+  // Buffer size likely to fit the next |pb_type| message, learned from the
+  // sizes encoded so far.
+  std::size_t EstimateSize(std::string_view pb_type);
 
-  NSData* Encode(PlatformObject object, std::string_view pb_type);
+  // Encodes |objects| of one |pb_type| on the shared worker pool into a
+  // single buffer allocated once the encoded sizes are known.
+  EncodedBatch EncodeBatch(std::span<const PlatformObject> objects,
+                           std::string_view pb_type,
+                           BatchLayout layout = BatchLayout::kLengthDelimited,
+                           const PBOptions& options = {});
 
   PlatformObject Decode(const PBInfo& pb_info, const PBOptions& options = {});
 
+  // Decodes every item on the shared worker pool. Results line up with
+  // |pb_infos|, failed items hold their error and nil.
+  std::vector<std::pair<ErrorCode, PlatformObject>> DecodeBatch(
+      std::span<const PBInfo> pb_infos,
+      const PBOptions& options = {});
+
+  // Transcodes between the wire format and JSON without platform objects,
+  // replacing the contents of |out| and reusing its storage. See
+  // pb::to_json and pb::from_json.
+  ErrorCode ToJson(const PBInfo& pb_info,
+                   std::string* out,
+                   const PBOptions& options = {});
+  ErrorCode FromJson(std::string_view json,
+                     std::string_view pb_type,
+                     std::string* out);
+
+  // Parser for one |pb_type| payload received in chunks.
+  std::unique_ptr<PushParser> NewParser(std::string_view pb_type,
+                                        const PBOptions& options = {});
+
+  // Maps |path|, a file of varint length delimited |pb_type| records.
+  std::unique_ptr<RecordReader> OpenRecords(const std::string& path,
+                                            std::string_view pb_type,
+                                            const PBOptions& options = {});
+
   PlatformObject Create(std::string_view pb_type,
                         const PBOptions& options = {});
 
+  DescriptorSet::Stats descriptor_stats() const;
+
  private:
-  PBConvert(const std::string& pb_desc_path);
+  // Everything derived from one descriptor set, released when the last
+  // conversion using it is done.
+  struct Snapshot {
+    std::unique_ptr<DescriptorSet> descriptors;
+    std::unique_ptr<MessagePool> message_pool;
+    std::unique_ptr<PlanCache> plans;
+    std::unique_ptr<pb::SizeEstimator> sizes;
+    std::unique_ptr<pb::JsonPlanCache> json_plans;
+  };
+
+  PBConvert(std::shared_ptr<const Snapshot> snapshot,
+            const ArenaConfig& arena);
+
+  static std::shared_ptr<const Snapshot> LoadSnapshot(
+      const std::string& pb_desc_path);
+
+  // Builds the descriptors, prototypes and plans of |types| in |snapshot|.
+  void Warm(const Snapshot& snapshot,
+            std::span<const std::string> types,
+            const PBOptions& options);
+
+  PBRuntime runtime() const;
+
+  WorkerPool* workers();
+
+  // |options| with the shared pool when they ask for parallel conversion.
+  PBOptions WithWorkers(const PBOptions& options);
 
  private:
-  std::unique_ptr<DescriptorPool> pb_pool_;
+  pb::RcuPtr<Snapshot> snapshot_;
+  ArenaConfig arena_;
+  std::once_flag workers_once_;
+  std::unique_ptr<WorkerPool> workers_;
 };
 }  // namespace magic
 
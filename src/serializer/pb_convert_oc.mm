@@ -1,50 +1,281 @@
 #include "serializer/pb_convert_oc.h"
 
-#include <google/protobuf/descriptor.pb.h>
-
-#include <fstream>
+#include "serializer/pb_wire_format.h"
 
 namespace magic {
-PBConvert::PBConvert(const std::string& pb_desc_path) {
-  std::ifstream file(pb_desc_path, std::ios::binary | std::ios::ate);
-  if (file) {
-    using google::protobuf::FileDescriptorSet;
-    auto size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<char> buffer(size);
-    file.read(buffer.data(), size);
-    FileDescriptorSet descriptors;
-    if (!descriptors.ParseFromArray(buffer.data(),
-                                    static_cast<int>(buffer.size())))
+namespace {
+// Buffer for to_pb_into that appends to a worker's scratch vector.
+struct ScratchTail {
+  using value_type = uint8_t;
+
+  void resize(std::size_t size) {
+    offset = scratch->size();
+    scratch->resize(offset + size);
+  }
+
+  const uint8_t* data() const { return scratch->data() + offset; }
+
+  std::vector<uint8_t>* scratch = nullptr;
+  std::size_t offset = 0;
+};
+
+// Buffer for to_pb_into that resizes a caller's NSMutableData.
+struct MutableDataBuffer {
+  using value_type = void;
+
+  void resize(std::size_t size) { target.length = size; }
+
+  const void* data() const { return target.mutableBytes; }
+
+  NSMutableData* target = nil;
+};
+
+struct EncodedItem {
+  std::size_t slot = 0;
+  std::size_t offset = 0;
+  std::size_t size = 0;
+};
+}  // namespace
+
+PBConvert::PBConvert(std::shared_ptr<const Snapshot> snapshot,
+                     const ArenaConfig& arena)
+    : snapshot_(std::move(snapshot)), arena_(arena) {}
+
+PBConvert::~PBConvert() = default;
+
+std::shared_ptr<const PBConvert::Snapshot> PBConvert::LoadSnapshot(
+    const std::string& pb_desc_path) {
+  auto descriptors = DescriptorSet::Open(pb_desc_path);
+  if (!descriptors) {
+    return nullptr;
+  }
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->descriptors = std::move(descriptors);
+  snapshot->message_pool = std::make_unique<MessagePool>();
+  snapshot->plans = std::make_unique<PlanCache>();
+  snapshot->sizes = std::make_unique<pb::SizeEstimator>();
+  snapshot->json_plans = std::make_unique<pb::JsonPlanCache>();
+  return snapshot;
+}
+
+PBRuntime PBConvert::runtime() const {
+  auto snapshot = snapshot_.Load();
+  auto* sizes = snapshot->sizes.get();
+  return {.descriptor_pool = snapshot->descriptors->pool(),
+          .message_pool = snapshot->message_pool.get(),
+          .plans = snapshot->plans.get(),
+          .arena = arena_,
+          .owner = std::move(snapshot),
+          .sizes = sizes};
+}
+
+WorkerPool* PBConvert::workers() {
+  std::call_once(workers_once_,
+                 [this] { workers_ = std::make_unique<WorkerPool>(); });
+  return workers_.get();
+}
+
+PBOptions PBConvert::WithWorkers(const PBOptions& options) {
+  PBOptions result = options;
+  if (result.parallel_threshold && !result.workers) {
+    result.workers = workers();
+  }
+  return result;
+}
+
+std::unique_ptr<PBConvert> PBConvert::New(const std::string& pb_desc_path,
+                                          const ArenaConfig& arena) {
+  auto snapshot = LoadSnapshot(pb_desc_path);
+  if (!snapshot) {
+    return nullptr;
+  }
+  return std::unique_ptr<PBConvert>(new PBConvert(std::move(snapshot), arena));
+}
+
+void PBConvert::Warm(const Snapshot& snapshot,
+                     std::span<const std::string> types,
+                     const PBOptions& options) {
+  if (types.empty()) {
+    return;
+  }
+  const auto* pool = snapshot.descriptors->pool();
+  workers()->ParallelFor(types.size(), [&](std::size_t index, std::size_t) {
+    const auto* descriptor = snapshot.plans->FindType(pool, types[index]);
+    if (!descriptor) {
       return;
-    pb_pool_ = std::make_unique<DescriptorPool>();
-    for (int i = 0; i < descriptors.file_size(); i++) {
-      assert(pb_pool_->BuildFile(descriptors.file(i)));
     }
-  }
+    snapshot.message_pool->GetPrototype(descriptor);
+    snapshot.plans->Get(descriptor, options);
+    snapshot.json_plans->Get(descriptor);
+  });
 }
 
-PBConvert::~PBConvert() = default;
+bool PBConvert::Reload(const std::string& pb_desc_path,
+                       std::span<const std::string> warm_types,
+                       const PBOptions& options) {
+  auto snapshot = LoadSnapshot(pb_desc_path);
+  if (!snapshot) {
+    return false;
+  }
+  Warm(*snapshot, warm_types, options);
+  snapshot_.Store(std::move(snapshot));
+  return true;
+}
 
-std::unique_ptr<PBConvert> PBConvert::New(const std::string& pb_desc_path) {
-  auto convert = std::unique_ptr<PBConvert>(new PBConvert(pb_desc_path));
-  return convert->pb_pool_ ? std::move(convert) : std::unique_ptr<PBConvert>{};
+DescriptorSet::Stats PBConvert::descriptor_stats() const {
+  return snapshot_.Load()->descriptors->stats();
 }
 
-NSData* PBConvert::Encode(PlatformObject object, std::string_view pb_type) {
-  auto res = to_pb(object, pb_pool_.get(), pb_type);
+NSData* PBConvert::Encode(PlatformObject object,
+                          std::string_view pb_type,
+                          const PBOptions& options) {
+  auto res = to_pb(object, runtime(), pb_type, nullptr, WithWorkers(options));
   return !res.first ? res.second : nil;
 }
 
+std::pair<ErrorCode, std::size_t> PBConvert::EncodeInto(
+    PlatformObject object,
+    std::string_view pb_type,
+    std::span<uint8_t> out,
+    const PBOptions& options) {
+  return pb::to_pb_into<PlatformObject>(object, runtime(), pb_type, out,
+                                        nullptr, WithWorkers(options));
+}
+
+ErrorCode PBConvert::EncodeInto(PlatformObject object,
+                                std::string_view pb_type,
+                                NSMutableData* data,
+                                const PBOptions& options) {
+  MutableDataBuffer buffer{.target = data};
+  return pb::to_pb_into<PlatformObject>(object, runtime(), pb_type, &buffer,
+                                        nullptr, WithWorkers(options));
+}
+
+std::size_t PBConvert::EstimateSize(std::string_view pb_type) {
+  auto pb_runtime = runtime();
+  const auto* descriptor =
+      pb_runtime.plans->FindType(pb_runtime.descriptor_pool, pb_type);
+  return descriptor ? pb_runtime.sizes->Estimate(descriptor)
+                    : pb::SizeEstimator::kDefaultEstimate;
+}
+
+EncodedBatch PBConvert::EncodeBatch(std::span<const PlatformObject> objects,
+                                    std::string_view pb_type,
+                                    BatchLayout layout,
+                                    const PBOptions& options) {
+  EncodedBatch batch;
+  batch.error_codes.assign(objects.size(), CommonError::UNKNOWN);
+  batch.warnning_fields.resize(objects.size());
+  std::vector<EncodedItem> items(objects.size());
+  std::vector<std::vector<uint8_t>> scratch(workers()->size());
+  auto pb_runtime = runtime();
+  auto item_options = WithWorkers(options);
+  workers()->ParallelFor(
+      objects.size(), [&](std::size_t index, std::size_t slot) {
+        @autoreleasepool {
+          ScratchTail tail{.scratch = &scratch[slot]};
+          batch.error_codes[index] = pb::to_pb_into<PlatformObject>(
+              objects[index], pb_runtime, pb_type, &tail,
+              &batch.warnning_fields[index], item_options);
+          if (!batch.error_codes[index]) {
+            items[index] = {.slot = slot,
+                            .offset = tail.offset,
+                            .size = scratch[slot].size() - tail.offset};
+          }
+        }
+      });
+
+  std::vector<std::size_t> starts(objects.size() + 1);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    std::size_t size = items[i].size;
+    if (layout == BatchLayout::kLengthDelimited) {
+      size += pb::VarintSize(items[i].size);
+    }
+    starts[i + 1] = starts[i] + size;
+  }
+  NSMutableData* data = [NSMutableData dataWithLength:starts.back()];
+  auto* bytes = static_cast<uint8_t*>(data.mutableBytes);
+  workers()->ParallelFor(
+      items.size(), [&](std::size_t index, std::size_t) {
+        const auto& item = items[index];
+        pb::WireWriter writer(bytes + starts[index]);
+        if (layout == BatchLayout::kLengthDelimited) {
+          writer.WriteVarint(item.size);
+        }
+        writer.WriteBytes(
+            {reinterpret_cast<const char*>(scratch[item.slot].data()) +
+                 item.offset,
+             item.size});
+      });
+
+  batch.data = data;
+  if (layout == BatchLayout::kOffsets) {
+    batch.offsets = std::move(starts);
+  }
+  return batch;
+}
+
 PlatformObject PBConvert::Decode(const PBInfo& pb_info,
                                  const PBOptions& options) {
-  auto res = from_pb(pb_pool_.get(), pb_info, options);
+  auto res = from_pb(runtime(), pb_info, WithWorkers(options));
   return !res.first ? res.second : nil;
 }
 
+std::vector<std::pair<ErrorCode, PlatformObject>> PBConvert::DecodeBatch(
+    std::span<const PBInfo> pb_infos,
+    const PBOptions& options) {
+  std::vector<std::pair<ErrorCode, PlatformObject>> results(
+      pb_infos.size(), {CommonError::UNKNOWN, nil});
+  // Reflection decodes reuse the worker thread's arena between items.
+  PBOptions item_options = WithWorkers(options);
+  item_options.use_arena |= options.engine == PBEngine::kReflection;
+  auto pb_runtime = runtime();
+  workers()->ParallelFor(
+      pb_infos.size(), [&](std::size_t index, std::size_t) {
+        @autoreleasepool {
+          results[index] = from_pb(pb_runtime, pb_infos[index], item_options);
+        }
+      });
+  return results;
+}
+
+ErrorCode PBConvert::ToJson(const PBInfo& pb_info,
+                            std::string* out,
+                            const PBOptions& options) {
+  auto snapshot = snapshot_.Load();
+  const pb::JsonRuntime json_runtime{
+      .descriptor_pool = snapshot->descriptors->pool(),
+      .message_pool = snapshot->message_pool.get(),
+      .plans = snapshot->json_plans.get()};
+  return pb::to_json(json_runtime, pb_info, out, options);
+}
+
+ErrorCode PBConvert::FromJson(std::string_view json,
+                              std::string_view pb_type,
+                              std::string* out) {
+  auto snapshot = snapshot_.Load();
+  const pb::JsonRuntime json_runtime{
+      .descriptor_pool = snapshot->descriptors->pool(),
+      .message_pool = snapshot->message_pool.get(),
+      .plans = snapshot->json_plans.get()};
+  return pb::from_json(json_runtime, json, pb_type, out);
+}
+
+std::unique_ptr<PushParser> PBConvert::NewParser(std::string_view pb_type,
+                                                 const PBOptions& options) {
+  return std::make_unique<PushParser>(runtime(), pb_type, options);
+}
+
+std::unique_ptr<RecordReader> PBConvert::OpenRecords(
+    const std::string& path,
+    std::string_view pb_type,
+    const PBOptions& options) {
+  return RecordReader::Open(path, runtime(), pb_type, WithWorkers(options));
+}
+
 PlatformObject PBConvert::Create(std::string_view pb_type,
                                  const PBOptions& options) {
-  auto res = from_default_pb(pb_pool_.get(), pb_type, options);
+  auto res = from_default_pb(runtime(), pb_type, options);
   return !res.first ? res.second : nil;
 }
 }  // namespace magic
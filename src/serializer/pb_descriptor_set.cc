@@ -0,0 +1,51 @@
+#include "serializer/pb_descriptor_set.h"
+
+#include "serializer/pb_serializer.h"
+#include "serializer/pb_wire_format.h"
+
+namespace magic::pb {
+namespace {
+// FileDescriptorSet.file
+constexpr uint32_t kFileFieldNumber = 1;
+}  // namespace
+
+DescriptorSet::~DescriptorSet() = default;
+
+std::unique_ptr<DescriptorSet> DescriptorSet::Open(const std::string& path) {
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<DescriptorSet> set(new DescriptorSet);
+  set->file_ = MappedFile::Open(path);
+  if (!set->file_) {
+    return nullptr;
+  }
+  set->database_ = std::make_unique<EncodedDescriptorDatabase>();
+  WireReader reader(set->file_->data());
+  uint32_t number = 0;
+  WireType wire_type;
+  std::string_view file;
+  while (!reader.done()) {
+    bool ok = reader.ReadTag(&number, &wire_type);
+    if (ok && number == kFileFieldNumber &&
+        wire_type == WireType::kLengthDelimited) {
+      ok = reader.ReadLengthDelimited(&file);
+      // Duplicate or malformed files are logged by the database and left
+      // out.
+      if (ok &&
+          set->database_->Add(file.data(), static_cast<int>(file.size()))) {
+        ++set->stats_.file_count;
+      }
+    } else if (ok) {
+      ok = reader.SkipField(number, wire_type);
+    }
+    if (!ok) {
+      PB_LOG(ERROR) << "FileDescriptorSet parse error, path: " << path;
+      return nullptr;
+    }
+  }
+  set->pool_ = std::make_unique<DescriptorPool>(set->database_.get());
+  set->stats_.size = set->file_->data().size();
+  set->stats_.open_time = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  return set;
+}
+}  // namespace magic::pb
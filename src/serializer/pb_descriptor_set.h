@@ -0,0 +1,54 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_DESCRIPTOR_SET_H_
+#define CONVERT_SRC_SERIALIZER_PB_DESCRIPTOR_SET_H_
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor_database.h>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "serializer/pb_mapped_file.h"
+
+namespace magic::pb {
+using google::protobuf::DescriptorPool;
+using google::protobuf::EncodedDescriptorDatabase;
+
+// DescriptorPool over a mapped FileDescriptorSet. Opening only indexes the
+// symbols of each file in place, a file and its dependencies are built when
+// one of their types is first looked up. Broken files therefore surface as
+// failed lookups rather than at open. Thread safe.
+class DescriptorSet {
+ public:
+  struct Stats {
+    std::size_t file_count = 0;
+    std::size_t size = 0;
+    // Mapping and indexing the set, the cold-start cost of Open().
+    std::chrono::microseconds open_time{0};
+  };
+
+  ~DescriptorSet();
+
+  DescriptorSet(const DescriptorSet&) = delete;
+  DescriptorSet& operator=(const DescriptorSet&) = delete;
+
+  static std::unique_ptr<DescriptorSet> Open(const std::string& path);
+
+  DescriptorPool* pool() const { return pool_.get(); }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  DescriptorSet() = default;
+
+  // Declared in destruction order: the pool reads the database, which reads
+  // the mapping.
+  std::unique_ptr<MappedFile> file_;
+  std::unique_ptr<EncodedDescriptorDatabase> database_;
+  std::unique_ptr<DescriptorPool> pool_;
+  Stats stats_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_DESCRIPTOR_SET_H_
@@ -0,0 +1,53 @@
+#include "serializer/pb_field_mask.h"
+
+#include "serializer/pb_serializer.h"
+
+namespace magic::pb {
+const FieldMask::Node* FieldMask::Node::Find(std::string_view name) const {
+  if (all_) {
+    return this;
+  }
+  if (auto it = children_.find(name); it != children_.end()) {
+    return it->second.get();
+  }
+  if (auto it = children_.find("*"); it != children_.end()) {
+    return it->second.get();
+  }
+  return nullptr;
+}
+
+const FieldMask::Node* FieldMask::Node::Elements() const {
+  if (auto it = children_.find("*"); !all_ && it != children_.end()) {
+    return it->second.get();
+  }
+  return this;
+}
+
+std::shared_ptr<const FieldMask> FieldMask::New(
+    const std::vector<std::string>& paths) {
+  std::shared_ptr<FieldMask> mask(new FieldMask);
+  for (const auto& path : paths) {
+    Node* node = &mask->root_;
+    std::string_view rest = path;
+    while (true) {
+      auto end = rest.find('.');
+      auto segment = rest.substr(0, end);
+      if (segment.empty()) {
+        PB_LOG(ERROR) << "FieldMask invalid path: " << path;
+        return nullptr;
+      }
+      auto& child = node->children_[std::string(segment)];
+      if (!child) {
+        child = std::make_unique<Node>();
+      }
+      node = child.get();
+      if (end == std::string_view::npos) {
+        break;
+      }
+      rest.remove_prefix(end + 1);
+    }
+    node->all_ = true;
+  }
+  return mask;
+}
+}  // namespace magic::pb
@@ -0,0 +1,54 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_FIELD_MASK_H_
+#define CONVERT_SRC_SERIALIZER_PB_FIELD_MASK_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace magic::pb {
+// Field paths a decode is limited to, FieldMask style: proto field names
+// from the top level message down, "user.profile.name". "*" matches any
+// field, and right below a repeated or map field it stands for each element,
+// "items.*.id" and "items.id" select the same. A path ending at a message
+// field selects all of it. Extensions are named by their full name.
+//
+// Set through PBOptions::field_mask. Plans compiled against a mask are
+// cached for as long as the PlanCache lives and keep the mask alive, so
+// create one per set of paths and reuse it.
+class FieldMask {
+ public:
+  class Node {
+   public:
+    // The whole subtree is selected.
+    bool all() const { return all_; }
+
+    // Selection below field |name|, nullptr if the field is not selected.
+    const Node* Find(std::string_view name) const;
+
+    // Selection inside each element of a repeated or map field.
+    const Node* Elements() const;
+
+   private:
+    friend class FieldMask;
+
+    bool all_ = false;
+    std::map<std::string, std::unique_ptr<Node>, std::less<>> children_;
+  };
+
+  // Returns nullptr if a path has an empty segment.
+  static std::shared_ptr<const FieldMask> New(
+      const std::vector<std::string>& paths);
+
+  const Node& root() const { return root_; }
+
+ private:
+  FieldMask() = default;
+
+  Node root_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_FIELD_MASK_H_
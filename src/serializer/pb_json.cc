@@ -0,0 +1,1465 @@
+#include "serializer/pb_json.h"
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/util/json_util.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <unordered_set>
+
+#include "magic/serializer.h"
+#include "serializer/pb_json_tokenizer.h"
+#include "serializer/pb_wire_decoder.h"
+
+namespace magic::pb {
+namespace {
+// Nesting allowed below the top level message, as in CodedInputStream.
+constexpr int kMaxDepth = 100;
+
+// Required fields past this many are not checked.
+constexpr int kMaxRequiredBits = 64;
+
+constexpr std::string_view kWellKnownTypes[] = {
+    "google.protobuf.Any",         "google.protobuf.BoolValue",
+    "google.protobuf.BytesValue",  "google.protobuf.DoubleValue",
+    "google.protobuf.Duration",    "google.protobuf.FieldMask",
+    "google.protobuf.FloatValue",  "google.protobuf.Int32Value",
+    "google.protobuf.Int64Value",  "google.protobuf.ListValue",
+    "google.protobuf.StringValue", "google.protobuf.Struct",
+    "google.protobuf.Timestamp",   "google.protobuf.UInt32Value",
+    "google.protobuf.UInt64Value", "google.protobuf.Value",
+};
+
+constexpr char kBase64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 6-bit values of the standard and URL-safe alphabets, -1 elsewhere.
+constexpr auto kBase64Values = [] {
+  std::array<int8_t, 256> values{};
+  values.fill(-1);
+  for (int i = 0; i < 64; ++i) {
+    values[static_cast<uint8_t>(kBase64[i])] = static_cast<int8_t>(i);
+  }
+  values['-'] = 62;
+  values['_'] = 63;
+  return values;
+}();
+
+bool IsWellKnown(const Descriptor* descriptor) {
+  return descriptor->file()->package() == "google.protobuf" &&
+         std::find(std::begin(kWellKnownTypes), std::end(kWellKnownTypes),
+                   descriptor->full_name()) != std::end(kWellKnownTypes);
+}
+
+bool IsNullable(const FieldDescriptor* field) {
+  if (field->type() == FieldDescriptor::TYPE_ENUM) {
+    return field->enum_type()->full_name() == "google.protobuf.NullValue";
+  }
+  return field->type() == FieldDescriptor::TYPE_MESSAGE &&
+         field->message_type()->full_name() == "google.protobuf.Value";
+}
+
+std::string QuotedKey(const std::string& name) {
+  std::string key;
+  AppendJsonString(name, &key);
+  key.push_back(':');
+  return key;
+}
+
+void AppendBase64(std::string_view data, std::string* out) {
+  const auto* in = reinterpret_cast<const uint8_t*>(data.data());
+  const std::size_t size = data.size();
+  const std::size_t begin = out->size();
+  out->resize(begin + (size + 2) / 3 * 4);
+  char* p = out->data() + begin;
+  std::size_t i = 0;
+  for (; i + 3 <= size; i += 3, p += 4) {
+    const uint32_t v = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+    p[0] = kBase64[v >> 18];
+    p[1] = kBase64[v >> 12 & 63];
+    p[2] = kBase64[v >> 6 & 63];
+    p[3] = kBase64[v & 63];
+  }
+  if (i < size) {
+    const uint32_t v = in[i] << 16 | (i + 1 < size ? in[i + 1] << 8 : 0);
+    p[0] = kBase64[v >> 18];
+    p[1] = kBase64[v >> 12 & 63];
+    p[2] = i + 1 < size ? kBase64[v >> 6 & 63] : '=';
+    p[3] = '=';
+  }
+}
+
+// Standard or URL-safe base64, padding optional but complete when present.
+bool AppendUnbase64(std::string_view text, std::string* out) {
+  const bool padded = !text.empty() && text.back() == '=';
+  if (padded && text.size() % 4 != 0) {
+    return false;
+  }
+  for (int i = 0; i < 2 && !text.empty() && text.back() == '='; ++i) {
+    text.remove_suffix(1);
+  }
+  if (text.size() % 4 == 1) {
+    return false;
+  }
+  const std::size_t begin = out->size();
+  out->resize(begin + text.size() / 4 * 3 + (text.size() % 4) * 3 / 4);
+  char* p = out->data() + begin;
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text) {
+    const int value = kBase64Values[static_cast<uint8_t>(c)];
+    if (value < 0) {
+      return false;
+    }
+    bits = bits << 6 | value;
+    if (++count == 4) {
+      p[0] = static_cast<char>(bits >> 16);
+      p[1] = static_cast<char>(bits >> 8);
+      p[2] = static_cast<char>(bits);
+      p += 3;
+      bits = 0;
+      count = 0;
+    }
+  }
+  if (count == 2) {
+    *p = static_cast<char>(bits >> 4);
+  } else if (count == 3) {
+    p[0] = static_cast<char>(bits >> 10);
+    p[1] = static_cast<char>(bits >> 2);
+  }
+  return true;
+}
+
+template <typename T>
+void AppendNumber(T value, std::string* out) {
+  char buffer[32];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out->append(buffer, end);
+}
+
+// Shortest text that reads back as the same value.
+template <typename T>
+void AppendFloating(T value, std::string* out) {
+  if (std::isnan(value)) {
+    out->append("\"NaN\"");
+  } else if (std::isinf(value)) {
+    out->append(value > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+  } else {
+#if defined(__cpp_lib_to_chars)
+    AppendNumber(value, out);
+#else
+    // Standard libraries without floating point to_chars.
+    char buffer[32];
+    const int size =
+        std::snprintf(buffer, sizeof(buffer),
+                      std::is_same_v<T, float> ? "%.9g" : "%.17g", value);
+    out->append(buffer, size);
+#endif
+  }
+}
+
+bool AcceptsWireType(const JsonFieldPlan& field, WireType wire_type) {
+  return wire_type == field.wire_type ||
+         (field.packable && wire_type == WireType::kLengthDelimited);
+}
+
+bool IsDefault(const JsonFieldPlan& field,
+               uint64_t bits,
+               std::string_view bytes) {
+  return field.wire_type == WireType::kLengthDelimited ? bytes.empty()
+                                                       : bits == 0;
+}
+
+// Wire format to JSON text, appended to |out|.
+class WireToJson {
+ public:
+  WireToJson(const JsonRuntime& runtime,
+             const PBOptions& options,
+             std::string* out)
+      : runtime_(runtime), options_(options), out_(out) {}
+
+  bool WriteMessage(const JsonMessagePlan& plan,
+                    std::string_view data,
+                    int depth) {
+    if (depth > kMaxDepth) {
+      return false;
+    }
+    if (plan.well_known) {
+      return WriteWellKnown(plan, data);
+    }
+    const std::size_t begin = occurrences_.size();
+    const std::size_t oneofs = winners_.size();
+    winners_.resize(oneofs + plan.oneof_count, -1);
+    bool sorted = true;
+    if (!Scan(plan, data, oneofs, &sorted)) {
+      return false;
+    }
+    const std::size_t end = occurrences_.size();
+    if (!sorted) {
+      std::stable_sort(occurrences_.begin() + begin, occurrences_.end(),
+                       [](const Occurrence& a, const Occurrence& b) {
+                         return a.field < b.field;
+                       });
+    }
+
+    out_->push_back('{');
+    bool first = true;
+    uint64_t required = 0;
+    for (std::size_t i = begin, j; i < end; i = j) {
+      const int32_t index = occurrences_[i].field;
+      for (j = i + 1; j < end && occurrences_[j].field == index; ++j) {
+      }
+      const auto& field = plan.fields[index];
+      // Of the members of a oneof, the last one seen is set.
+      if (field.oneof >= 0 && winners_[oneofs + field.oneof] != index) {
+        continue;
+      }
+      const std::size_t size = out_->size();
+      if (!WriteField(field, i, j, depth, &first)) {
+        return false;
+      }
+      if (field.required_bit >= 0 && out_->size() > size) {
+        required |= uint64_t{1} << field.required_bit;
+      }
+    }
+    if (std::popcount(required) < plan.required_count) {
+      PB_LOG(ERROR) << "to_json missing required field, type: "
+                    << plan.descriptor->full_name();
+      return false;
+    }
+    out_->push_back('}');
+    occurrences_.resize(begin);
+    winners_.resize(oneofs);
+    return true;
+  }
+
+ private:
+  struct Occurrence {
+    uint64_t bits = 0;
+    // Length delimited values and group bodies.
+    std::string_view bytes;
+    // Index into the message plan's fields.
+    int32_t field = 0;
+    WireType wire_type = WireType::kVarint;
+  };
+
+  struct MapEntry {
+    Occurrence key;
+    Occurrence value;
+    bool dropped = false;
+  };
+
+  static bool ReadValue(WireReader& reader,
+                        const JsonFieldPlan& field,
+                        WireType wire_type,
+                        Occurrence* occurrence) {
+    occurrence->wire_type = wire_type;
+    uint32_t u32 = 0;
+    switch (wire_type) {
+      case WireType::kVarint:
+        if (!reader.ReadVarint(&occurrence->bits)) {
+          return false;
+        }
+        switch (field.field->cpp_type()) {
+          case FieldDescriptor::CPPTYPE_INT32:
+          case FieldDescriptor::CPPTYPE_UINT32:
+          case FieldDescriptor::CPPTYPE_ENUM:
+            // 32 bit varints keep the low bits only.
+            occurrence->bits = static_cast<uint32_t>(occurrence->bits);
+            break;
+          default:
+            break;
+        }
+        return true;
+      case WireType::kFixed64:
+        return reader.ReadFixed64(&occurrence->bits);
+      case WireType::kFixed32:
+        if (!reader.ReadFixed32(&u32)) {
+          return false;
+        }
+        occurrence->bits = u32;
+        return true;
+      case WireType::kLengthDelimited:
+        return reader.ReadLengthDelimited(&occurrence->bytes);
+      case WireType::kStartGroup:
+        return reader.ReadGroup(field.number, &occurrence->bytes);
+      default:
+        return false;
+    }
+  }
+
+  // Skips fields the plan does not know or that have another wire type,
+  // which protobuf keeps as unknown fields.
+  static bool Skip(WireReader& reader, uint32_t number, WireType wire_type) {
+    return wire_type != WireType::kEndGroup &&
+           reader.SkipField(number, wire_type);
+  }
+
+  bool Scan(const JsonMessagePlan& plan,
+            std::string_view data,
+            std::size_t oneofs,
+            bool* sorted) {
+    WireReader reader(data);
+    int32_t last = -1;
+    while (!reader.done()) {
+      uint32_t number = 0;
+      WireType wire_type;
+      if (!reader.ReadTag(&number, &wire_type)) {
+        return false;
+      }
+      const auto* field = plan.FindByNumber(number);
+      if (!field || !AcceptsWireType(*field, wire_type)) {
+        if (!Skip(reader, number, wire_type)) {
+          return false;
+        }
+        continue;
+      }
+      Occurrence occurrence;
+      occurrence.field = static_cast<int32_t>(field - plan.fields.data());
+      if (!ReadValue(reader, *field, wire_type, &occurrence)) {
+        return false;
+      }
+      if (field->closed_enum && wire_type == WireType::kVarint &&
+          !field->enum_values->descriptor->FindValueByNumber(
+              static_cast<int32_t>(occurrence.bits))) {
+        // Unknown values of closed enums go to the unknown field set.
+        continue;
+      }
+      if (field->oneof >= 0) {
+        winners_[oneofs + field->oneof] = occurrence.field;
+      }
+      if (occurrence.field < last) {
+        *sorted = false;
+      }
+      last = occurrence.field;
+      occurrences_.push_back(occurrence);
+    }
+    return true;
+  }
+
+  void WriteKey(const JsonFieldPlan& field, bool* first) {
+    if (!*first) {
+      out_->push_back(',');
+    }
+    *first = false;
+    out_->append(options_.use_camelcase ? field.json_key : field.name_key);
+  }
+
+  // Occurrences [begin, end) of |field|.
+  bool WriteField(const JsonFieldPlan& field,
+                  std::size_t begin,
+                  std::size_t end,
+                  int depth,
+                  bool* first) {
+    if (field.map) {
+      return WriteMap(field, begin, end, depth, first);
+    }
+    if (field.repeated) {
+      return WriteRepeated(field, begin, end, depth, first);
+    }
+    if (field.message) {
+      // Occurrences of a singular message are merged.
+      std::string_view body = occurrences_[begin].bytes;
+      if (end - begin > 1) {
+        auto& merged = merged_.emplace_back();
+        for (std::size_t i = begin; i < end; ++i) {
+          merged.append(occurrences_[i].bytes);
+        }
+        body = merged;
+      }
+      const std::size_t rollback = out_->size();
+      const bool was_first = *first;
+      WriteKey(field, first);
+      const std::size_t value = out_->size();
+      if (!WriteMessage(*field.message, body, depth + 1)) {
+        return false;
+      }
+      if (out_->size() == value) {
+        // A Value without a kind prints as nothing and is left out.
+        out_->resize(rollback);
+        *first = was_first;
+      }
+      return true;
+    }
+    const Occurrence occurrence = occurrences_[end - 1];
+    if (!field.has_presence &&
+        IsDefault(field, occurrence.bits, occurrence.bytes)) {
+      return true;
+    }
+    WriteKey(field, first);
+    return WriteValue(field, occurrence, depth);
+  }
+
+  bool WriteRepeated(const JsonFieldPlan& field,
+                     std::size_t begin,
+                     std::size_t end,
+                     int depth,
+                     bool* first) {
+    const std::size_t rollback = out_->size();
+    const bool was_first = *first;
+    WriteKey(field, first);
+    out_->push_back('[');
+    bool empty = true;
+    for (std::size_t i = begin; i < end; ++i) {
+      const Occurrence occurrence = occurrences_[i];
+      if (occurrence.wire_type == field.wire_type) {
+        if (!WriteElement(field, occurrence, depth, &empty)) {
+          return false;
+        }
+        continue;
+      }
+      WireReader reader(occurrence.bytes);
+      while (!reader.done()) {
+        Occurrence element;
+        if (!ReadValue(reader, field, field.wire_type, &element)) {
+          return false;
+        }
+        if (field.closed_enum &&
+            !field.enum_values->descriptor->FindValueByNumber(
+                static_cast<int32_t>(element.bits))) {
+          continue;
+        }
+        if (!WriteElement(field, element, depth, &empty)) {
+          return false;
+        }
+      }
+    }
+    if (empty) {
+      // Like an empty repeated field, which is left out.
+      out_->resize(rollback);
+      *first = was_first;
+      return true;
+    }
+    out_->push_back(']');
+    return true;
+  }
+
+  // Writes an element of a repeated field, separator included, unless it
+  // prints as nothing like a Value without a kind.
+  bool WriteElement(const JsonFieldPlan& field,
+                    const Occurrence& occurrence,
+                    int depth,
+                    bool* empty) {
+    const std::size_t rollback = out_->size();
+    if (!*empty) {
+      out_->push_back(',');
+    }
+    const std::size_t value = out_->size();
+    if (!WriteValue(field, occurrence, depth)) {
+      return false;
+    }
+    if (out_->size() == value) {
+      out_->resize(rollback);
+    } else {
+      *empty = false;
+    }
+    return true;
+  }
+
+  bool ReadMapEntry(const JsonMessagePlan& plan,
+                    std::string_view data,
+                    MapEntry* entry) {
+    const auto& key_field = plan.fields[0];
+    const auto& value_field = plan.fields[1];
+    entry->key.bytes = {};
+    entry->value.bytes = {};
+    if (value_field.type == FieldDescriptor::TYPE_ENUM) {
+      entry->value.bits = static_cast<uint32_t>(
+          value_field.field->default_value_enum()->number());
+    }
+    bool has_value = false;
+    WireReader reader(data);
+    while (!reader.done()) {
+      uint32_t number = 0;
+      WireType wire_type;
+      if (!reader.ReadTag(&number, &wire_type)) {
+        return false;
+      }
+      const auto* field = plan.FindByNumber(number);
+      if (!field || !AcceptsWireType(*field, wire_type)) {
+        if (!Skip(reader, number, wire_type)) {
+          return false;
+        }
+        continue;
+      }
+      Occurrence occurrence;
+      if (!ReadValue(reader, *field, wire_type, &occurrence)) {
+        return false;
+      }
+      if (field == &key_field) {
+        entry->key = occurrence;
+      } else if (has_value && value_field.message) {
+        auto& merged = merged_.emplace_back(entry->value.bytes);
+        merged.append(occurrence.bytes);
+        entry->value.bytes = merged;
+      } else {
+        entry->value = occurrence;
+        has_value = true;
+      }
+    }
+    // A closed enum value that is unknown drops the entry, which protobuf
+    // keeps as an unknown field.
+    entry->dropped =
+        value_field.closed_enum &&
+        !value_field.enum_values->descriptor->FindValueByNumber(
+            static_cast<int32_t>(entry->value.bits));
+    return true;
+  }
+
+  bool WriteMap(const JsonFieldPlan& field,
+                std::size_t begin,
+                std::size_t end,
+                int depth,
+                bool* first) {
+    const auto& plan = *field.message;
+    const auto& key_field = plan.fields[0];
+    const auto& value_field = plan.fields[1];
+    const std::size_t base = entries_.size();
+    entries_.resize(base + (end - begin));
+    for (std::size_t i = begin; i < end; ++i) {
+      if (!ReadMapEntry(plan, occurrences_[i].bytes,
+                        &entries_[base + i - begin])) {
+        return false;
+      }
+    }
+    if (end - begin > 1) {
+      // The last entry of a key wins. Keys are told apart by their bytes,
+      // or by the 8 bytes of their value.
+      keys_.clear();
+      auto key_of = [&](const MapEntry& entry) {
+        return key_field.wire_type == WireType::kLengthDelimited
+                   ? entry.key.bytes
+                   : std::string_view(
+                         reinterpret_cast<const char*>(&entry.key.bits),
+                         sizeof(entry.key.bits));
+      };
+      for (std::size_t i = base; i < entries_.size(); ++i) {
+        if (!entries_[i].dropped) {
+          keys_[key_of(entries_[i])] = i;
+        }
+      }
+      for (std::size_t i = base; i < entries_.size(); ++i) {
+        if (!entries_[i].dropped) {
+          entries_[i].dropped = keys_[key_of(entries_[i])] != i;
+        }
+      }
+    }
+
+    const std::size_t rollback = out_->size();
+    const bool was_first = *first;
+    WriteKey(field, first);
+    out_->push_back('{');
+    bool empty = true;
+    for (std::size_t i = base; i < base + (end - begin); ++i) {
+      const MapEntry entry = entries_[i];
+      if (entry.dropped) {
+        continue;
+      }
+      const std::size_t element = out_->size();
+      if (!empty) {
+        out_->push_back(',');
+      }
+      if (!WriteMapKey(key_field, entry.key)) {
+        return false;
+      }
+      out_->push_back(':');
+      const std::size_t value = out_->size();
+      if (!WriteValue(value_field, entry.value, depth + 1)) {
+        return false;
+      }
+      if (out_->size() == value) {
+        out_->resize(element);
+      } else {
+        empty = false;
+      }
+    }
+    entries_.resize(base);
+    if (empty) {
+      out_->resize(rollback);
+      *first = was_first;
+      return true;
+    }
+    out_->push_back('}');
+    return true;
+  }
+
+  bool WriteMapKey(const JsonFieldPlan& field, const Occurrence& key) {
+    const uint64_t bits = key.bits;
+    switch (field.type) {
+      case FieldDescriptor::TYPE_STRING:
+        return WriteString(field, key.bytes);
+      case FieldDescriptor::TYPE_BOOL:
+        out_->append(bits ? "\"true\"" : "\"false\"");
+        return true;
+      default:
+        break;
+    }
+    out_->push_back('"');
+    switch (field.type) {
+      case FieldDescriptor::TYPE_INT64:
+      case FieldDescriptor::TYPE_SFIXED64:
+        AppendNumber(static_cast<int64_t>(bits), out_);
+        break;
+      case FieldDescriptor::TYPE_SINT64:
+        AppendNumber(ZigZagDecode64(bits), out_);
+        break;
+      case FieldDescriptor::TYPE_UINT64:
+      case FieldDescriptor::TYPE_FIXED64:
+        AppendNumber(bits, out_);
+        break;
+      case FieldDescriptor::TYPE_INT32:
+      case FieldDescriptor::TYPE_SFIXED32:
+        AppendNumber(static_cast<int32_t>(bits), out_);
+        break;
+      case FieldDescriptor::TYPE_SINT32:
+        AppendNumber(ZigZagDecode32(static_cast<uint32_t>(bits)), out_);
+        break;
+      default:
+        AppendNumber(static_cast<uint32_t>(bits), out_);
+        break;
+    }
+    out_->push_back('"');
+    return true;
+  }
+
+  void WriteInt64(int64_t value) {
+    constexpr int64_t kMaxSafeInteger = int64_t{1} << 53;
+    const bool quoted =
+        options_.int64_format == PBInt64Format::kString ||
+        (options_.int64_format == PBInt64Format::kHybrid &&
+         (value > kMaxSafeInteger || value < -kMaxSafeInteger));
+    if (quoted) {
+      out_->push_back('"');
+    }
+    AppendNumber(value, out_);
+    if (quoted) {
+      out_->push_back('"');
+    }
+  }
+
+  void WriteUint64(uint64_t value) {
+    constexpr uint64_t kMaxSafeInteger = uint64_t{1} << 53;
+    const bool quoted =
+        options_.int64_format == PBInt64Format::kString ||
+        (options_.int64_format == PBInt64Format::kHybrid &&
+         value > kMaxSafeInteger);
+    if (quoted) {
+      out_->push_back('"');
+    }
+    AppendNumber(value, out_);
+    if (quoted) {
+      out_->push_back('"');
+    }
+  }
+
+  bool WriteValue(const JsonFieldPlan& field,
+                  const Occurrence& occurrence,
+                  int depth) {
+    const uint64_t bits = occurrence.bits;
+    switch (field.type) {
+      case FieldDescriptor::TYPE_DOUBLE:
+        AppendFloating(std::bit_cast<double>(bits), out_);
+        return true;
+      case FieldDescriptor::TYPE_FLOAT:
+        AppendFloating(std::bit_cast<float>(static_cast<uint32_t>(bits)),
+                       out_);
+        return true;
+      case FieldDescriptor::TYPE_INT64:
+      case FieldDescriptor::TYPE_SFIXED64:
+        WriteInt64(static_cast<int64_t>(bits));
+        return true;
+      case FieldDescriptor::TYPE_SINT64:
+        WriteInt64(ZigZagDecode64(bits));
+        return true;
+      case FieldDescriptor::TYPE_UINT64:
+      case FieldDescriptor::TYPE_FIXED64:
+        WriteUint64(bits);
+        return true;
+      case FieldDescriptor::TYPE_INT32:
+      case FieldDescriptor::TYPE_SFIXED32:
+        AppendNumber(static_cast<int32_t>(bits), out_);
+        return true;
+      case FieldDescriptor::TYPE_SINT32:
+        AppendNumber(ZigZagDecode32(static_cast<uint32_t>(bits)), out_);
+        return true;
+      case FieldDescriptor::TYPE_UINT32:
+      case FieldDescriptor::TYPE_FIXED32:
+        AppendNumber(static_cast<uint32_t>(bits), out_);
+        return true;
+      case FieldDescriptor::TYPE_BOOL:
+        out_->append(bits ? "true" : "false");
+        return true;
+      case FieldDescriptor::TYPE_ENUM: {
+        if (field.nullable) {
+          out_->append("null");
+          return true;
+        }
+        const auto* value = field.enum_values->descriptor->FindValueByNumber(
+            static_cast<int32_t>(bits));
+        if (value) {
+          AppendJsonString(value->name(), out_);
+        } else {
+          AppendNumber(static_cast<int32_t>(bits), out_);
+        }
+        return true;
+      }
+      case FieldDescriptor::TYPE_STRING:
+        return WriteString(field, occurrence.bytes);
+      case FieldDescriptor::TYPE_BYTES:
+        out_->push_back('"');
+        AppendBase64(occurrence.bytes, out_);
+        out_->push_back('"');
+        return true;
+      default:
+        return WriteMessage(*field.message, occurrence.bytes, depth + 1);
+    }
+  }
+
+  // Strings that need no UTF-8 validation print without their invalid
+  // bytes, as json_util prints them.
+  bool WriteString(const JsonFieldPlan& field, std::string_view bytes) {
+    if (IsValidUtf8(bytes)) {
+      AppendJsonString(bytes, out_);
+      return true;
+    }
+    if (field.utf8) {
+      PB_LOG(ERROR) << "to_json invalid UTF-8, name: " << field.field->name();
+      return false;
+    }
+    scratch_.clear();
+    while (!bytes.empty()) {
+      const std::size_t valid = google::protobuf::internal::
+          UTF8SpnStructurallyValid({bytes.data(), bytes.size()});
+      scratch_.append(bytes.substr(0, valid));
+      bytes.remove_prefix(std::min(valid + 1, bytes.size()));
+    }
+    AppendJsonString(scratch_, out_);
+    return true;
+  }
+
+  bool WriteWellKnown(const JsonMessagePlan& plan, std::string_view data) {
+    auto message = runtime_.message_pool
+                       ? runtime_.message_pool->Acquire(plan.descriptor)
+                       : MessagePool::Handle();
+    if (!message || !message->ParseFromArray(data.data(), data.size())) {
+      return false;
+    }
+    google::protobuf::util::JsonPrintOptions print_options;
+    print_options.preserve_proto_field_names = !options_.use_camelcase;
+    scratch_.clear();
+    if (!google::protobuf::util::MessageToJsonString(*message, &scratch_,
+                                                     print_options)
+             .ok()) {
+      return false;
+    }
+    out_->append(scratch_);
+    return true;
+  }
+
+  const JsonRuntime& runtime_;
+  const PBOptions& options_;
+  std::string* out_;
+  // Fields of the messages being written, outermost first.
+  std::vector<Occurrence> occurrences_;
+  // Per oneof of those messages, the field index of the last member seen.
+  std::vector<int32_t> winners_;
+  std::vector<MapEntry> entries_;
+  std::unordered_map<std::string_view, std::size_t> keys_;
+  // Merged sub message occurrences, stable while the conversion runs.
+  std::deque<std::string> merged_;
+  std::string scratch_;
+};
+
+// JSON text to wire format, appended to |out|.
+class JsonToWire {
+ public:
+  JsonToWire(const JsonRuntime& runtime,
+             std::string_view json,
+             std::string* out)
+      : runtime_(runtime), tokens_(json), out_(out) {}
+
+  bool Parse(const JsonMessagePlan& plan) {
+    return ParseMessage(plan, tokens_.Next(), 0) &&
+           tokens_.Next() == JsonToken::kEnd;
+  }
+
+ private:
+  bool ParseMessage(const JsonMessagePlan& plan, JsonToken token, int depth) {
+    if (depth > kMaxDepth) {
+      return false;
+    }
+    if (plan.well_known) {
+      return ParseWellKnown(plan, token);
+    }
+    if (token != JsonToken::kBeginObject) {
+      return false;
+    }
+    uint64_t required = 0;
+    const std::size_t oneofs = oneofs_set_.size();
+    oneofs_set_.resize(oneofs + plan.oneof_count, false);
+    // Keys usually come in field order, the next field is tried first.
+    std::size_t next = 0;
+    while ((token = tokens_.Next()) != JsonToken::kEndObject) {
+      if (token != JsonToken::kString) {
+        return false;
+      }
+      const JsonFieldPlan* field = nullptr;
+      std::string_view key = tokens_.text();
+      if (tokens_.escaped()) {
+        key_.clear();
+        if (!UnescapeJson(key, &key_)) {
+          return false;
+        }
+        key = key_;
+      }
+      if (next < plan.fields.size() &&
+          (plan.fields[next].field->name() == key ||
+           plan.fields[next].field->json_name() == key)) {
+        field = &plan.fields[next];
+      } else {
+        field = plan.FindByName(key);
+      }
+      token = tokens_.Next();
+      if (!field) {
+        if (!tokens_.SkipValue(token)) {
+          return false;
+        }
+        continue;
+      }
+      next = field - plan.fields.data() + 1;
+      if (token == JsonToken::kNull && (!field->nullable || field->repeated)) {
+        continue;
+      }
+      if (field->oneof >= 0) {
+        if (oneofs_set_[oneofs + field->oneof]) {
+          PB_LOG(ERROR) << "from_json oneof already set, name: "
+                        << field->field->full_name();
+          return false;
+        }
+        oneofs_set_[oneofs + field->oneof] = true;
+      }
+      if (!ParseField(*field, token, depth)) {
+        PB_LOG(ERROR) << "from_json invalid value, name: "
+                      << field->field->full_name();
+        return false;
+      }
+      if (field->required_bit >= 0) {
+        required |= uint64_t{1} << field->required_bit;
+      }
+    }
+    if (std::popcount(required) < plan.required_count) {
+      PB_LOG(ERROR) << "from_json missing required field, type: "
+                    << plan.descriptor->full_name();
+      return false;
+    }
+    oneofs_set_.resize(oneofs);
+    return true;
+  }
+
+  bool ParseField(const JsonFieldPlan& field, JsonToken token, int depth) {
+    if (field.map) {
+      return ParseMap(field, token, depth);
+    }
+    if (!field.repeated) {
+      return ParseValue(field, token, depth, false);
+    }
+    if (token != JsonToken::kBeginArray) {
+      return false;
+    }
+    if (!field.packed) {
+      while ((token = tokens_.Next()) != JsonToken::kEndArray) {
+        if ((token == JsonToken::kNull && !field.nullable) ||
+            !ParseValue(field, token, depth, true)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    const std::size_t rollback = out_->size();
+    WriteTag(field.number, WireType::kLengthDelimited);
+    const std::size_t length = BeginLength();
+    while ((token = tokens_.Next()) != JsonToken::kEndArray) {
+      uint64_t bits = 0;
+      std::string_view bytes;
+      bool skip = false;
+      if (!ParseScalar(field, token, &bits, &bytes, &skip)) {
+        return false;
+      }
+      if (!skip) {
+        WriteScalar(field, bits, bytes);
+      }
+    }
+    if (out_->size() == length) {
+      // Nothing packed, no field either.
+      out_->resize(rollback);
+      return true;
+    }
+    EndLength(length);
+    return true;
+  }
+
+  bool ParseMap(const JsonFieldPlan& field, JsonToken token, int depth) {
+    if (token != JsonToken::kBeginObject) {
+      return false;
+    }
+    const auto& key_field = field.message->fields[0];
+    const auto& value_field = field.message->fields[1];
+    // Written keys, so "1" and "01" are the same int32 key.
+    std::unordered_set<std::string> keys;
+    while ((token = tokens_.Next()) != JsonToken::kEndObject) {
+      if (token != JsonToken::kString) {
+        return false;
+      }
+      WriteTag(field.number, WireType::kLengthDelimited);
+      const std::size_t length = BeginLength();
+      if (!WriteMapKey(key_field, tokens_.text(), tokens_.escaped())) {
+        return false;
+      }
+      if (!keys.emplace(out_->substr(length)).second) {
+        PB_LOG(ERROR) << "from_json duplicate map key, name: "
+                      << field.field->full_name();
+        return false;
+      }
+      token = tokens_.Next();
+      if (token == JsonToken::kNull && !value_field.nullable) {
+        return false;
+      }
+      // Entries always hold both fields.
+      if (!ParseValue(value_field, token, depth + 1, true)) {
+        return false;
+      }
+      EndLength(length);
+    }
+    return true;
+  }
+
+  bool WriteMapKey(const JsonFieldPlan& field,
+                   std::string_view text,
+                   bool escaped) {
+    if (escaped) {
+      key_.clear();
+      if (!UnescapeJson(text, &key_)) {
+        return false;
+      }
+      text = key_;
+    }
+    uint64_t bits = 0;
+    bool ok = true;
+    switch (field.type) {
+      case FieldDescriptor::TYPE_STRING:
+        if (!IsValidUtf8(text)) {
+          return false;
+        }
+        WriteScalar(field, 0, text, true);
+        return true;
+      case FieldDescriptor::TYPE_BOOL:
+        ok = text == "true" || text == "false";
+        bits = text == "true";
+        break;
+      case FieldDescriptor::TYPE_INT64:
+      case FieldDescriptor::TYPE_SFIXED64:
+      case FieldDescriptor::TYPE_SINT64:
+        ok = ToBits<int64_t>(field, text, &bits);
+        break;
+      case FieldDescriptor::TYPE_UINT64:
+      case FieldDescriptor::TYPE_FIXED64:
+        ok = ToBits<uint64_t>(field, text, &bits);
+        break;
+      case FieldDescriptor::TYPE_UINT32:
+      case FieldDescriptor::TYPE_FIXED32:
+        ok = ToBits<uint32_t>(field, text, &bits);
+        break;
+      default:
+        ok = ToBits<int32_t>(field, text, &bits);
+        break;
+    }
+    if (ok) {
+      WriteScalar(field, bits, {}, true);
+    }
+    return ok;
+  }
+
+  // |always| writes default values too, which fields without presence
+  // leave out.
+  bool ParseValue(const JsonFieldPlan& field,
+                  JsonToken token,
+                  int depth,
+                  bool always) {
+    if (field.type == FieldDescriptor::TYPE_MESSAGE) {
+      WriteTag(field.number, WireType::kLengthDelimited);
+      const std::size_t length = BeginLength();
+      if (!ParseMessage(*field.message, token, depth + 1)) {
+        return false;
+      }
+      EndLength(length);
+      return true;
+    }
+    if (field.type == FieldDescriptor::TYPE_GROUP) {
+      WriteTag(field.number, WireType::kStartGroup);
+      if (!ParseMessage(*field.message, token, depth + 1)) {
+        return false;
+      }
+      WriteTag(field.number, WireType::kEndGroup);
+      return true;
+    }
+    uint64_t bits = 0;
+    std::string_view bytes;
+    bool skip = false;
+    if (!ParseScalar(field, token, &bits, &bytes, &skip)) {
+      return false;
+    }
+    if (!skip && (always || field.has_presence ||
+                  !IsDefault(field, bits, bytes))) {
+      WriteScalar(field, bits, bytes, true);
+    }
+    return true;
+  }
+
+  // Integers also come as strings, and in exponent or fraction notation as
+  // long as the value is integral.
+  template <typename T>
+  static bool ToInteger(std::string_view text, T* value) {
+    if (auto v = detail::string_to_number<T>(text, detail::kNumberExponent)) {
+      *value = *v;
+      return true;
+    }
+    auto d = detail::string_to_number<double>(text);
+    if (!d || std::trunc(*d) != *d ||
+        *d < static_cast<double>(std::numeric_limits<T>::min()) ||
+        // 2^64 and 2^63 are exact doubles, T's maximum may not be.
+        *d >= static_cast<double>(std::numeric_limits<T>::max()) + 1.0) {
+      return false;
+    }
+    *value = static_cast<T>(*d);
+    return true;
+  }
+
+  // The wire form of integer |text| as field |field|.
+  template <typename T>
+  static bool ToBits(const JsonFieldPlan& field,
+                     std::string_view text,
+                     uint64_t* bits) {
+    T value{};
+    if (!ToInteger(text, &value)) {
+      return false;
+    }
+    switch (field.type) {
+      case FieldDescriptor::TYPE_SINT32:
+        *bits = ZigZagEncode32(static_cast<int32_t>(value));
+        break;
+      case FieldDescriptor::TYPE_SINT64:
+        *bits = ZigZagEncode64(static_cast<int64_t>(value));
+        break;
+      default:
+        // Negative 32 bit varints are sign extended, fixed32 fields keep
+        // the low bits.
+        *bits = static_cast<uint64_t>(static_cast<int64_t>(value));
+        break;
+    }
+    return true;
+  }
+
+  template <typename T>
+  static bool ToFloating(JsonToken token, std::string_view text, T* value) {
+    if (token == JsonToken::kString) {
+      if (text == "NaN") {
+        *value = std::numeric_limits<T>::quiet_NaN();
+        return true;
+      }
+      if (text == "Infinity" || text == "-Infinity") {
+        *value = text[0] == '-' ? -std::numeric_limits<T>::infinity()
+                                : std::numeric_limits<T>::infinity();
+        return true;
+      }
+    }
+    auto d = detail::string_to_number<double>(text);
+    if (!d || std::isinf(*d)) {
+      return false;
+    }
+    *value = static_cast<T>(*d);
+    // Rounds as protobuf does: only values past FLT_MAX once rounded are out
+    // of range.
+    return !std::isinf(*value);
+  }
+
+  bool ParseScalar(const JsonFieldPlan& field,
+                   JsonToken token,
+                   uint64_t* bits,
+                   std::string_view* bytes,
+                   bool* skip) {
+    std::string_view text = tokens_.text();
+    switch (field.type) {
+      case FieldDescriptor::TYPE_BOOL:
+        if (token != JsonToken::kTrue && token != JsonToken::kFalse) {
+          return false;
+        }
+        *bits = token == JsonToken::kTrue;
+        return true;
+      case FieldDescriptor::TYPE_STRING:
+      case FieldDescriptor::TYPE_BYTES:
+        if (token != JsonToken::kString) {
+          return false;
+        }
+        if (tokens_.escaped()) {
+          value_.clear();
+          if (!UnescapeJson(text, &value_)) {
+            return false;
+          }
+          text = value_;
+        }
+        if (field.type == FieldDescriptor::TYPE_STRING) {
+          if (!IsValidUtf8(text)) {
+            return false;
+          }
+          *bytes = text;
+          return true;
+        }
+        bytes_.clear();
+        if (!AppendUnbase64(text, &bytes_)) {
+          return false;
+        }
+        *bytes = bytes_;
+        return true;
+      case FieldDescriptor::TYPE_ENUM:
+        if (token == JsonToken::kNull) {
+          *bits = 0;
+          return true;
+        }
+        if (token == JsonToken::kString) {
+          std::string name;
+          if (tokens_.escaped()) {
+            if (!UnescapeJson(text, &name)) {
+              return false;
+            }
+            text = name;
+          }
+          const auto& numbers = field.enum_values->numbers;
+          auto it = numbers.find(text);
+          int32_t number = 0;
+          if (it != numbers.end()) {
+            number = it->second;
+          } else {
+            // Known numbers are taken in strings too.
+            const auto [end, error] =
+                std::from_chars(text.data(), text.data() + text.size(), number);
+            if (error != std::errc() || end != text.data() + text.size() ||
+                !field.enum_values->descriptor->FindValueByNumber(number)) {
+              // Like an unknown key.
+              *skip = true;
+              return true;
+            }
+          }
+          *bits = static_cast<uint64_t>(static_cast<int64_t>(number));
+          return true;
+        }
+        return token == JsonToken::kNumber &&
+               ToBits<int32_t>(field, text, bits);
+      case FieldDescriptor::TYPE_DOUBLE:
+      case FieldDescriptor::TYPE_FLOAT:
+        if (token != JsonToken::kNumber && token != JsonToken::kString) {
+          return false;
+        }
+        if (field.type == FieldDescriptor::TYPE_DOUBLE) {
+          double d = 0;
+          if (!ToFloating(token, text, &d)) {
+            return false;
+          }
+          *bits = std::bit_cast<uint64_t>(d);
+        } else {
+          float f = 0;
+          if (!ToFloating(token, text, &f)) {
+            return false;
+          }
+          *bits = std::bit_cast<uint32_t>(f);
+        }
+        return true;
+      default:
+        break;
+    }
+    if (token != JsonToken::kNumber && token != JsonToken::kString) {
+      return false;
+    }
+    switch (field.type) {
+      case FieldDescriptor::TYPE_INT64:
+      case FieldDescriptor::TYPE_SFIXED64:
+      case FieldDescriptor::TYPE_SINT64:
+        return ToBits<int64_t>(field, text, bits);
+      case FieldDescriptor::TYPE_UINT64:
+      case FieldDescriptor::TYPE_FIXED64:
+        return ToBits<uint64_t>(field, text, bits);
+      case FieldDescriptor::TYPE_UINT32:
+      case FieldDescriptor::TYPE_FIXED32:
+        return ToBits<uint32_t>(field, text, bits);
+      default:
+        return ToBits<int32_t>(field, text, bits);
+    }
+  }
+
+  // Writes the value alone when |tagged| is false, inside a packed field.
+  void WriteScalar(const JsonFieldPlan& field,
+                   uint64_t bits,
+                   std::string_view bytes,
+                   bool tagged = false) {
+    if (tagged) {
+      WriteTag(field.number, field.wire_type);
+    }
+    uint8_t buffer[10];
+    WireWriter writer(buffer);
+    switch (field.wire_type) {
+      case WireType::kFixed32:
+        writer.WriteFixed32(static_cast<uint32_t>(bits));
+        break;
+      case WireType::kFixed64:
+        writer.WriteFixed64(bits);
+        break;
+      case WireType::kLengthDelimited:
+        writer.WriteVarint(bytes.size());
+        break;
+      default:
+        writer.WriteVarint(bits);
+        break;
+    }
+    out_->append(reinterpret_cast<const char*>(buffer),
+                 writer.position() - buffer);
+    out_->append(bytes);
+  }
+
+  void WriteTag(uint32_t number, WireType wire_type) {
+    uint8_t buffer[5];
+    WireWriter writer(buffer);
+    writer.WriteTag(number, wire_type);
+    out_->append(reinterpret_cast<const char*>(buffer),
+                 writer.position() - buffer);
+  }
+
+  // Lengths are not known up front. One byte is reserved, and longer values
+  // move over once their length is.
+  std::size_t BeginLength() {
+    out_->push_back('\0');
+    return out_->size();
+  }
+
+  void EndLength(std::size_t begin) {
+    const std::size_t size = out_->size() - begin;
+    const std::size_t prefix = VarintSize(size);
+    if (prefix > 1) {
+      out_->resize(out_->size() + prefix - 1);
+      std::memmove(out_->data() + begin - 1 + prefix, out_->data() + begin,
+                   size);
+    }
+    WireWriter writer(reinterpret_cast<uint8_t*>(out_->data() + begin - 1));
+    writer.WriteVarint(size);
+  }
+
+  bool ParseWellKnown(const JsonMessagePlan& plan, JsonToken token) {
+    const char* begin = tokens_.token_begin();
+    if (!tokens_.SkipValue(token)) {
+      return false;
+    }
+    auto message = runtime_.message_pool
+                       ? runtime_.message_pool->Acquire(plan.descriptor)
+                       : MessagePool::Handle();
+    if (!message) {
+      return false;
+    }
+    google::protobuf::util::JsonParseOptions parse_options;
+    parse_options.ignore_unknown_fields = true;
+    const std::string_view json(begin, tokens_.position() - begin);
+    return google::protobuf::util::JsonStringToMessage(
+               google::protobuf::StringPiece(json.data(), json.size()),
+               message.get(), parse_options)
+               .ok() &&
+           message->AppendToString(out_);
+  }
+
+  const JsonRuntime& runtime_;
+  JsonTokenizer tokens_;
+  std::string* out_;
+  // Per oneof of the messages being parsed, whether a member was set.
+  std::vector<bool> oneofs_set_;
+  // Unescaped keys, strings and decoded bytes.
+  std::string key_;
+  std::string value_;
+  std::string bytes_;
+};
+}  // namespace
+
+const JsonFieldPlan* JsonMessagePlan::FindByNumber(uint32_t number) const {
+  if (number < dense.size()) {
+    const int32_t index = dense[number];
+    return index >= 0 ? &fields[index] : nullptr;
+  }
+  auto it = std::lower_bound(
+      fields.begin(), fields.end(), number,
+      [](const JsonFieldPlan& field, uint32_t n) { return field.number < n; });
+  return it != fields.end() && it->number == number ? &*it : nullptr;
+}
+
+const JsonFieldPlan* JsonMessagePlan::FindByName(std::string_view name) const {
+  auto it = names.find(name);
+  return it != names.end() ? &fields[it->second] : nullptr;
+}
+
+const Descriptor* JsonPlanCache::FindType(const DescriptorPool* pool,
+                                          std::string_view name) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (auto it = types_.find(name);
+        it != types_.end() && it->second.pool == pool) {
+      return it->second.descriptor;
+    }
+  }
+  const auto* descriptor = pool->FindMessageTypeByName(std::string(name));
+  if (descriptor) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    types_.insert_or_assign(std::string(name), FoundType{pool, descriptor});
+  }
+  return descriptor;
+}
+
+const JsonMessagePlan* JsonPlanCache::Get(const Descriptor* descriptor) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (auto it = plans_.find(descriptor); it != plans_.end()) {
+      return it->second.get();
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  return Compile(descriptor);
+}
+
+const JsonMessagePlan* JsonPlanCache::Compile(const Descriptor* descriptor) {
+  auto& slot = plans_[descriptor];
+  if (slot) {
+    return slot.get();
+  }
+  slot = std::make_unique<JsonMessagePlan>();
+  auto* plan = slot.get();
+  plan->descriptor = descriptor;
+  plan->well_known = IsWellKnown(descriptor);
+  if (plan->well_known) {
+    return plan;
+  }
+  plan->oneof_count = descriptor->real_oneof_decl_count();
+
+  std::vector<const FieldDescriptor*> fields;
+  fields.reserve(descriptor->field_count());
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    fields.push_back(descriptor->field(i));
+  }
+  std::sort(fields.begin(), fields.end(),
+            [](const FieldDescriptor* a, const FieldDescriptor* b) {
+              return a->number() < b->number();
+            });
+
+  plan->fields.reserve(fields.size());
+  for (const auto* field : fields) {
+    auto& entry = plan->fields.emplace_back();
+    entry.field = field;
+    entry.type = field->type();
+    entry.number = static_cast<uint32_t>(field->number());
+    entry.wire_type = ExpectedWireType(entry.type);
+    entry.repeated = field->is_repeated();
+    entry.map = field->is_map();
+    entry.packable = entry.repeated &&
+                     entry.wire_type != WireType::kLengthDelimited &&
+                     entry.wire_type != WireType::kStartGroup;
+    entry.packed = entry.packable && field->is_packed();
+    entry.has_presence = field->has_presence();
+    entry.closed_enum = IsClosedEnum(field);
+    entry.utf8 = RequiresUtf8Validation(field);
+    entry.nullable = IsNullable(field);
+    if (const auto* oneof = field->real_containing_oneof()) {
+      entry.oneof = oneof->index();
+    }
+    if (field->is_required() && plan->required_count < kMaxRequiredBits) {
+      entry.required_bit = plan->required_count++;
+    }
+    if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+      entry.message = Compile(field->message_type());
+    } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
+      entry.enum_values = CompileEnum(field->enum_type());
+    }
+    entry.name_key = QuotedKey(field->name());
+    entry.json_key = QuotedKey(field->json_name());
+  }
+
+  if (!fields.empty() &&
+      fields.back()->number() <= JsonPlanCache::kMaxDenseFieldNumber) {
+    plan->dense.assign(fields.back()->number() + 1, -1);
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+      plan->dense[fields[i]->number()] = static_cast<int32_t>(i);
+    }
+  }
+  // Field names first, a JSON name equal to another field's name does not
+  // shadow it.
+  for (std::size_t i = 0; i < fields.size(); ++i) {
+    plan->names.emplace(fields[i]->name(), static_cast<int32_t>(i));
+  }
+  for (std::size_t i = 0; i < fields.size(); ++i) {
+    plan->names.emplace(fields[i]->json_name(), static_cast<int32_t>(i));
+  }
+  return plan;
+}
+
+const JsonEnumPlan* JsonPlanCache::CompileEnum(
+    const EnumDescriptor* descriptor) {
+  auto& slot = enums_[descriptor];
+  if (!slot) {
+    slot = std::make_unique<JsonEnumPlan>();
+    slot->descriptor = descriptor;
+    for (int i = 0; i < descriptor->value_count(); ++i) {
+      const auto* value = descriptor->value(i);
+      slot->numbers.emplace(value->name(), value->number());
+    }
+  }
+  return slot.get();
+}
+
+ErrorCode to_json(const JsonRuntime& runtime,
+                  const PBInfo& pb_info,
+                  std::string* json,
+                  const PBOptions& options) {
+  json->clear();
+  const Descriptor* descriptor =
+      runtime.plans->FindType(runtime.descriptor_pool, pb_info.type);
+  if (!descriptor) {
+    PB_LOG(ERROR) << "FindMessageTypeByName error, type: " << pb_info.type;
+    return PBError::KPBMessageNotFound;
+  }
+  WireToJson writer(runtime, options, json);
+  if (!writer.WriteMessage(*runtime.plans->Get(descriptor), pb_info.data, 0)) {
+    PB_LOG(ERROR) << "to_json parse error, pb.size(): " << pb_info.data.size();
+    json->clear();
+    return PBError::kPBParseError;
+  }
+  return CommonError::SUCCESS;
+}
+
+ErrorCode from_json(const JsonRuntime& runtime,
+                    std::string_view json,
+                    std::string_view pb_type,
+                    std::string* pb) {
+  pb->clear();
+  const Descriptor* descriptor =
+      runtime.plans->FindType(runtime.descriptor_pool, pb_type);
+  if (!descriptor) {
+    PB_LOG(ERROR) << "FindMessageTypeByName error, type: " << pb_type;
+    return PBError::KPBMessageNotFound;
+  }
+  JsonToWire parser(runtime, json, pb);
+  if (!parser.Parse(*runtime.plans->Get(descriptor))) {
+    PB_LOG(ERROR) << "from_json parse error, json.size(): " << json.size();
+    pb->clear();
+    return PBError::kPBParseError;
+  }
+  return CommonError::SUCCESS;
+}
+}  // namespace magic::pb
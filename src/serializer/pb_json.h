@@ -0,0 +1,154 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_JSON_H_
+#define CONVERT_SRC_SERIALIZER_PB_JSON_H_
+
+#include <google/protobuf/descriptor.h>
+
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "serializer/pb_message_pool.h"
+#include "serializer/pb_serializer.h"
+#include "serializer/pb_wire_format.h"
+
+// Transcoding between protobuf wire format and its JSON mapping, guided by
+// the Descriptor, without a Message or platform objects in between.
+//
+// to_json output parses with JsonStringToMessage to the message it was
+// written from, but is not byte for byte that of MessageToJsonString:
+// floats are printed shortest round trip ("1e-45" rather than
+// "1.40129846e-45") and characters such as U+007F, U+2028, '<' and '>' are
+// not escaped. from_json takes strict RFC 8259 JSON in the proto3 JSON
+// mapping and fails where JsonStringToMessage is more lenient, as with
+// quoted bools or null elements of repeated fields. Like it, from_json
+// fails on a oneof set twice and on duplicate map keys.
+namespace magic::pb {
+using google::protobuf::EnumDescriptor;
+
+struct JsonMessagePlan;
+
+struct JsonEnumPlan {
+  const EnumDescriptor* descriptor = nullptr;
+  std::unordered_map<std::string_view, int32_t> numbers;
+};
+
+struct JsonFieldPlan {
+  const FieldDescriptor* field = nullptr;
+  FieldDescriptor::Type type = FieldDescriptor::TYPE_INT32;
+  uint32_t number = 0;
+  WireType wire_type = WireType::kVarint;
+  bool repeated = false;
+  // Repeated scalars other than strings and bytes, which take packed input.
+  bool packable = false;
+  // Written packed.
+  bool packed = false;
+  bool map = false;
+  bool has_presence = false;
+  bool closed_enum = false;
+  bool utf8 = false;
+  // google.protobuf.Value and NullValue fields, for which JSON null is a
+  // value rather than the default.
+  bool nullable = false;
+  // Index of the real oneof holding the field, -1 if none.
+  int oneof = -1;
+  // Bit of the field among its message's required fields, -1 if optional.
+  int required_bit = -1;
+  // Messages, groups and map entries.
+  const JsonMessagePlan* message = nullptr;
+  const JsonEnumPlan* enum_values = nullptr;
+  // Quoted key followed by ':', by field name and by JSON name.
+  std::string name_key;
+  std::string json_key;
+};
+
+struct JsonMessagePlan {
+  const Descriptor* descriptor = nullptr;
+  // Well-known types with a JSON form of their own, converted by
+  // protobuf's json_util through a pooled message.
+  bool well_known = false;
+  // By field number.
+  std::vector<JsonFieldPlan> fields;
+  // Index into |fields| per field number up to kMaxDenseFieldNumber, -1 for
+  // numbers that are not fields.
+  std::vector<int32_t> dense;
+  // Field names and JSON names.
+  std::unordered_map<std::string_view, int32_t> names;
+  int required_count = 0;
+  int oneof_count = 0;
+
+  const JsonFieldPlan* FindByNumber(uint32_t number) const;
+  const JsonFieldPlan* FindByName(std::string_view name) const;
+};
+
+// Compiles and caches JsonMessagePlans per Descriptor. Plans are immutable
+// once published and shared by all threads.
+class JsonPlanCache {
+ public:
+  JsonPlanCache() = default;
+
+  JsonPlanCache(const JsonPlanCache&) = delete;
+  JsonPlanCache& operator=(const JsonPlanCache&) = delete;
+
+  // FindMessageTypeByName on |pool| without building a std::string once
+  // |name| was found in it.
+  const Descriptor* FindType(const DescriptorPool* pool,
+                             std::string_view name);
+
+  const JsonMessagePlan* Get(const Descriptor* descriptor);
+
+  static constexpr int kMaxDenseFieldNumber = 4096;
+
+ private:
+  struct FoundType {
+    // Only compared with the pool asked for.
+    const DescriptorPool* pool = nullptr;
+    const Descriptor* descriptor = nullptr;
+  };
+
+  // Require |mutex_| held exclusively. Plans are published before their
+  // fields are compiled so recursive message types resolve to them.
+  const JsonMessagePlan* Compile(const Descriptor* descriptor);
+  const JsonEnumPlan* CompileEnum(const EnumDescriptor* descriptor);
+
+  std::shared_mutex mutex_;
+  // Type last found per name.
+  std::map<std::string, FoundType, std::less<>> types_;
+  std::unordered_map<const Descriptor*, std::unique_ptr<JsonMessagePlan>>
+      plans_;
+  std::unordered_map<const EnumDescriptor*, std::unique_ptr<JsonEnumPlan>>
+      enums_;
+};
+
+// What transcoding runs against. The message pool is only used for
+// well-known types.
+struct JsonRuntime {
+  DescriptorPool* descriptor_pool = nullptr;
+  MessagePool* message_pool = nullptr;
+  JsonPlanCache* plans = nullptr;
+};
+
+// Replaces the contents of |json| with the JSON form of |pb_info|, reusing
+// its storage. Keys are field names, or JSON names with
+// PBOptions::use_camelcase, and 64-bit integers follow
+// PBOptions::int64_format; other options do not apply. Unknown fields are
+// dropped, as are invalid UTF-8 bytes in proto2 strings.
+ErrorCode to_json(const JsonRuntime& runtime,
+                  const PBInfo& pb_info,
+                  std::string* json,
+                  const PBOptions& options = {});
+
+// Replaces the contents of |pb| with the wire format of |json|, a |pb_type|
+// message. Both names of a field are taken, and unknown keys and enum names
+// are skipped like JsonParseOptions::ignore_unknown_fields does. null
+// stands for the default value.
+ErrorCode from_json(const JsonRuntime& runtime,
+                    std::string_view json,
+                    std::string_view pb_type,
+                    std::string* pb);
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_JSON_H_
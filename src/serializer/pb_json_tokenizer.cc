@@ -0,0 +1,437 @@
+#include "serializer/pb_json_tokenizer.h"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace magic::pb {
+namespace {
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// The four hex digits at |p|, -1 if they are not.
+int32_t ReadHex4(const char* p) {
+  int32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    const int digit = HexValue(p[i]);
+    if (digit < 0) {
+      return -1;
+    }
+    value = value << 4 | digit;
+  }
+  return value;
+}
+
+void AppendUtf8(uint32_t code_point, std::string* out) {
+  char buffer[4];
+  std::size_t size;
+  if (code_point < 0x80) {
+    buffer[0] = static_cast<char>(code_point);
+    size = 1;
+  } else if (code_point < 0x800) {
+    buffer[0] = static_cast<char>(0xc0 | code_point >> 6);
+    buffer[1] = static_cast<char>(0x80 | (code_point & 0x3f));
+    size = 2;
+  } else if (code_point < 0x10000) {
+    buffer[0] = static_cast<char>(0xe0 | code_point >> 12);
+    buffer[1] = static_cast<char>(0x80 | (code_point >> 6 & 0x3f));
+    buffer[2] = static_cast<char>(0x80 | (code_point & 0x3f));
+    size = 3;
+  } else {
+    buffer[0] = static_cast<char>(0xf0 | code_point >> 18);
+    buffer[1] = static_cast<char>(0x80 | (code_point >> 12 & 0x3f));
+    buffer[2] = static_cast<char>(0x80 | (code_point >> 6 & 0x3f));
+    buffer[3] = static_cast<char>(0x80 | (code_point & 0x3f));
+    size = 4;
+  }
+  out->append(buffer, size);
+}
+}  // namespace
+
+const char* FindJsonSpecial(const char* ptr, const char* end) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i last_control = _mm_set1_epi8(0x1f);
+  for (; end - ptr >= 16; ptr += 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    // Unsigned c <= 0x1f exactly when min(c, 0x1f) == c.
+    const __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk));
+    if (const int mask = _mm_movemask_epi8(special)) {
+      return ptr + std::countr_zero(static_cast<unsigned>(mask));
+    }
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  const uint8x16_t space = vdupq_n_u8(0x20);
+  for (; end - ptr >= 16; ptr += 16) {
+    const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(ptr));
+    const uint8x16_t special =
+        vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+                 vcltq_u8(chunk, space));
+    // Narrowing keeps four bits per byte, NEON has no movemask.
+    const uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(special), 4)),
+        0);
+    if (mask) {
+      return ptr + std::countr_zero(mask) / 4;
+    }
+  }
+#endif
+  for (; ptr < end; ++ptr) {
+    const auto c = static_cast<uint8_t>(*ptr);
+    if (c == '"' || c == '\\' || c < 0x20) {
+      return ptr;
+    }
+  }
+  return end;
+}
+
+void AppendJsonString(std::string_view value, std::string* out) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out->push_back('"');
+  const char* ptr = value.data();
+  const char* end = ptr + value.size();
+  while (true) {
+    const char* special = FindJsonSpecial(ptr, end);
+    out->append(ptr, special);
+    if (special == end) {
+      break;
+    }
+    const auto c = static_cast<uint8_t>(*special);
+    switch (c) {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      case '\b':
+        out->append("\\b");
+        break;
+      case '\f':
+        out->append("\\f");
+        break;
+      case '\n':
+        out->append("\\n");
+        break;
+      case '\r':
+        out->append("\\r");
+        break;
+      case '\t':
+        out->append("\\t");
+        break;
+      default: {
+        const char escape[] = {'\\', 'u', '0', '0', kHex[c >> 4],
+                               kHex[c & 0xf]};
+        out->append(escape, sizeof(escape));
+        break;
+      }
+    }
+    ptr = special + 1;
+  }
+  out->push_back('"');
+}
+
+bool UnescapeJson(std::string_view raw, std::string* out) {
+  const char* ptr = raw.data();
+  const char* end = ptr + raw.size();
+  while (ptr < end) {
+    const auto* backslash =
+        static_cast<const char*>(std::memchr(ptr, '\\', end - ptr));
+    if (!backslash) {
+      out->append(ptr, end);
+      return true;
+    }
+    out->append(ptr, backslash);
+    ptr = backslash + 1;
+    if (ptr == end) {
+      return false;
+    }
+    switch (*ptr++) {
+      case '"':
+        out->push_back('"');
+        break;
+      case '\\':
+        out->push_back('\\');
+        break;
+      case '/':
+        out->push_back('/');
+        break;
+      case 'b':
+        out->push_back('\b');
+        break;
+      case 'f':
+        out->push_back('\f');
+        break;
+      case 'n':
+        out->push_back('\n');
+        break;
+      case 'r':
+        out->push_back('\r');
+        break;
+      case 't':
+        out->push_back('\t');
+        break;
+      case 'u': {
+        int32_t unit = end - ptr >= 4 ? ReadHex4(ptr) : -1;
+        if (unit < 0 || (unit >= 0xdc00 && unit <= 0xdfff)) {
+          return false;
+        }
+        ptr += 4;
+        uint32_t code_point = unit;
+        if (unit >= 0xd800 && unit <= 0xdbff) {
+          const int32_t low = end - ptr >= 6 && ptr[0] == '\\' && ptr[1] == 'u'
+                                  ? ReadHex4(ptr + 2)
+                                  : -1;
+          if (low < 0xdc00 || low > 0xdfff) {
+            return false;
+          }
+          ptr += 6;
+          code_point = 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+        }
+        AppendUtf8(code_point, out);
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+JsonTokenizer::JsonTokenizer(std::string_view json)
+    : ptr_(json.data()), end_(json.data() + json.size()), token_(ptr_) {}
+
+JsonToken JsonTokenizer::Next() {
+  SkipWhitespace();
+  token_ = ptr_;
+  switch (state_) {
+    case State::kTopLevel:
+      return ReadValue();
+    case State::kFirstKey:
+      if (ptr_ < end_ && *ptr_ == '}') {
+        return ReadClose();
+      }
+      return ReadKey();
+    case State::kFirstValue:
+      if (ptr_ < end_ && *ptr_ == ']') {
+        return ReadClose();
+      }
+      return ReadValue();
+    case State::kAfterKey:
+      if (ptr_ == end_ || *ptr_ != ':') {
+        return Fail();
+      }
+      ++ptr_;
+      SkipWhitespace();
+      token_ = ptr_;
+      return ReadValue();
+    case State::kAfterValue:
+      if (ptr_ < end_ && *ptr_ == ',') {
+        ++ptr_;
+        SkipWhitespace();
+        token_ = ptr_;
+        return containers_.back() == '{' ? ReadKey() : ReadValue();
+      }
+      return ReadClose();
+    case State::kDone:
+      return ptr_ == end_ ? JsonToken::kEnd : Fail();
+    case State::kError:
+      return JsonToken::kError;
+  }
+  return Fail();
+}
+
+bool JsonTokenizer::SkipValue(JsonToken token) {
+  switch (token) {
+    case JsonToken::kBeginObject:
+    case JsonToken::kBeginArray:
+      break;
+    case JsonToken::kString:
+    case JsonToken::kNumber:
+    case JsonToken::kTrue:
+    case JsonToken::kFalse:
+    case JsonToken::kNull:
+      return true;
+    default:
+      return false;
+  }
+  const std::size_t depth = containers_.size() - 1;
+  while (containers_.size() > depth) {
+    token = Next();
+    if (token == JsonToken::kError) {
+      return false;
+    }
+  }
+  return true;
+}
+
+JsonToken JsonTokenizer::ReadKey() {
+  if (ptr_ == end_ || *ptr_ != '"' || !ReadString()) {
+    return Fail();
+  }
+  state_ = State::kAfterKey;
+  return JsonToken::kString;
+}
+
+JsonToken JsonTokenizer::ReadValue() {
+  if (ptr_ == end_) {
+    return Fail();
+  }
+  switch (*ptr_) {
+    case '{':
+      return Open('{', JsonToken::kBeginObject);
+    case '[':
+      return Open('[', JsonToken::kBeginArray);
+    case '"':
+      return ReadString() ? Scalar(JsonToken::kString) : Fail();
+    case 't':
+      return ReadLiteral("true") ? Scalar(JsonToken::kTrue) : Fail();
+    case 'f':
+      return ReadLiteral("false") ? Scalar(JsonToken::kFalse) : Fail();
+    case 'n':
+      return ReadLiteral("null") ? Scalar(JsonToken::kNull) : Fail();
+    default:
+      return ReadNumber() ? Scalar(JsonToken::kNumber) : Fail();
+  }
+}
+
+JsonToken JsonTokenizer::ReadClose() {
+  if (ptr_ == end_ || containers_.empty() ||
+      *ptr_ != (containers_.back() == '{' ? '}' : ']')) {
+    return Fail();
+  }
+  ++ptr_;
+  const bool object = containers_.back() == '{';
+  containers_.pop_back();
+  return Scalar(object ? JsonToken::kEndObject : JsonToken::kEndArray);
+}
+
+JsonToken JsonTokenizer::Scalar(JsonToken token) {
+  state_ = containers_.empty() ? State::kDone : State::kAfterValue;
+  return token;
+}
+
+JsonToken JsonTokenizer::Open(char container, JsonToken token) {
+  ++ptr_;
+  containers_.push_back(container);
+  state_ = container == '{' ? State::kFirstKey : State::kFirstValue;
+  return token;
+}
+
+bool JsonTokenizer::ReadString() {
+  const char* begin = ++ptr_;
+  escaped_ = false;
+  while (true) {
+    ptr_ = FindJsonSpecial(ptr_, end_);
+    if (ptr_ == end_) {
+      return false;
+    }
+    if (*ptr_ == '"') {
+      break;
+    }
+    if (*ptr_ != '\\' || end_ - ptr_ < 2) {
+      return false;
+    }
+    escaped_ = true;
+    switch (ptr_[1]) {
+      case '"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        ptr_ += 2;
+        break;
+      case 'u':
+        if (end_ - ptr_ < 6 || ReadHex4(ptr_ + 2) < 0) {
+          return false;
+        }
+        ptr_ += 6;
+        break;
+      default:
+        return false;
+    }
+  }
+  text_ = std::string_view(begin, ptr_ - begin);
+  ++ptr_;
+  return true;
+}
+
+bool JsonTokenizer::ReadNumber() {
+  const char* begin = ptr_;
+  if (ptr_ < end_ && *ptr_ == '-') {
+    ++ptr_;
+  }
+  if (ptr_ == end_ || !IsDigit(*ptr_)) {
+    return false;
+  }
+  if (*ptr_++ != '0') {
+    while (ptr_ < end_ && IsDigit(*ptr_)) {
+      ++ptr_;
+    }
+  }
+  if (ptr_ < end_ && *ptr_ == '.') {
+    if (++ptr_ == end_ || !IsDigit(*ptr_)) {
+      return false;
+    }
+    while (ptr_ < end_ && IsDigit(*ptr_)) {
+      ++ptr_;
+    }
+  }
+  if (ptr_ < end_ && (*ptr_ == 'e' || *ptr_ == 'E')) {
+    if (++ptr_ < end_ && (*ptr_ == '+' || *ptr_ == '-')) {
+      ++ptr_;
+    }
+    if (ptr_ == end_ || !IsDigit(*ptr_)) {
+      return false;
+    }
+    while (ptr_ < end_ && IsDigit(*ptr_)) {
+      ++ptr_;
+    }
+  }
+  text_ = std::string_view(begin, ptr_ - begin);
+  return true;
+}
+
+bool JsonTokenizer::ReadLiteral(std::string_view literal) {
+  if (static_cast<std::size_t>(end_ - ptr_) < literal.size() ||
+      std::memcmp(ptr_, literal.data(), literal.size()) != 0) {
+    return false;
+  }
+  ptr_ += literal.size();
+  return true;
+}
+
+JsonToken JsonTokenizer::Fail() {
+  state_ = State::kError;
+  return JsonToken::kError;
+}
+}  // namespace magic::pb
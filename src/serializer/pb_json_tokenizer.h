@@ -0,0 +1,102 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_JSON_TOKENIZER_H_
+#define CONVERT_SRC_SERIALIZER_PB_JSON_TOKENIZER_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace magic::pb {
+// Position of the first '"', '\\' or control character in [ptr, end), |end|
+// if there is none. Scans 16 bytes at a time with SSE2 or NEON.
+const char* FindJsonSpecial(const char* ptr, const char* end);
+
+// Appends |value| to |out| as a quoted JSON string.
+void AppendJsonString(std::string_view value, std::string* out);
+
+// Appends the decoded form of |raw|, the text between the quotes of a JSON
+// string. False on an unpaired surrogate, which has no UTF-8 form.
+bool UnescapeJson(std::string_view raw, std::string* out);
+
+enum class JsonToken : uint8_t {
+  kError,
+  kEnd,
+  kBeginObject,
+  kEndObject,
+  kBeginArray,
+  kEndArray,
+  // Object keys as well as string values.
+  kString,
+  kNumber,
+  kTrue,
+  kFalse,
+  kNull,
+};
+
+// Pull tokenizer over one JSON text (RFC 8259). The structure is checked as
+// tokens are pulled: keys are strings, and ':' and ',' are consumed where
+// they belong. Anything else is kError, as is every token after it. kEnd
+// follows the top level value.
+//
+// Strings are not copied or decoded: text() is a view of the input, and
+// only strings that are escaped() need UnescapeJson.
+class JsonTokenizer {
+ public:
+  explicit JsonTokenizer(std::string_view json);
+
+  JsonToken Next();
+
+  // Contents of a kString without the quotes, the text of a kNumber.
+  std::string_view text() const { return text_; }
+  bool escaped() const { return escaped_; }
+
+  // Where the last token starts, and where the tokenizer is.
+  const char* token_begin() const { return token_; }
+  const char* position() const { return ptr_; }
+
+  // Skips the rest of a value whose first token was just pulled, so that
+  // containers are skipped whole. False on malformed input or if |token|
+  // does not start a value.
+  bool SkipValue(JsonToken token);
+
+ private:
+  enum class State : uint8_t {
+    kTopLevel,
+    // Right after '{' and '['.
+    kFirstKey,
+    kFirstValue,
+    kAfterKey,
+    kAfterValue,
+    kDone,
+    kError,
+  };
+
+  JsonToken ReadKey();
+  JsonToken ReadValue();
+  JsonToken ReadClose();
+  JsonToken Scalar(JsonToken token);
+  JsonToken Open(char container, JsonToken token);
+  bool ReadString();
+  bool ReadNumber();
+  bool ReadLiteral(std::string_view literal);
+  JsonToken Fail();
+
+  void SkipWhitespace() {
+    while (ptr_ < end_ && (*ptr_ == ' ' || *ptr_ == '\n' || *ptr_ == '\r' ||
+                           *ptr_ == '\t')) {
+      ++ptr_;
+    }
+  }
+
+  const char* ptr_;
+  const char* end_;
+  const char* token_;
+  std::string_view text_;
+  bool escaped_ = false;
+  State state_ = State::kTopLevel;
+  // '{' or '[' per open container.
+  std::vector<char> containers_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_JSON_TOKENIZER_H_
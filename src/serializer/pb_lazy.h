@@ -0,0 +1,114 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_LAZY_H_
+#define CONVERT_SRC_SERIALIZER_PB_LAZY_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "serializer/pb_serializer.h"
+
+namespace magic::pb {
+// Owner of a payload decoded with PBOptions::lazy, the caller's or a copy,
+// shared by every lazy container made from it.
+using LazyBytes = std::shared_ptr<const void>;
+
+// A sub message converted on first use, one nesting level at a time: its
+// own sub messages come back lazy again. Its bytes were checked by the
+// decode that made it, Get() only returns an empty Object when the backend
+// fails to make a value, which containers must report rather than read as
+// an empty message. Thread safe.
+//
+// Keeps the plan it was made with, so it must not be used once the
+// PBRuntime that decoded it is gone, unless that runtime has an owner.
+template <typename Object>
+class LazyMessage {
+ public:
+  LazyMessage(const MessagePlan<Object>& plan,
+              const PBOptions& options,
+              LazyBytes bytes,
+              std::vector<std::string_view> slices)
+      : plan_(plan),
+        options_(options),
+        bytes_(std::move(bytes)),
+        slices_(std::move(slices)) {}
+
+  const Descriptor* descriptor() const { return plan_.descriptor; }
+
+  Object Get();
+
+ private:
+  const MessagePlan<Object>& plan_;
+  PBOptions options_;
+  LazyBytes bytes_;
+  // Occurrences merged into the message, none for an absent one.
+  std::vector<std::string_view> slices_;
+  std::once_flag once_;
+  Object value_{};
+};
+
+// Elements of a repeated message field, each a LazyMessage made on first
+// use. Thread safe, same lifetime rule as LazyMessage.
+template <typename Object>
+class LazyRepeated {
+ public:
+  LazyRepeated(const MessagePlan<Object>& plan,
+               const PBOptions& options,
+               LazyBytes bytes,
+               std::vector<std::string_view> elements)
+      : plan_(plan),
+        options_(options),
+        bytes_(std::move(bytes)),
+        elements_(std::move(elements)),
+        once_(new std::once_flag[elements_.size()]),
+        values_(elements_.size()) {}
+
+  std::size_t size() const { return elements_.size(); }
+
+  Object At(std::size_t index);
+
+ private:
+  const MessagePlan<Object>& plan_;
+  PBOptions options_;
+  LazyBytes bytes_;
+  std::vector<std::string_view> elements_;
+  std::unique_ptr<std::once_flag[]> once_;
+  std::vector<Object> values_;
+};
+
+// Backends opt in to lazy containers by giving DictWrapper<Object, false>
+//   static Object Lazy(std::shared_ptr<LazyMessage<Object>>)
+// and ArrayWrapper<Object, false>
+//   static Object Lazy(std::shared_ptr<LazyRepeated<Object>>)
+// that return containers calling Get() and At() when first read. Without
+// them the values are converted right away.
+template <typename Object>
+Object MakeLazy(std::shared_ptr<LazyMessage<Object>> message) {
+  if constexpr (requires { DictWrapper<Object, false>::Lazy(message); }) {
+    return DictWrapper<Object, false>::Lazy(std::move(message));
+  } else {
+    return message->Get();
+  }
+}
+
+template <typename Object>
+Object MakeLazy(std::shared_ptr<LazyRepeated<Object>> repeated) {
+  if constexpr (requires { ArrayWrapper<Object, false>::Lazy(repeated); }) {
+    return ArrayWrapper<Object, false>::Lazy(std::move(repeated));
+  } else {
+    ArrayWrapper<Object, false> array_wrapper;
+    for (std::size_t i = 0; i < repeated->size(); ++i) {
+      auto item = repeated->At(i);
+      if (!item) {
+        return {};
+      }
+      array_wrapper.Add(item);
+    }
+    return array_wrapper;
+  }
+}
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_LAZY_H_
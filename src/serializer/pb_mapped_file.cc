@@ -0,0 +1,45 @@
+#include "serializer/pb_mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "serializer/pb_serializer.h"
+
+namespace magic::pb {
+MappedFile::MappedFile(const char* data, std::size_t size)
+    : data_(data), size_(size) {}
+
+MappedFile::~MappedFile() {
+  if (size_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    PB_LOG(ERROR) << "open error, path: " << path;
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    PB_LOG(ERROR) << "fstat error, path: " << path;
+    close(fd);
+    return nullptr;
+  }
+  auto size = static_cast<std::size_t>(st.st_size);
+  void* data = nullptr;
+  if (size) {
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    PB_LOG(ERROR) << "mmap error, path: " << path;
+    return nullptr;
+  }
+  return std::unique_ptr<MappedFile>(
+      new MappedFile(static_cast<const char*>(data), size));
+}
+}  // namespace magic::pb
@@ -0,0 +1,30 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_MAPPED_FILE_H_
+#define CONVERT_SRC_SERIALIZER_PB_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace magic::pb {
+// Read-only mapping of a whole file, unmapped when destroyed.
+class MappedFile {
+ public:
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  static std::unique_ptr<MappedFile> Open(const std::string& path);
+
+  std::string_view data() const { return {data_, size_}; }
+
+ private:
+  MappedFile(const char* data, std::size_t size);
+
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_MAPPED_FILE_H_
@@ -0,0 +1,74 @@
+#include "serializer/pb_message_pool.h"
+
+namespace magic::pb {
+void MessagePool::Deleter::operator()(Message* message) const {
+  if (arena_owned_) {
+    return;
+  }
+  if (pool_) {
+    pool_->Release(message);
+  } else {
+    delete message;
+  }
+}
+
+MessagePool::MessagePool(std::size_t max_idle_per_type)
+    : max_idle_per_type_(max_idle_per_type) {}
+
+// Idle messages must go before the factory that owns their prototypes.
+MessagePool::~MessagePool() {
+  slots_.clear();
+}
+
+MessagePool::Slot& MessagePool::GetSlot(const Descriptor* descriptor) {
+  auto& slot = slots_[descriptor];
+  if (!slot.prototype) {
+    slot.prototype = factory_.GetPrototype(descriptor);
+  }
+  return slot;
+}
+
+MessagePool::Handle MessagePool::Acquire(const Descriptor* descriptor) {
+  const Message* prototype = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = GetSlot(descriptor);
+    if (!slot.idle.empty()) {
+      auto message = std::move(slot.idle.back());
+      slot.idle.pop_back();
+      return Handle(message.release(), Deleter(this));
+    }
+    prototype = slot.prototype;
+  }
+  return prototype ? Handle(prototype->New(), Deleter(this)) : Handle();
+}
+
+MessagePool::Handle MessagePool::Acquire(const Descriptor* descriptor,
+                                         Arena* arena) {
+  if (!arena) {
+    return Acquire(descriptor);
+  }
+  const Message* prototype = GetPrototype(descriptor);
+  if (!prototype) {
+    return Handle();
+  }
+  Deleter deleter;
+  deleter.arena_owned_ = true;
+  return Handle(prototype->New(arena), deleter);
+}
+
+const Message* MessagePool::GetPrototype(const Descriptor* descriptor) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return GetSlot(descriptor).prototype;
+}
+
+void MessagePool::Release(Message* message) {
+  std::unique_ptr<Message> owned(message);
+  owned->Clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& idle = slots_[owned->GetDescriptor()].idle;
+  if (idle.size() < max_idle_per_type_) {
+    idle.emplace_back(std::move(owned));
+  }
+}
+}  // namespace magic::pb
@@ -0,0 +1,79 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_MESSAGE_POOL_H_
+#define CONVERT_SRC_SERIALIZER_PB_MESSAGE_POOL_H_
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/message.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace magic::pb {
+using google::protobuf::Arena;
+using google::protobuf::Descriptor;
+using google::protobuf::DynamicMessageFactory;
+using google::protobuf::Message;
+
+// Owns one long-lived DynamicMessageFactory and keeps a free list of
+// Clear()ed messages per type, so steady-state conversion of a known type
+// does no factory, prototype or message allocation work.
+//
+// Thread safe. Messages handed out must be released before the pool (and the
+// DescriptorPool the descriptors come from) is destroyed.
+class MessagePool {
+ public:
+  class Deleter {
+   public:
+    Deleter() = default;
+    explicit Deleter(MessagePool* pool) : pool_(pool) {}
+
+    void operator()(Message* message) const;
+
+   private:
+    friend class MessagePool;
+
+    MessagePool* pool_ = nullptr;
+    bool arena_owned_ = false;
+  };
+
+  using Handle = std::unique_ptr<Message, Deleter>;
+
+  explicit MessagePool(std::size_t max_idle_per_type = kDefaultMaxIdlePerType);
+  ~MessagePool();
+
+  MessagePool(const MessagePool&) = delete;
+  MessagePool& operator=(const MessagePool&) = delete;
+
+  // Returns an empty message of |descriptor|'s type, reusing a released one
+  // when available. Returns an empty handle if no prototype can be built.
+  Handle Acquire(const Descriptor* descriptor);
+
+  // Same, but builds the message on |arena| when not null. Such handles do
+  // not return to the pool, the arena frees the message.
+  Handle Acquire(const Descriptor* descriptor, Arena* arena);
+
+  const Message* GetPrototype(const Descriptor* descriptor);
+
+  static constexpr std::size_t kDefaultMaxIdlePerType = 8;
+
+ private:
+  struct Slot {
+    const Message* prototype = nullptr;
+    std::vector<std::unique_ptr<Message>> idle;
+  };
+
+  Slot& GetSlot(const Descriptor* descriptor);
+
+  void Release(Message* message);
+
+  const std::size_t max_idle_per_type_;
+  std::mutex mutex_;
+  DynamicMessageFactory factory_;
+  std::unordered_map<const Descriptor*, Slot> slots_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_MESSAGE_POOL_H_
@@ -0,0 +1,161 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_PUSH_PARSER_H_
+#define CONVERT_SRC_SERIALIZER_PB_PUSH_PARSER_H_
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "serializer/pb_serializer.h"
+#include "serializer/pb_wire_decoder.h"
+#include "serializer/pb_wire_format.h"
+
+namespace magic::pb {
+// Decodes one message whose bytes arrive in chunks of any size. Every top
+// level field is fed to a WireDecoder as soon as its last byte arrives, so
+// repeated and map elements are converted while the payload is still being
+// received. Only a field split across chunks is buffered, and top level
+// strings and singular sub messages are copied because later occurrences
+// may still replace or merge into them.
+//
+// The result equals from_pb on the concatenated chunks with either engine.
+template <typename Object>
+class PushParser {
+ public:
+  PushParser(const PBRuntime<Object>& runtime,
+             std::string_view pb_type,
+             const PBOptions& options = {})
+      : owner_(runtime.owner), options_(options), decoder_(options_) {
+    if (!CanCreate<Object>()) {
+      PB_LOG(ERROR) << "PushParser no storage for new objects";
+      error_ = CommonError::INVALID_ARG;
+      return;
+    }
+    const Descriptor* descriptor =
+        runtime.plans->FindType(runtime.descriptor_pool, pb_type);
+    if (!descriptor) {
+      PB_LOG(ERROR) << "FindMessageTypeByName error, type: " << pb_type;
+      error_ = PBError::KPBMessageNotFound;
+      return;
+    }
+    decoder_.Begin(*runtime.plans->Get(descriptor, options_), &kept_);
+  }
+
+  PushParser(const PushParser&) = delete;
+  PushParser& operator=(const PushParser&) = delete;
+
+  // Returns false once the payload is known to be malformed.
+  bool Feed(std::string_view chunk) {
+    if (finished_ || error_) {
+      return false;
+    }
+    while (!pending_.empty() && !chunk.empty()) {
+      auto take = std::min(unsized_ ? chunk.size() : Missing(), chunk.size());
+      pending_.append(chunk.data(), take);
+      chunk.remove_prefix(take);
+      if (unsized_ && pending_.size() < 2 * unsized_) {
+        return true;
+      }
+      pending_.erase(0, Consume(pending_));
+      if (error_) {
+        return false;
+      }
+      CheckUnsized();
+    }
+    if (pending_.empty()) {
+      auto used = Consume(chunk);
+      if (error_) {
+        return false;
+      }
+      pending_.assign(chunk.substr(used));
+      CheckUnsized();
+    }
+    return true;
+  }
+
+  // Converts what was fed. The parser takes no more chunks afterwards.
+  std::pair<ErrorCode, Object> Finish() {
+    if (finished_) {
+      return {CommonError::FAILED, {}};
+    }
+    finished_ = true;
+    if (error_) {
+      return {error_, {}};
+    }
+    // A group may have been completed since it was last probed.
+    pending_.erase(0, Consume(pending_));
+    if (error_) {
+      return {error_, {}};
+    }
+    if (!pending_.empty()) {
+      PB_LOG(ERROR) << "PushParser truncated field, size: " << pending_.size();
+      return {PBError::kPBParseError, {}};
+    }
+    return decoder_.End();
+  }
+
+ private:
+  // Probe size while the length of the pending field is unknown, more than
+  // any tag and varint together.
+  static constexpr std::size_t kProbeSize = 16;
+
+  // Bytes to add to |pending_| before its field may be complete.
+  std::size_t Missing() const {
+    std::size_t size = 0;
+    ProbeField(pending_, &size);
+    return size > pending_.size() ? size - pending_.size() : kProbeSize;
+  }
+
+  // A pending field past kProbeSize whose length is still unknown is a
+  // group, found complete only by scanning it whole. Whole chunks are then
+  // buffered and it is probed again once |pending_| doubled, which keeps
+  // a group split into many chunks linear.
+  void CheckUnsized() {
+    std::size_t size = 0;
+    const bool group =
+        pending_.size() >= kProbeSize &&
+        ProbeField(pending_, &size) == FieldStatus::kIncomplete && size == 0;
+    unsized_ = group ? pending_.size() : 0;
+  }
+
+  // Feeds the complete fields at the front of |data|, returns their size.
+  std::size_t Consume(std::string_view data) {
+    std::size_t used = 0;
+    while (used < data.size()) {
+      auto rest = data.substr(used);
+      std::size_t size = 0;
+      auto status = ProbeField(rest, &size);
+      if (status == FieldStatus::kIncomplete) {
+        break;
+      }
+      WireReader reader(rest.substr(0, size));
+      uint32_t number = 0;
+      WireType wire_type;
+      if (status == FieldStatus::kMalformed ||
+          !reader.ReadTag(&number, &wire_type) ||
+          !decoder_.Field(number, wire_type, reader)) {
+        PB_LOG(ERROR) << "PushParser parse error, offset: " << used;
+        error_ = PBError::kPBParseError;
+        break;
+      }
+      used += size;
+    }
+    return used;
+  }
+
+  std::shared_ptr<const void> owner_;
+  PBOptions options_;
+  WireDecoder<Object> decoder_;
+  std::deque<std::string> kept_;
+  // Beginning of a field split across chunks.
+  std::string pending_;
+  // Size of |pending_| when its group was last probed, 0 if not a group.
+  std::size_t unsized_ = 0;
+  ErrorCode error_ = CommonError::SUCCESS;
+  bool finished_ = false;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_PUSH_PARSER_H_
@@ -0,0 +1,66 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_RCU_PTR_H_
+#define CONVERT_SRC_SERIALIZER_PB_RCU_PTR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace magic::pb {
+// Shared pointer read without locks and replaced RCU style. Readers count
+// themselves in the current epoch while copying the pointer; Store()
+// publishes the new value, starts a new epoch and waits for the readers of
+// the old one before dropping its reference. Whoever copied the old value
+// keeps it alive until done.
+//
+// Load() never blocks, it only retries when it races a Store(). Store()
+// calls are serialized and wait for at most one pointer copy per reader.
+template <typename T>
+class RcuPtr {
+ public:
+  explicit RcuPtr(std::shared_ptr<const T> value)
+      : current_(new std::shared_ptr<const T>(std::move(value))) {}
+
+  ~RcuPtr() { delete current_.load(); }
+
+  RcuPtr(const RcuPtr&) = delete;
+  RcuPtr& operator=(const RcuPtr&) = delete;
+
+  std::shared_ptr<const T> Load() const {
+    while (true) {
+      const auto epoch = epoch_.load();
+      auto& readers = readers_[epoch & 1];
+      readers.fetch_add(1);
+      if (epoch_.load() == epoch) {
+        std::shared_ptr<const T> value = *current_.load();
+        readers.fetch_sub(1);
+        return value;
+      }
+      readers.fetch_sub(1);
+    }
+  }
+
+  void Store(std::shared_ptr<const T> value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto* old =
+        current_.exchange(new std::shared_ptr<const T>(std::move(value)));
+    // Readers that can still see |old| counted themselves in this epoch,
+    // new ones count in the next.
+    const auto epoch = epoch_.fetch_add(1);
+    while (readers_[epoch & 1].load() != 0) {
+      std::this_thread::yield();
+    }
+    delete old;
+  }
+
+ private:
+  std::atomic<std::shared_ptr<const T>*> current_;
+  mutable std::atomic<uint32_t> epoch_{0};
+  mutable std::atomic<uint32_t> readers_[2] = {};
+  std::mutex mutex_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_RCU_PTR_H_
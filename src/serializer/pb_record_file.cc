@@ -0,0 +1,43 @@
+#include "serializer/pb_record_file.h"
+
+#include "serializer/pb_serializer.h"
+#include "serializer/pb_wire_format.h"
+
+namespace magic::pb {
+RecordFile::RecordFile(std::unique_ptr<MappedFile> file)
+    : file_(std::move(file)) {}
+
+RecordFile::~RecordFile() = default;
+
+std::unique_ptr<RecordFile> RecordFile::Open(const std::string& path) {
+  auto file = MappedFile::Open(path);
+  if (!file) {
+    return nullptr;
+  }
+  return std::unique_ptr<RecordFile>(new RecordFile(std::move(file)));
+}
+
+std::size_t RecordFile::Count() const {
+  std::call_once(index_once_, [this] { BuildIndex(); });
+  return records_.size();
+}
+
+std::string_view RecordFile::Record(std::size_t index) const {
+  std::call_once(index_once_, [this] { BuildIndex(); });
+  return records_[index];
+}
+
+void RecordFile::BuildIndex() const {
+  const auto data = file_->data();
+  WireReader reader(data);
+  std::string_view record;
+  while (!reader.done()) {
+    const char* begin = reader.position();
+    if (!reader.ReadLengthDelimited(&record)) {
+      PB_LOG(ERROR) << "Malformed record at offset: " << begin - data.data();
+      break;
+    }
+    records_.push_back(record);
+  }
+}
+}  // namespace magic::pb
@@ -0,0 +1,46 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_RECORD_FILE_H_
+#define CONVERT_SRC_SERIALIZER_PB_RECORD_FILE_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "serializer/pb_mapped_file.h"
+
+namespace magic::pb {
+// Read-only mapping of a file of varint length delimited records. Opening
+// only maps the file, record boundaries are indexed on first use by hopping
+// from length to length, record bytes are never touched.
+//
+// A truncated or malformed tail ends the index, the complete records before
+// it stay readable. Thread safe.
+class RecordFile {
+ public:
+  ~RecordFile();
+
+  RecordFile(const RecordFile&) = delete;
+  RecordFile& operator=(const RecordFile&) = delete;
+
+  static std::unique_ptr<RecordFile> Open(const std::string& path);
+
+  std::size_t Count() const;
+
+  // Bytes of record |index|, which must be below Count(). Valid as long as
+  // the file is open.
+  std::string_view Record(std::size_t index) const;
+
+ private:
+  explicit RecordFile(std::unique_ptr<MappedFile> file);
+
+  void BuildIndex() const;
+
+  std::unique_ptr<MappedFile> file_;
+  mutable std::once_flag index_once_;
+  mutable std::vector<std::string_view> records_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_RECORD_FILE_H_
@@ -0,0 +1,100 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_RECORD_READER_H_
+#define CONVERT_SRC_SERIALIZER_PB_RECORD_READER_H_
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "serializer/pb_record_file.h"
+#include "serializer/pb_serializer.h"
+
+namespace magic::pb {
+// Records of one type in a mapped file, each decoded through from_pb only
+// when it is read. Must not outlive the runtime it was created with, unless
+// that runtime has an owner.
+template <typename Object>
+class RecordReader {
+ public:
+  class Iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::pair<ErrorCode, Object>;
+    using difference_type = std::ptrdiff_t;
+    // Records are decoded when dereferenced and returned by value.
+    using reference = value_type;
+    using pointer = void;
+
+    Iterator() = default;
+    Iterator(const RecordReader* reader, std::size_t index)
+        : reader_(reader), index_(index) {}
+
+    reference operator*() const { return reader_->Decode(index_); }
+
+    Iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator previous = *this;
+      ++index_;
+      return previous;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return index_ == other.index_;
+    }
+
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    const RecordReader* reader_ = nullptr;
+    std::size_t index_ = 0;
+  };
+  static_assert(std::input_iterator<Iterator>);
+
+  RecordReader(std::unique_ptr<RecordFile> file,
+               const PBRuntime<Object>& runtime,
+               std::string_view pb_type,
+               const PBOptions& options)
+      : file_(std::move(file)),
+        runtime_(runtime),
+        pb_type_(pb_type),
+        options_(options) {}
+
+  static std::unique_ptr<RecordReader> Open(const std::string& path,
+                                            const PBRuntime<Object>& runtime,
+                                            std::string_view pb_type,
+                                            const PBOptions& options = {}) {
+    auto file = RecordFile::Open(path);
+    if (!file) {
+      return nullptr;
+    }
+    return std::make_unique<RecordReader>(std::move(file), runtime, pb_type,
+                                          options);
+  }
+
+  std::size_t Count() const { return file_->Count(); }
+
+  std::pair<ErrorCode, Object> Decode(std::size_t index) const {
+    return from_pb<Object>(
+        runtime_, PBInfo{.type = pb_type_, .data = file_->Record(index)},
+        options_);
+  }
+
+  Iterator begin() const { return Iterator(this, 0); }
+
+  Iterator end() const { return Iterator(this, Count()); }
+
+ private:
+  std::unique_ptr<RecordFile> file_;
+  PBRuntime<Object> runtime_;
+  std::string pb_type_;
+  PBOptions options_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_RECORD_READER_H_
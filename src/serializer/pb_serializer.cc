@@ -50,6 +50,24 @@ const FieldDescriptor* find_field(const Descriptor* descriptor,
   return field;
 }
 
+const FieldDescriptor* find_field(const Descriptor* descriptor,
+                                  const std::string& name) {
+  const auto* field = descriptor->FindFieldByName(name);
+  if (!field && descriptor->extension_range_count() > 0) {
+    field = descriptor->file()->pool()->FindExtensionByPrintableName(
+        descriptor, name);
+  }
+  if (!field) {
+    for (auto i = 0; i < descriptor->field_count(); ++i) {
+      if (descriptor->field(i)->json_name() == name) {
+        field = descriptor->field(i);
+        break;
+      }
+    }
+  }
+  return field;
+}
+
 ErrorCode MakeErrorCode(ErrorCode error_code,
                         const std::string& field_name,
                         const std::string& message_type) {
@@ -6,11 +6,27 @@
 #include <google/protobuf/message.h>
 #include <google/protobuf/util/json_util.h>
 
+#include <algorithm>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <ostream>
+#include <shared_mutex>
+#include <span>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "magic/error_code.h"
+#include "serializer/pb_arena.h"
+#include "serializer/pb_field_mask.h"
+#include "serializer/pb_message_pool.h"
+#include "serializer/pb_size_estimator.h"
+#include "serializer/pb_worker_pool.h"
 
 namespace magic::pb {
 enum class PBError;
@@ -18,7 +34,7 @@ enum class PBError;
 
 namespace std {
 template <>
-struct std::is_error_code_enum<magic::pb::PBError> : true_type {};
+struct is_error_code_enum<magic::pb::PBError> : true_type {};
 }  // namespace std
 
 namespace magic::pb {
@@ -62,10 +78,56 @@ using WarnningFields = std::set<std::string>;
 struct PBInfo {
   std::string_view type;
   std::string_view data;
+  // Keeps |data| alive, lets PBOptions::borrow_bytes values point into it.
+  std::shared_ptr<const void> owner;
+};
+
+// kWireFormat decodes from and encodes to wire format directly without
+// building a DynamicMessage; objects, bytes and errors are the same.
+enum class PBEngine {
+  kReflection,
+  kWireFormat,
+};
+
+// How decodes hand int64 and uint64 values to the platform. Platforms whose
+// numbers are doubles only hold integers up to 2^53 exactly.
+enum class PBInt64Format {
+  // Decimal strings.
+  kString,
+  // 64-bit numbers.
+  kNative,
+  // Numbers up to 2^53 in magnitude, strings above.
+  kHybrid,
 };
 
 struct PBOptions {
   bool use_camelcase = false;
+  PBEngine engine = PBEngine::kReflection;
+  PBInt64Format int64_format = PBInt64Format::kString;
+  // Encodes also take numeric strings for integer fields in 0x hex or with
+  // an exponent, "1e3". Plain decimals are always taken.
+  bool lenient_numbers = false;
+  // Reflection engine only: build the temporary message tree on the calling
+  // thread's recycled arena instead of the heap.
+  bool use_arena = false;
+  // Decode with the wire engine into containers that convert sub messages
+  // and repeated message elements on first access, see pb_lazy.h. Only
+  // honoured with a long-lived PBRuntime.
+  bool lazy = false;
+  // Decode with the wire engine into string and bytes values that point
+  // into PBInfo::data and hold PBInfo::owner instead of copying, for
+  // backends that support it. Without an owner values are copied.
+  bool borrow_bytes = false;
+  // Decode only the fields selected by the mask, see pb_field_mask.h. The
+  // reflection engine still parses and checks the whole payload, the wire
+  // engine skips everything else like unknown fields, so malformed bytes and
+  // missing required fields outside the mask go unnoticed there.
+  std::shared_ptr<const FieldMask> field_mask;
+  // Reflection engine only: repeated message fields with at least
+  // |parallel_threshold| elements are converted in chunks on |workers|,
+  // in both directions. 0 or no workers keeps every loop serial.
+  std::size_t parallel_threshold = 0;
+  WorkerPool* workers = nullptr;
 };
 
 struct Context {
@@ -81,6 +143,10 @@ const FieldDescriptor* find_field(const Descriptor* descriptor,
                                   const Reflection* ref,
                                   const std::string& name);
 
+// Same lookup without a message, extensions come from the descriptor's pool.
+const FieldDescriptor* find_field(const Descriptor* descriptor,
+                                  const std::string& name);
+
 bool IsMessageInitialized(Message* message);
 
 ErrorCode MakeErrorCode(ErrorCode error_code,
@@ -96,8 +162,7 @@ template <FieldDescriptor::CppType T, typename Object>
 std::pair<ErrorCode, Object> from_pb(const Context& pb_context);
 
 template <typename Object>
-using FromPbFunction =
-    std::function<std::pair<ErrorCode, Object>(const Context&)>;
+using FromPbFunction = std::pair<ErrorCode, Object> (*)(const Context&);
 
 template <typename Object>
 using FromPbFunctionMap =
@@ -112,7 +177,7 @@ template <FieldDescriptor::CppType T, typename Object>
 ErrorCode to_pb(Object obj, Context& pb_context);
 
 template <typename Object>
-using ToPbFunction = std::function<ErrorCode(Object, Context&)>;
+using ToPbFunction = ErrorCode (*)(Object, Context&);
 
 template <typename Object>
 using ToPbFunctionMap =
@@ -147,105 +212,779 @@ struct Serializer {
   Object to_platform(const T&);
 };
 
+// Dictionary keys for field names, made once when a plan is compiled and
+// shared by every decode. Backends whose keys are objects specialize it to
+// return a ready-made immutable key that DictWrapper::Add takes; by default
+// the name itself is added as a const char*.
+//
+// from_platform gives the name of a key being encoded, valid while |key| is
+// alive or, for backends that have to convert it, while |scratch| is.
+template <typename Object>
+struct KeySerializer {
+  using Key = const char*;
+  Key to_platform(std::string_view name) { return name.data(); }
+  std::string_view from_platform(Object key, std::string* scratch) {
+    *scratch = Serializer<Object, std::string>().from_platform(key);
+    return *scratch;
+  }
+};
+
+// Converts field values between protobuf and platform objects, shared by all
+// engines. Enum values are passed as their number. to_platform gets string
+// and bytes fields as a view that is only valid for the duration of the call;
+// from_platform returns a view that stays valid while |object| is alive, or
+// points it into |scratch| when the object has no bytes of its own.
+template <typename Object>
+struct FieldSerializer {
+  explicit FieldSerializer(const PBOptions& options);
+  Object to_platform(const FieldDescriptor* field, int32_t value);
+  Object to_platform(const FieldDescriptor* field, uint32_t value);
+  Object to_platform(const FieldDescriptor* field, int64_t value);
+  Object to_platform(const FieldDescriptor* field, uint64_t value);
+  Object to_platform(const FieldDescriptor* field, float value);
+  Object to_platform(const FieldDescriptor* field, double value);
+  Object to_platform(const FieldDescriptor* field, bool value);
+  Object to_platform(const FieldDescriptor* field, std::string_view value);
+
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          int32_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          uint32_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          int64_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          uint64_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          float* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          double* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          bool* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          const EnumValueDescriptor** value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Object object,
+                          std::string_view* value,
+                          std::string* scratch);
+};
+
+// Backends that can wrap bytes they do not own give FieldSerializer
+//   Object to_platform(const FieldDescriptor* field,
+//                      std::string_view value,
+//                      const std::shared_ptr<const void>& owner)
+// returning a string or bytes value over |value| that holds |owner|, see
+// PBOptions::borrow_bytes.
+
 template <typename Object>
 struct IngoreErrorWhenConvertToPbOptionalField : public std::false_type {};
 
-static const std::string& kKeyFieldName = *(new std::string("key"));
-static const std::string& kValueFieldName = *(new std::string("value"));
+// BEGIN PLAN
+enum FieldPlanFlag : uint32_t {
+  kFieldRepeated = 1 << 0,
+  kFieldMap = 1 << 1,
+  kFieldMessage = 1 << 2,
+  kFieldOptional = 1 << 3,
+  // Optional field without default value, skipped by from_pb when absent.
+  kFieldSkipIfAbsent = 1 << 4,
+  kFieldRequired = 1 << 5,
+  kFieldHasPresence = 1 << 6,
+  kFieldPacked = 1 << 7,
+  // Outside PBOptions::field_mask, not converted.
+  kFieldMasked = 1 << 8,
+};
+
+template <typename Object>
+struct MessagePlan;
+
+// Everything the convert loops need to know about one field, resolved once
+// per descriptor.
+template <typename Object>
+struct FieldPlan {
+  const FieldDescriptor* field = nullptr;
+  FieldDescriptor::Type type = FieldDescriptor::TYPE_INT32;
+  FromPbFunction<Object> from_pb = nullptr;
+  ToPbFunction<Object> to_pb = nullptr;
+  // Plan of the sub message or map entry, set for message fields.
+  const MessagePlan<Object>* message = nullptr;
+  uint32_t flags = 0;
+  std::string_view name;
+  std::string_view json_name;
+  // name or json_name, as selected by PBOptions::use_camelcase.
+  std::string_view key;
+  // |key| as added to decoded dictionaries.
+  typename KeySerializer<Object>::Key platform_key{};
+
+  bool Has(FieldPlanFlag flag) const { return flags & flag; }
+};
+
+// Open addressing table from the names a field is looked up by to its plan
+// entry, built once per plan.
+template <typename Object>
+class FieldNameIndex {
+ public:
+  // Names added first win over later duplicates.
+  void Build(const std::vector<std::pair<std::string_view,
+                                         const FieldPlan<Object>*>>& names) {
+    std::size_t capacity = 8;
+    while (capacity < names.size() * 2) {
+      capacity *= 2;
+    }
+    slots_.assign(capacity, {});
+    for (const auto& [name, entry] : names) {
+      auto& slot = Probe(name);
+      if (!slot.second) {
+        slot = {name, entry};
+      }
+    }
+  }
+
+  const FieldPlan<Object>* Find(std::string_view name) const {
+    return slots_.empty() ? nullptr : Probe(name).second;
+  }
+
+ private:
+  using Slot = std::pair<std::string_view, const FieldPlan<Object>*>;
+
+  // The slot holding |name|, or the empty one it belongs in.
+  const Slot& Probe(std::string_view name) const {
+    const auto mask = slots_.size() - 1;
+    auto i = std::hash<std::string_view>()(name) & mask;
+    while (slots_[i].second && slots_[i].first != name) {
+      i = (i + 1) & mask;
+    }
+    return slots_[i];
+  }
+
+  Slot& Probe(std::string_view name) {
+    return const_cast<Slot&>(std::as_const(*this).Probe(name));
+  }
+
+  std::vector<Slot> slots_;
+};
+
+template <typename Object>
+struct MessagePlan {
+  const Descriptor* descriptor = nullptr;
+  // Indexed by FieldDescriptor::index().
+  std::vector<FieldPlan<Object>> fields;
+  // Extensions known to the pool when the plan was compiled.
+  std::vector<FieldPlan<Object>> extensions;
+  // Field number to index into |fields|, -1 for unknown numbers.
+  std::vector<int32_t> numbers;
+  // Slots sorted by field number, the order fields are serialized in. A slot
+  // indexes |fields| followed by |extensions|.
+  std::vector<int32_t> order;
+  // Field names, extension names and JSON names, in that order of priority.
+  FieldNameIndex<Object> names;
+  // Some field outside the mask is required, so an empty message is
+  // malformed.
+  bool has_required = false;
+
+  // The default instance, converted on first use per PBInt64Format. See
+  // DefaultObject().
+  struct Default {
+    std::once_flag once;
+    std::pair<ErrorCode, Object> value;
+    // Keeps |value| alive for backends that allocate from the caller's
+    // storage.
+    std::shared_ptr<void> storage;
+  };
+  mutable Default defaults[3];
+
+  std::size_t slot_count() const { return fields.size() + extensions.size(); }
+
+  std::size_t SlotOf(const FieldPlan<Object>* entry) const {
+    return entry >= fields.data() && entry < fields.data() + fields.size()
+               ? entry - fields.data()
+               : fields.size() + (entry - extensions.data());
+  }
+
+  const FieldPlan<Object>& AtSlot(std::size_t slot) const {
+    return slot < fields.size() ? fields[slot]
+                                : extensions[slot - fields.size()];
+  }
+
+  const FieldPlan<Object>* FindByNumber(uint32_t number) const {
+    if (number < numbers.size()) {
+      auto index = numbers[number];
+      return index < 0 ? nullptr : &fields[index];
+    }
+    const auto* field = descriptor->FindFieldByNumber(number);
+    return field && IsScanned(fields[field->index()]) ? &fields[field->index()]
+                                                      : nullptr;
+  }
+
+  // Fields outside the mask are skipped unread, except oneof members which
+  // still clear the other members.
+  static bool IsScanned(const FieldPlan<Object>& entry) {
+    return !entry.Has(kFieldMasked) || entry.field->containing_oneof();
+  }
+
+  // Entry for a dictionary key being encoded, like find_field().
+  const FieldPlan<Object>* FindByName(std::string_view name) const {
+    return names.Find(name);
+  }
+
+  const FieldPlan<Object>* Find(const FieldDescriptor* field) const {
+    if (!field->is_extension()) {
+      return &fields[field->index()];
+    }
+    for (const auto& extension : extensions) {
+      if (extension.field == field) {
+        return &extension;
+      }
+    }
+    return nullptr;
+  }
+};
+
+// Compiles and caches MessagePlans per Descriptor and PBOptions. Plans are
+// immutable once published and shared by all threads. They point into the
+// descriptors they were compiled from, so a cache must not outlive the
+// pools it is used with.
+template <typename Object>
+class PlanCache {
+ public:
+  // FindMessageTypeByName on |pool| without building a std::string once
+  // |name| was found in it.
+  const Descriptor* FindType(const DescriptorPool* pool,
+                             std::string_view name) {
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      if (auto it = types_.find(name);
+          it != types_.end() && it->second.pool == pool) {
+        return it->second.descriptor;
+      }
+    }
+    const auto* descriptor = pool->FindMessageTypeByName(std::string(name));
+    if (descriptor) {
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      types_.insert_or_assign(std::string(name), FoundType{pool, descriptor});
+    }
+    return descriptor;
+  }
+
+  const MessagePlan<Object>* Get(const Descriptor* descriptor,
+                                 const PBOptions& options) {
+    const auto& mask = options.field_mask;
+    const Key key{descriptor, options.use_camelcase,
+                  Selection(mask ? &mask->root() : nullptr)};
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      if (auto it = plans_.find(key); it != plans_.end()) {
+        return it->second.get();
+      }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (key.mask &&
+        std::find(masks_.begin(), masks_.end(), mask) == masks_.end()) {
+      masks_.push_back(mask);
+    }
+    return Compile(key);
+  }
+
+ private:
+  static constexpr int kMaxDenseFieldNumber = 4096;
+
+  struct Key {
+    const Descriptor* descriptor = nullptr;
+    bool use_camelcase = false;
+    // Fields selected in |descriptor|, nullptr for all of them.
+    const FieldMask::Node* mask = nullptr;
+
+    bool operator==(const Key& other) const = default;
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      return std::hash<const Descriptor*>()(key.descriptor) ^
+             std::hash<const FieldMask::Node*>()(key.mask) ^
+             static_cast<std::size_t>(key.use_camelcase);
+    }
+  };
+
+  struct FoundType {
+    // Only compared with the pool asked for.
+    const DescriptorPool* pool = nullptr;
+    const Descriptor* descriptor = nullptr;
+  };
+
+  static const FieldMask::Node* Selection(const FieldMask::Node* node) {
+    return node && !node->all() ? node : nullptr;
+  }
+
+  // Requires |mutex_| held exclusively. The plan is published before its
+  // fields are compiled so recursive message types resolve to it.
+  const MessagePlan<Object>* Compile(const Key& key) {
+    auto& slot = plans_[key];
+    if (slot) {
+      return slot.get();
+    }
+    slot = std::make_unique<MessagePlan<Object>>();
+    auto* plan = slot.get();
+    plan->descriptor = key.descriptor;
+    plan->fields.reserve(key.descriptor->field_count());
+    for (int i = 0; i < key.descriptor->field_count(); ++i) {
+      const auto* field = key.descriptor->field(i);
+      plan->fields.emplace_back(CompileField(key, field));
+      if (field->number() <= kMaxDenseFieldNumber &&
+          plan->IsScanned(plan->fields.back())) {
+        if (plan->numbers.size() <= static_cast<size_t>(field->number())) {
+          plan->numbers.resize(field->number() + 1, -1);
+        }
+        plan->numbers[field->number()] = i;
+      }
+      if (plan->fields.back().Has(kFieldRequired) &&
+          !plan->fields.back().Has(kFieldMasked)) {
+        plan->has_required = true;
+      }
+    }
+    if (const auto* pool = key.descriptor->file()->pool()) {
+      std::vector<const FieldDescriptor*> extensions;
+      pool->FindAllExtensions(key.descriptor, &extensions);
+      for (const auto* extension : extensions) {
+        plan->extensions.emplace_back(CompileField(key, extension));
+      }
+    }
+    plan->order.resize(plan->slot_count());
+    std::iota(plan->order.begin(), plan->order.end(), 0);
+    std::sort(plan->order.begin(), plan->order.end(), [plan](auto a, auto b) {
+      return plan->AtSlot(a).field->number() < plan->AtSlot(b).field->number();
+    });
+    IndexNames(plan);
+    return plan;
+  }
+
+  static void IndexNames(MessagePlan<Object>* plan) {
+    std::vector<std::pair<std::string_view, const FieldPlan<Object>*>> names;
+    for (const auto& entry : plan->fields) {
+      names.emplace_back(entry.name, &entry);
+    }
+    const auto* pool = plan->descriptor->file()->pool();
+    for (const auto& entry : plan->extensions) {
+      names.emplace_back(entry.field->full_name(), &entry);
+      // Message set extensions are also named by their message type.
+      if (const auto* type = entry.field->message_type();
+          type && pool->FindExtensionByPrintableName(
+                      plan->descriptor, type->full_name()) == entry.field) {
+        names.emplace_back(type->full_name(), &entry);
+      }
+    }
+    for (const auto& entry : plan->fields) {
+      names.emplace_back(entry.json_name, &entry);
+    }
+    plan->names.Build(names);
+  }
+
+  FieldPlan<Object> CompileField(const Key& key,
+                                 const FieldDescriptor* field) {
+    static const auto& from_pb_map = GetFromPbFunctionMap<Object>();
+    static const auto& to_pb_map = GetToPbFunctionMap<Object>();
+    FieldPlan<Object> entry;
+    entry.field = field;
+    entry.type = field->type();
+    // Map entries keep their key, the value gets the element selection.
+    const FieldMask::Node* mask = nullptr;
+    if (key.mask && key.descriptor->map_key()) {
+      mask = field == key.descriptor->map_value() ? key.mask : nullptr;
+    } else if (key.mask) {
+      mask = key.mask->Find(field->is_extension() ? field->full_name()
+                                                  : field->name());
+      if (!mask) {
+        entry.flags |= kFieldMasked;
+      } else if (field->is_repeated()) {
+        mask = mask->Elements();
+      }
+    }
+    if (auto it = from_pb_map.find(field->cpp_type());
+        it != from_pb_map.end()) {
+      entry.from_pb = it->second;
+    }
+    if (auto it = to_pb_map.find(field->cpp_type()); it != to_pb_map.end()) {
+      entry.to_pb = it->second;
+    }
+    if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+      entry.flags |= kFieldMessage;
+      if (!entry.Has(kFieldMasked)) {
+        entry.message = Compile(
+            {field->message_type(), key.use_camelcase, Selection(mask)});
+      }
+    }
+    if (field->is_repeated()) {
+      entry.flags |= kFieldRepeated;
+    }
+    if (field->is_map()) {
+      entry.flags |= kFieldMap;
+    }
+    if (field->is_optional()) {
+      entry.flags |= kFieldOptional;
+      if (!field->has_default_value()) {
+        entry.flags |= kFieldSkipIfAbsent;
+      }
+    }
+    if (field->is_required()) {
+      entry.flags |= kFieldRequired;
+    }
+    if (field->has_presence()) {
+      entry.flags |= kFieldHasPresence;
+    }
+    if (field->is_packed()) {
+      entry.flags |= kFieldPacked;
+    }
+    entry.name = field->name();
+    entry.json_name = field->json_name();
+    entry.key = key.use_camelcase ? entry.json_name : entry.name;
+    entry.platform_key = KeySerializer<Object>().to_platform(entry.key);
+    return entry;
+  }
+
+  std::shared_mutex mutex_;
+  std::unordered_map<Key, std::unique_ptr<MessagePlan<Object>>, KeyHash>
+      plans_;
+  // Masks plans were compiled for, kept so their nodes stay unique keys.
+  std::vector<std::shared_ptr<const FieldMask>> masks_;
+  // Type last found per name.
+  std::map<std::string, FoundType, std::less<>> types_;
+};
+
+// The long-lived state a conversion runs against.
+template <typename Object>
+struct PBRuntime {
+  DescriptorPool* descriptor_pool = nullptr;
+  MessagePool* message_pool = nullptr;
+  PlanCache<Object>* plans = nullptr;
+  ArenaConfig arena;
+  // Owner of the pools and plans when they can be replaced at run time.
+  // Parsers, record readers and lazy containers hold it as long as they
+  // use them.
+  std::shared_ptr<const void> owner;
+  // Learns encoded sizes per type when set, see to_pb_into.
+  SizeEstimator* sizes = nullptr;
+};
+// END PLAN
 
 // BEGIN FROM_PB IMPL
-template <typename Key, typename Value>
-std::tuple<ErrorCode, Key, Value> from_pb(Message* message,
-                                          const PBOptions& options) {
-  const auto* descriptor = message->GetDescriptor();
+template <typename Object>
+std::pair<ErrorCode, Object> from_pb(const MessagePlan<Object>& plan,
+                                     Message* message,
+                                     const PBOptions& options);
+
+// Wire format decode engine, defined in serializer/pb_wire_decoder.h.
+template <typename Object>
+std::pair<ErrorCode, Object> from_wire(
+    const MessagePlan<Object>& plan,
+    std::string_view data,
+    const PBOptions& options,
+    const std::shared_ptr<const void>& owner = nullptr,
+    const std::shared_ptr<const void>& data_owner = nullptr);
+
+template <typename Object>
+std::tuple<ErrorCode, Object, Object> from_pb_map_entry(
+    const MessagePlan<Object>& plan,
+    Message* message,
+    const PBOptions& options) {
   const auto* ref = message->GetReflection();
-  const auto* key = descriptor->FindFieldByName(kKeyFieldName);
-  const auto* value = descriptor->FindFieldByName(kValueFieldName);
+  const auto& key = plan.fields[0];
+  const auto& value = plan.fields[1];
 
-  static const auto& function_map = GetFromPbFunctionMap<Key>();
-  auto it = function_map.find(key->cpp_type());
-  if (it == function_map.end()) {
+  if (!key.from_pb) {
     assert(false);
     PB_LOG(ERROR) << "pb_to_v8<true> key ConvertFunction not found: "
-                  << key->cpp_type();
+                  << key.field->cpp_type();
     return {PBError::kNoConvertFunction, {}, {}};
   }
-  Context context{
-      .message = message, .reflection = ref, .field = key, .options = options};
-  if (auto key_result = it->second(context); key_result.first) {
+  Context context{.message = message,
+                  .reflection = ref,
+                  .field = key.field,
+                  .options = options};
+  if (auto key_result = key.from_pb(context); key_result.first) {
     return {std::move(key_result.first), std::move(key_result.second), {}};
+  } else if (value.Has(kFieldMessage)) {
+    auto* item =
+        const_cast<Message*>(&ref->GetMessage(*message, value.field));
+    auto value_result =
+        ref->HasField(*message, value.field)
+            ? from_pb<Object>(*value.message, item, options)
+            : DefaultObject(*value.message, options, [&] {
+                return from_pb<Object>(*value.message, item, options);
+              });
+    return {std::move(value_result.first), std::move(key_result.second),
+            std::move(value_result.second)};
   } else {
-    static const auto& function_map = GetFromPbFunctionMap<Value>();
-    it = function_map.find(value->cpp_type());
-    if (it == function_map.end()) {
+    if (!value.from_pb) {
       assert(false);
       PB_LOG(ERROR) << "pb_to_v8<true> value ConvertFunction not found: "
-                    << value->cpp_type();
+                    << value.field->cpp_type();
       return {PBError::kNoConvertFunction, {}, {}};
     }
-    context.field = value;
-    auto value_result = it->second(context);
+    context.field = value.field;
+    auto value_result = value.from_pb(context);
     return {std::move(value_result.first), std::move(key_result.second),
             std::move(value_result.second)};
   }
 }
 
+// Encoders read platform dictionaries and arrays through the helpers below.
+// Backends that can enumerate in place give DictWrapper<Object, true> and
+// ArrayWrapper<Object, true>
+//   std::size_t Size() const
+//   template <typename Fn> bool ForEach(Fn&& fn) const
+// where ForEach calls fn(key, value), or fn(value), for each entry until it
+// returns false, and then returns false. Without them entries are copied out
+// through KeyAndValues() and Values() first.
+template <typename Object, typename Fn>
+bool ForEachEntry(Object dict, Fn&& fn) {
+  DictWrapper<Object, true> wrapper(dict);
+  if constexpr (requires { wrapper.ForEach(fn); }) {
+    return wrapper.ForEach(fn);
+  } else {
+    for (auto& [key, value] : wrapper.KeyAndValues()) {
+      if (!fn(key, value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+template <typename Object, typename Fn>
+bool ForEachElement(Object array, Fn&& fn) {
+  ArrayWrapper<Object, true> wrapper(array);
+  if constexpr (requires { wrapper.ForEach(fn); }) {
+    return wrapper.ForEach(fn);
+  } else {
+    for (auto& value : wrapper.Values()) {
+      if (!fn(value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+// Element count of |array| when the backend knows it up front, 0 otherwise.
 template <typename Object>
-std::pair<ErrorCode, Object> from_pb(Message* message,
+std::size_t SizeHint(Object array) {
+  ArrayWrapper<Object, true> wrapper(array);
+  if constexpr (requires { wrapper.Size(); }) {
+    return wrapper.Size();
+  } else {
+    return 0;
+  }
+}
+
+// Element count of |array|, copying the elements out if it must.
+template <typename Object>
+std::size_t ElementCount(Object array) {
+  ArrayWrapper<Object, true> wrapper(array);
+  if constexpr (requires { wrapper.Size(); }) {
+    return wrapper.Size();
+  } else {
+    return wrapper.Values().size();
+  }
+}
+
+// Backends that need per-thread setup around work done on pool threads,
+// such as an autorelease pool, give ArrayWrapper<Object, false> a
+//   static void RunOnWorker(const std::function<void()>& fn)
+// that calls |fn| inside it.
+template <typename Object>
+void RunOnWorker(const std::function<void()>& fn) {
+  if constexpr (requires { ArrayWrapper<Object, false>::RunOnWorker(fn); }) {
+    ArrayWrapper<Object, false>::RunOnWorker(fn);
+  } else {
+    fn();
+  }
+}
+
+using WorkerRunner = std::function<void(const std::function<void()>& fn)>;
+
+// Backends whose pool work depends on the thread that started it, such as
+// the arena new objects are allocated from, give ArrayWrapper<Object, false>
+// a
+//   static WorkerRunner BindWorker()
+// called on that thread, whose result then runs the work on pool threads
+// instead of RunOnWorker.
+template <typename Object>
+WorkerRunner BindWorker() {
+  if constexpr (requires { ArrayWrapper<Object, false>::BindWorker(); }) {
+    return ArrayWrapper<Object, false>::BindWorker();
+  } else {
+    return RunOnWorker<Object>;
+  }
+}
+
+// Backends that can only make objects in storage the caller set up give
+// DictWrapper<Object, false> a
+//   static bool CanCreate()
+// checked by the decode entry points, which fail with INVALID_ARG when it
+// is false rather than fall back to storage nobody frees.
+template <typename Object>
+bool CanCreate() {
+  if constexpr (requires { DictWrapper<Object, false>::CanCreate(); }) {
+    return DictWrapper<Object, false>::CanCreate();
+  } else {
+    return true;
+  }
+}
+
+// Backends whose objects live in storage the caller provides give
+// DictWrapper<Object, false> a
+//   static std::shared_ptr<void> Retain(const std::function<void()>& fn)
+// that runs |fn| with objects made in storage of their own, kept alive by
+// the returned handle. DefaultObject() builds the cached instances in it.
+template <typename Object>
+std::shared_ptr<void> Retain(const std::function<void()>& fn) {
+  if constexpr (requires { DictWrapper<Object, false>::Retain(fn); }) {
+    return DictWrapper<Object, false>::Retain(fn);
+  } else {
+    fn();
+    return nullptr;
+  }
+}
+
+// Backends whose converted messages copy for less than converting them
+// again give DictWrapper<Object, false> a
+//   static Object Copy(Object dict)
+// that returns a deep copy the caller may change, or an empty Object if it
+// cannot. Default instances are then converted once per plan and handed out
+// as copies; without it |build| runs every time.
+template <typename Object, typename Build>
+std::pair<ErrorCode, Object> DefaultObject(const MessagePlan<Object>& plan,
+                                           const PBOptions& options,
+                                           Build&& build) {
+  if constexpr (requires(Object dict) {
+                  DictWrapper<Object, false>::Copy(dict);
+                }) {
+    auto& cached = plan.defaults[static_cast<int>(options.int64_format)];
+    std::call_once(cached.once, [&] {
+      cached.storage = Retain<Object>([&] { cached.value = build(); });
+    });
+    if (cached.value.first) {
+      return cached.value;
+    }
+    if (auto copy = DictWrapper<Object, false>::Copy(cached.value.second)) {
+      return {CommonError::SUCCESS, std::move(copy)};
+    }
+  }
+  return build();
+}
+
+inline bool IsParallel(const PBOptions& options, std::size_t size) {
+  return options.workers && options.parallel_threshold &&
+         size >= options.parallel_threshold;
+}
+
+// Calls |fn|(begin, end) on |workers| for consecutive chunks of [0, |size|),
+// a few per participant so stealing evens out uneven elements.
+template <typename Object>
+void ParallelChunks(
+    WorkerPool* workers,
+    std::size_t size,
+    const std::function<void(std::size_t begin, std::size_t end)>& fn) {
+  const std::size_t chunks = std::min(size, workers->size() * 4);
+  const auto run = BindWorker<Object>();
+  workers->ParallelFor(chunks, [&](std::size_t chunk, std::size_t) {
+    run([&] { fn(size * chunk / chunks, size * (chunk + 1) / chunks); });
+  });
+}
+
+// Converts the elements of a repeated message field in parallel and adds
+// them in order. Like the serial loop, the first failed element ends the
+// array.
+template <typename Object>
+Object from_pb_repeated_parallel(const MessagePlan<Object>& plan,
+                                 Message* message,
+                                 const FieldDescriptor* field,
+                                 std::size_t size,
+                                 const PBOptions& options) {
+  const auto* ref = message->GetReflection();
+  std::vector<std::pair<ErrorCode, Object>> items(
+      size, {CommonError::UNKNOWN, {}});
+  ParallelChunks<Object>(
+      options.workers, size, [&](std::size_t begin, std::size_t end) {
+        for (auto index = begin; index < end; ++index) {
+          auto* item = const_cast<Message*>(&(ref->GetRepeatedMessage(
+              *message, field, static_cast<int>(index))));
+          items[index] = from_pb<Object>(plan, item, options);
+        }
+      });
+  ArrayWrapper<Object, false> array_wrapper;
+  for (auto& item : items) {
+    if (item.first) {
+      break;
+    }
+    array_wrapper.Add(item.second);
+  }
+  return array_wrapper;
+}
+
+template <typename Object>
+std::pair<ErrorCode, Object> from_pb(const MessagePlan<Object>& plan,
+                                     Message* message,
                                      const PBOptions& options) {
-  const auto* descriptor = message->GetDescriptor();
   const auto* ref = message->GetReflection();
-  auto field_count = descriptor->field_count();
   DictWrapper<Object, false> object_wrapper;
   std::pair<ErrorCode, Object> result;
 
-  for (decltype(field_count) i = 0; i < field_count; ++i) {
-    const auto* field = descriptor->field(i);
-    if (field->is_optional() && !ref->HasField(*message, field) &&
-        !field->has_default_value()) {
+  for (const auto& entry : plan.fields) {
+    const auto* field = entry.field;
+    if (entry.Has(kFieldMasked) ||
+        (entry.Has(kFieldSkipIfAbsent) && !ref->HasField(*message, field))) {
       continue;
     }
-    static const auto& func_map = GetFromPbFunctionMap<Object>();
-    auto it = func_map.find(field->cpp_type());
-    if (it == func_map.end()) {
+    if (!entry.Has(kFieldMessage) && !entry.from_pb) {
       assert(false);
       PB_LOG(ERROR) << "pb_to_v8<false> field ConvertFunction not found: "
                     << field->cpp_type() << ", " << field->name() << ", "
-                    << descriptor->full_name();
+                    << plan.descriptor->full_name();
       return {PBError::kNoConvertFunction, {}};
     }
 
-    const auto& field_name =
-        options.use_camelcase ? field->json_name() : field->name();
-
     Context context{.message = message,
                     .reflection = ref,
                     .field = field,
                     .options = options};
-    if (field->is_repeated()) {
+    if (entry.Has(kFieldRepeated) && entry.Has(kFieldMessage) &&
+        !entry.Has(kFieldMap) &&
+        IsParallel(options, ref->FieldSize(*message, field))) {
+      result = {CommonError::SUCCESS,
+                from_pb_repeated_parallel<Object>(
+                    *entry.message, message, field,
+                    ref->FieldSize(*message, field), options)};
+    } else if (entry.Has(kFieldRepeated)) {
       auto size = ref->FieldSize(*message, field);
-      Object object = field->is_map()
+      const bool is_map = entry.Has(kFieldMap);
+      Object object = is_map
                           ? static_cast<Object>(DictWrapper<Object, false>())
                           : static_cast<Object>(ArrayWrapper<Object, false>());
-      const bool is_map = field->is_map();
       for (decltype(size) index = 0; index < size; ++index) {
         Object key{}, value{};
-        if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+        if (entry.Has(kFieldMessage)) {
           auto* item = const_cast<Message*>(
               &(ref->GetRepeatedMessage(*message, field, index)));
-          if (field->is_map()) {
-            auto sub_result = from_pb<Object, Object>(item, options);
+          if (is_map) {
+            auto sub_result =
+                from_pb_map_entry<Object>(*entry.message, item, options);
             result.first = std::move(std::get<0>(sub_result));
             key = std::move(std::get<1>(sub_result));
             value = std::move(std::get<2>(sub_result));
           } else {
-            auto sub_result = from_pb<Object>(item, options);
+            auto sub_result = from_pb<Object>(*entry.message, item, options);
             result.first = std::move(sub_result.first);
             value = std::move(sub_result.second);
           }
         } else {
           context.index = index;
-          result = it->second(context);
+          result = entry.from_pb(context);
           value = std::move(result.second);
         }
         if (result.first) {
@@ -258,190 +997,358 @@ std::pair<ErrorCode, Object> from_pb(Message* message,
       }
       result.first = CommonError::SUCCESS;
       result.second = object;
+    } else if (entry.Has(kFieldMessage)) {
+      // An absent field yields the default instance, no message is built.
+      auto* item = const_cast<Message*>(&ref->GetMessage(*message, field));
+      result = ref->HasField(*message, field)
+                   ? from_pb<Object>(*entry.message, item, options)
+                   : DefaultObject(*entry.message, options, [&] {
+                       return from_pb<Object>(*entry.message, item, options);
+                     });
     } else {
-      result = it->second(context);
+      result = entry.from_pb(context);
     }
     if (result.first) {
       break;
     } else {
-      object_wrapper.Add(field_name.c_str(), result.second);
+      object_wrapper.Add(entry.platform_key, result.second);
     }
   }
   return {std::move(result.first), object_wrapper};
 }
 
 template <typename Object>
-std::pair<ErrorCode, Object> from_pb(DescriptorPool* descriptor_pool,
+std::pair<ErrorCode, Object> from_pb(Message* message,
+                                     const PBOptions& options) {
+  if (!CanCreate<Object>()) {
+    PB_LOG(ERROR) << "from_pb no storage for new objects";
+    return {CommonError::INVALID_ARG, {}};
+  }
+  PlanCache<Object> plans;
+  return from_pb<Object>(*plans.Get(message->GetDescriptor(), options),
+                         message, options);
+}
+
+template <typename Object>
+std::pair<ErrorCode, Object> from_pb(const PBRuntime<Object>& runtime,
                                      const PBInfo& pb_info,
                                      const PBOptions& options = {}) {
+  if (!CanCreate<Object>()) {
+    PB_LOG(ERROR) << "from_pb no storage for new objects";
+    return {CommonError::INVALID_ARG, {}};
+  }
   const Descriptor* descriptor =
-      descriptor_pool->FindMessageTypeByName(std::string(pb_info.type));
+      runtime.plans->FindType(runtime.descriptor_pool, pb_info.type);
   if (!descriptor) {
     PB_LOG(ERROR) << "FindMessageTypeByName error, type: " << pb_info.type;
     return {PBError::KPBMessageNotFound, {}};
   }
 
-  DynamicMessageFactory factory;
-  std::unique_ptr<Message> message(
-      factory.GetPrototype(descriptor)->New());  // new message
+  if (options.engine == PBEngine::kWireFormat || options.lazy ||
+      options.borrow_bytes) {
+    return from_wire<Object>(*runtime.plans->Get(descriptor, options),
+                             pb_info.data, options, runtime.owner,
+                             pb_info.owner);
+  }
+
+  ThreadArena::Lease arena;
+  if (options.use_arena) {
+    arena = ThreadArena::Acquire(runtime.arena);
+  }
+  auto message = runtime.message_pool->Acquire(descriptor, arena.get());
+  if (!message) {
+    PB_LOG(ERROR) << "Acquire message error, type: " << pb_info.type;
+    return {PBError::kPBMessageInfoError, {}};
+  }
   if (!message->ParseFromArray(pb_info.data.data(), pb_info.data.size())) {
     PB_LOG(ERROR) << "ParseFromArray error, pb.size(): " << pb_info.data.size();
     return {PBError::kPBParseError, {}};
   }
 
-  return from_pb<Object>(message.get(), options);
+  return from_pb<Object>(*runtime.plans->Get(descriptor, options),
+                         message.get(), options);
 }
 
 template <typename Object>
-std::pair<ErrorCode, Object> from_default_pb(DescriptorPool* descriptor_pool,
+std::pair<ErrorCode, Object> from_pb(DescriptorPool* descriptor_pool,
+                                     const PBInfo& pb_info,
+                                     const PBOptions& options = {}) {
+  MessagePool message_pool;
+  PlanCache<Object> plans;
+  // Lazy containers would outlive |plans|.
+  PBOptions eager_options = options;
+  eager_options.lazy = false;
+  return from_pb<Object>(PBRuntime<Object>{.descriptor_pool = descriptor_pool,
+                                           .message_pool = &message_pool,
+                                           .plans = &plans},
+                         pb_info, eager_options);
+}
+
+template <typename Object>
+std::pair<ErrorCode, Object> from_default_pb(const PBRuntime<Object>& runtime,
                                              std::string_view pb_type,
                                              const PBOptions& options = {}) {
+  if (!CanCreate<Object>()) {
+    PB_LOG(ERROR) << "from_default_pb no storage for new objects";
+    return {CommonError::INVALID_ARG, {}};
+  }
   const Descriptor* descriptor =
-      descriptor_pool->FindMessageTypeByName(std::string(pb_type));
+      runtime.plans->FindType(runtime.descriptor_pool, pb_type);
   if (!descriptor) {
     PB_LOG(ERROR) << "FindMessageTypeByName error, type: " << pb_type;
     return {PBError::KPBMessageNotFound, {}};
   }
 
-  DynamicMessageFactory factory;
-  std::unique_ptr<Message> message(
-      factory.GetPrototype(descriptor)->New());  // new message
+  const auto& plan = *runtime.plans->Get(descriptor, options);
+  return DefaultObject(plan, options, [&]() -> std::pair<ErrorCode, Object> {
+    // The prototype is the default instance, it is only read here.
+    const Message* prototype = runtime.message_pool->GetPrototype(descriptor);
+    if (!prototype) {
+      PB_LOG(ERROR) << "GetPrototype error, type: " << pb_type;
+      return {PBError::kPBMessageInfoError, {}};
+    }
+    return from_pb<Object>(plan, const_cast<Message*>(prototype), options);
+  });
+}
 
-  return from_pb<Object>(message.get(), options);
+template <typename Object>
+std::pair<ErrorCode, Object> from_default_pb(DescriptorPool* descriptor_pool,
+                                             std::string_view pb_type,
+                                             const PBOptions& options = {}) {
+  MessagePool message_pool;
+  PlanCache<Object> plans;
+  return from_default_pb<Object>(
+      PBRuntime<Object>{.descriptor_pool = descriptor_pool,
+                        .message_pool = &message_pool,
+                        .plans = &plans},
+      pb_type, options);
 }
 // END FROM_PB IMPL
 
 // BEGIN TO_PB IMPL
-template <typename Key, typename Value>
-ErrorCode to_pb(Key k,
-                Value v,
+template <typename Object>
+ErrorCode to_pb(const MessagePlan<Object>& plan,
+                Object object,
                 Message* message,
-                WarnningFields* warnning_fields) {
-  const auto* descriptor = message->GetDescriptor();
+                WarnningFields* warnning_fields,
+                const PBOptions& options = {});
+
+// Wire format encode engine, defined in serializer/pb_wire_encoder.h.
+template <typename Object, typename Buffer>
+ErrorCode to_wire(const MessagePlan<Object>& plan,
+                  Object object,
+                  Buffer* buffer,
+                  WarnningFields* warnning_fields,
+                  const PBOptions& options);
+
+// Writes to |out| only if the message fits, |size| gets its size either way.
+template <typename Object>
+ErrorCode to_wire(const MessagePlan<Object>& plan,
+                  Object object,
+                  std::span<uint8_t> out,
+                  std::size_t* size,
+                  WarnningFields* warnning_fields,
+                  const PBOptions& options);
+
+template <typename Object>
+ErrorCode to_pb_map_entry(const MessagePlan<Object>& plan,
+                          Object k,
+                          Object v,
+                          Message* message,
+                          WarnningFields* warnning_fields,
+                          const PBOptions& options) {
   const auto* ref = message->GetReflection();
-  const auto* key = descriptor->FindFieldByName(kKeyFieldName);
-  const auto* value = descriptor->FindFieldByName(kValueFieldName);
+  const auto& key = plan.fields[0];
+  const auto& value = plan.fields[1];
 
-  const auto& func_map = GetToPbFunctionMap<Key>();
-  auto it = func_map.find(key->cpp_type());
-  if (it == func_map.end()) {
+  if (!key.to_pb) {
     assert(false);
     PB_LOG(ERROR) << "v8_to_pb_map_item key ConvertFunction not found: "
-                  << key->cpp_type();
+                  << key.field->cpp_type();
     return PBError::kNoConvertFunction;
   }
 
   Context context{.message = message,
                   .reflection = ref,
-                  .field = key,
+                  .field = key.field,
+                  .options = options,
                   .warnning_fields = warnning_fields};
-  if (auto error_code = it->second(k, context)) {
+  if (auto error_code = key.to_pb(k, context)) {
     return error_code;
   }
 
-  it = func_map.find(value->cpp_type());
-  if (it == func_map.end()) {
+  if (value.Has(kFieldMessage)) {
+    return to_pb<Object>(*value.message, v,
+                         ref->MutableMessage(message, value.field),
+                         warnning_fields, options);
+  }
+  if (!value.to_pb) {
     assert(false);
     PB_LOG(ERROR) << "v8_to_pb_map_item value ConvertFunction not found: "
-                  << value->cpp_type();
+                  << value.field->cpp_type();
     return PBError::kNoConvertFunction;
   }
 
-  context.field = value;
-  return it->second(v, context);
+  context.field = value.field;
+  return value.to_pb(v, context);
 }
 
+// Adds |items| to a repeated message field and converts them in parallel.
+// Returns the error of the first failed element, whose warnings and those
+// of the elements before it are kept, as the serial loop would.
 template <typename Object>
-ErrorCode to_pb(Object object,
-                Message* message,
-                WarnningFields* warnning_fields) {
-  const auto* descriptor = message->GetDescriptor();
+ErrorCode to_pb_repeated_parallel(const MessagePlan<Object>& plan,
+                                  const std::vector<Object>& items,
+                                  Message* message,
+                                  const FieldDescriptor* field,
+                                  WarnningFields* warnning_fields,
+                                  const PBOptions& options) {
   const auto* ref = message->GetReflection();
-  auto values = DictWrapper<Object, true>(object).KeyAndValues();
-  if (values.empty()) {
-    return message->IsInitialized() ? CommonError::SUCCESS
-                                    : CommonError::MISSING_ARG;
+  std::vector<Message*> messages(items.size());
+  for (auto& item : messages) {
+    item = ref->AddMessage(message, field);
   }
-
-  const FieldDescriptor* field = nullptr;
-  for (auto& [k, v] : values) {
-    if (TypeCheck<Object>(k).IsNullOrUndefined() ||
-        TypeCheck<Object>(v).IsNullOrUndefined()) {
-      continue;
-    }
-    field = find_field(descriptor, ref,
-                       Serializer<Object, std::string>().from_platform(k));
-    if (!field) {
-      continue;
+  std::vector<ErrorCode> errors(items.size(), CommonError::SUCCESS);
+  std::vector<WarnningFields> warnings(warnning_fields ? items.size() : 0);
+  ParallelChunks<Object>(
+      options.workers, items.size(), [&](std::size_t begin, std::size_t end) {
+        for (auto index = begin; index < end; ++index) {
+          errors[index] = to_pb<Object>(
+              plan, items[index], messages[index],
+              warnning_fields ? &warnings[index] : nullptr, options);
+        }
+      });
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    if (warnning_fields) {
+      warnning_fields->merge(warnings[i]);
     }
-    const auto& func_map = GetToPbFunctionMap<Object>();
-    auto it = func_map.find(field->cpp_type());
-    if (it == func_map.end()) {
-      assert(false);
-      PB_LOG(ERROR) << "v8_to_pb field ConvertFunction not found: "
-                    << field->cpp_type() << ", " << field->name() << ", "
-                    << descriptor->full_name();
-      return MakeErrorCode(PBError::kNoConvertFunction, field->name(),
-                           descriptor->full_name());
+    if (errors[i]) {
+      return errors[i];
     }
+  }
+  return CommonError::SUCCESS;
+}
 
-    Context context{.message = message,
-                    .reflection = ref,
-                    .field = field,
-                    .warnning_fields = warnning_fields};
+// Converts the value |v| of the key that resolved to |entry|.
+template <typename Object>
+ErrorCode to_pb_field(const MessagePlan<Object>& plan,
+                      const FieldPlan<Object>* entry,
+                      Object v,
+                      Message* message,
+                      WarnningFields* warnning_fields,
+                      const PBOptions& options) {
+  const auto* descriptor = plan.descriptor;
+  const auto* ref = message->GetReflection();
+  const auto* field = entry->field;
+  if (!entry->Has(kFieldMessage) && !entry->to_pb) {
+    assert(false);
+    PB_LOG(ERROR) << "v8_to_pb field ConvertFunction not found: "
+                  << field->cpp_type() << ", " << field->name() << ", "
+                  << descriptor->full_name();
+    return MakeErrorCode(PBError::kNoConvertFunction, field->name(),
+                         descriptor->full_name());
+  }
 
-    if (field->is_repeated()) {
-      TypeCheck<Object> type_check(v);
-      if ((field->is_map() && (type_check.IsArray() || !type_check.IsDict())) ||
-          (!field->is_map() && !type_check.IsArray())) {
-        PB_LOG(ERROR) << "v8_to_pb MESSAGE error: "
-                      << "name: " << field->name();
-        return MakeErrorCode(CommonError::ARG_TYPE_ERROR, field->name(),
-                             descriptor->full_name());
-      }
-      if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
-        if (field->is_map()) {
-          auto property_list = DictWrapper<Object, true>(v).KeyAndValues();
-          for (const auto& [property_key, property_value] : property_list) {
-            Message* item = ref->AddMessage(message, field);
-            if (auto error_code = to_pb<Object, Object>(
-                    property_key, property_value, item, warnning_fields)) {
-              return MakeErrorCode(error_code, field->name(),
-                                   descriptor->full_name());
-            }
-          }
-        } else {
-          auto item_list = ArrayWrapper<Object, true>(v).Values();
-          for (const auto& array_tiem : item_list) {
-            Message* item = ref->AddMessage(message, field);
-            if (auto error_code =
-                    to_pb<Object>(array_tiem, item, warnning_fields)) {
-              return MakeErrorCode(error_code, field->name(),
-                                   descriptor->full_name());
-            }
-          }
-        }
+  Context context{.message = message,
+                  .reflection = ref,
+                  .field = field,
+                  .options = options,
+                  .warnning_fields = warnning_fields};
+
+  if (entry->Has(kFieldRepeated)) {
+    TypeCheck<Object> type_check(v);
+    const bool is_map = entry->Has(kFieldMap);
+    if ((is_map && (type_check.IsArray() || !type_check.IsDict())) ||
+        (!is_map && !type_check.IsArray())) {
+      PB_LOG(ERROR) << "v8_to_pb MESSAGE error: "
+                    << "name: " << field->name();
+      return MakeErrorCode(CommonError::ARG_TYPE_ERROR, field->name(),
+                           descriptor->full_name());
+    }
+    ErrorCode error_code = CommonError::SUCCESS;
+    if (entry->Has(kFieldMessage)) {
+      if (is_map) {
+        ForEachEntry<Object>(v, [&](Object property_key,
+                                    Object property_value) {
+          Message* item = ref->AddMessage(message, field);
+          error_code = to_pb_map_entry<Object>(*entry->message, property_key,
+                                               property_value, item,
+                                               warnning_fields, options);
+          return !error_code;
+        });
+      } else if (options.workers &&
+                 IsParallel(options, ElementCount<Object>(v))) {
+        error_code = to_pb_repeated_parallel<Object>(
+            *entry->message, ArrayWrapper<Object, true>(v).Values(), message,
+            field, warnning_fields, options);
       } else {
-        auto item_list = ArrayWrapper<Object, true>(v).Values();
-        for (size_t i = 0; i < item_list.size(); ++i) {
-          context.index = static_cast<int>(i);
-          if (auto error_code = it->second(item_list[i], context)) {
-            return MakeErrorCode(error_code, field->name(),
-                                 descriptor->full_name());
-          }
-        }
+        ForEachElement<Object>(v, [&](Object array_tiem) {
+          Message* item = ref->AddMessage(message, field);
+          error_code = to_pb<Object>(*entry->message, array_tiem, item,
+                                     warnning_fields, options);
+          return !error_code;
+        });
       }
     } else {
-      auto error_code = it->second(v, context);
-      if (error_code &&
-          (!IngoreErrorWhenConvertToPbOptionalField<Object>::value ||
-           !field->is_optional())) {
-        return MakeErrorCode(error_code, field->name(),
-                             descriptor->full_name());
-      } else if (error_code) {
-        AddWarnningField(warnning_fields, descriptor, field);
-      }
+      int index = 0;
+      ForEachElement<Object>(v, [&](Object array_tiem) {
+        context.index = index++;
+        error_code = entry->to_pb(array_tiem, context);
+        return !error_code;
+      });
+    }
+    return error_code ? MakeErrorCode(error_code, field->name(),
+                                      descriptor->full_name())
+                      : error_code;
+  }
+
+  auto error_code =
+      entry->Has(kFieldMessage)
+          ? to_pb<Object>(*entry->message, v,
+                          ref->MutableMessage(message, field),
+                          warnning_fields, options)
+          : entry->to_pb(v, context);
+  if (error_code &&
+      (!IngoreErrorWhenConvertToPbOptionalField<Object>::value ||
+       !entry->Has(kFieldOptional))) {
+    return MakeErrorCode(error_code, field->name(), descriptor->full_name());
+  } else if (error_code) {
+    AddWarnningField(warnning_fields, descriptor, field);
+  }
+  return CommonError::SUCCESS;
+}
+
+template <typename Object>
+ErrorCode to_pb(const MessagePlan<Object>& plan,
+                Object object,
+                Message* message,
+                WarnningFields* warnning_fields,
+                const PBOptions& options) {
+  const auto* descriptor = plan.descriptor;
+  bool empty = true;
+  ErrorCode error_code = CommonError::SUCCESS;
+  std::string key;
+  ForEachEntry<Object>(object, [&](Object k, Object v) {
+    empty = false;
+    if (TypeCheck<Object>(k).IsNullOrUndefined() ||
+        TypeCheck<Object>(v).IsNullOrUndefined()) {
+      return true;
+    }
+    const auto* entry =
+        plan.FindByName(KeySerializer<Object>().from_platform(k, &key));
+    if (!entry) {
+      return true;
     }
+    error_code = to_pb_field<Object>(plan, entry, v, message, warnning_fields,
+                                     options);
+    return !error_code;
+  });
+  if (error_code) {
+    return error_code;
+  }
+  if (empty) {
+    return message->IsInitialized() ? CommonError::SUCCESS
+                                    : CommonError::MISSING_ARG;
   }
   return message->IsInitialized()
              ? CommonError::SUCCESS
@@ -450,32 +1357,163 @@ ErrorCode to_pb(Object object,
                              descriptor->full_name());
 }
 
-template <typename Object, typename Buffer = std::vector<uint8_t>>
-std::pair<ErrorCode, Buffer> to_pb(Object object,
-                                   DescriptorPool* descriptor_pool,
-                                   std::string_view pb_type,
-                                   WarnningFields* warnning_fields = nullptr) {
+template <typename Object>
+ErrorCode to_pb(Object object,
+                Message* message,
+                WarnningFields* warnning_fields) {
+  PlanCache<Object> plans;
+  return to_pb<Object>(*plans.Get(message->GetDescriptor(), {}), object,
+                       message, warnning_fields);
+}
+
+// Buffer that remembers the size |buffer| was resized to.
+template <typename Buffer>
+struct SizedBuffer {
+  using value_type = typename Buffer::value_type;
+
+  void resize(std::size_t new_size) {
+    size = new_size;
+    buffer->resize(new_size);
+  }
+
+  auto data() const { return buffer->data(); }
+
+  Buffer* buffer = nullptr;
+  std::size_t size = 0;
+};
+
+// Encodes into |pb_buffer|, which is resized to the encoded size on success
+// and left untouched on failure.
+template <typename Object, typename Buffer>
+ErrorCode to_pb_into(Object object,
+                     const PBRuntime<Object>& runtime,
+                     std::string_view pb_type,
+                     Buffer* pb_buffer,
+                     WarnningFields* warnning_fields = nullptr,
+                     const PBOptions& options = {}) {
   const Descriptor* descriptor =
-      descriptor_pool->FindMessageTypeByName(std::string(pb_type));
+      runtime.plans->FindType(runtime.descriptor_pool, pb_type);
   if (!descriptor) {
     PB_LOG(ERROR) << "FindMessageTypeByName error, type: " << pb_type;
-    return {PBError::KPBMessageNotFound, Buffer{}};
+    return PBError::KPBMessageNotFound;
   }
 
-  DynamicMessageFactory factory;
-  std::unique_ptr<Message> message(
-      factory.GetPrototype(descriptor)->New());  // new message
+  if (options.engine == PBEngine::kWireFormat) {
+    SizedBuffer<Buffer> sized{.buffer = pb_buffer};
+    auto error_code = to_wire<Object>(*runtime.plans->Get(descriptor, {}),
+                                      object, &sized, warnning_fields,
+                                      options);
+    if (!error_code && runtime.sizes) {
+      runtime.sizes->Record(descriptor, sized.size);
+    }
+    return error_code;
+  }
 
-  auto error_code = to_pb<Object>(object, message.get(), warnning_fields);
-  Buffer pb_buffer;
+  ThreadArena::Lease arena;
+  if (options.use_arena) {
+    arena = ThreadArena::Acquire(runtime.arena);
+  }
+  auto message = runtime.message_pool->Acquire(descriptor, arena.get());
+  if (!message) {
+    PB_LOG(ERROR) << "Acquire message error, type: " << pb_type;
+    return PBError::kPBMessageInfoError;
+  }
+
+  auto error_code = to_pb<Object>(*runtime.plans->Get(descriptor, {}), object,
+                                  message.get(), warnning_fields, options);
   if (!error_code) {
-    pb_buffer.resize(message->ByteSizeLong());
+    const auto size = message->ByteSizeLong();
+    pb_buffer->resize(size);
     auto* memory = reinterpret_cast<uint8_t*>(
-        const_cast<typename Buffer::value_type*>(pb_buffer.data()));
+        const_cast<typename Buffer::value_type*>(pb_buffer->data()));
     message->SerializeWithCachedSizesToArray(memory);
+    if (runtime.sizes) {
+      runtime.sizes->Record(descriptor, size);
+    }
+  }
+  return error_code;
+}
+
+// Encodes into the caller's |out| without allocating a buffer. Returns the
+// encoded size; the bytes are in |out| only if they fit, otherwise nothing
+// is written and the caller retries with at least that many bytes. Size
+// |out| with runtime.sizes->Estimate() to get it right the first time.
+template <typename Object>
+std::pair<ErrorCode, std::size_t> to_pb_into(
+    Object object,
+    const PBRuntime<Object>& runtime,
+    std::string_view pb_type,
+    std::span<uint8_t> out,
+    WarnningFields* warnning_fields = nullptr,
+    const PBOptions& options = {}) {
+  const Descriptor* descriptor =
+      runtime.plans->FindType(runtime.descriptor_pool, pb_type);
+  if (!descriptor) {
+    PB_LOG(ERROR) << "FindMessageTypeByName error, type: " << pb_type;
+    return {PBError::KPBMessageNotFound, 0};
   }
+
+  std::size_t size = 0;
+  if (options.engine == PBEngine::kWireFormat) {
+    auto error_code = to_wire<Object>(*runtime.plans->Get(descriptor, {}),
+                                      object, out, &size, warnning_fields,
+                                      options);
+    if (error_code) {
+      return {std::move(error_code), 0};
+    }
+  } else {
+    ThreadArena::Lease arena;
+    if (options.use_arena) {
+      arena = ThreadArena::Acquire(runtime.arena);
+    }
+    auto message = runtime.message_pool->Acquire(descriptor, arena.get());
+    if (!message) {
+      PB_LOG(ERROR) << "Acquire message error, type: " << pb_type;
+      return {PBError::kPBMessageInfoError, 0};
+    }
+    if (auto error_code =
+            to_pb<Object>(*runtime.plans->Get(descriptor, {}), object,
+                          message.get(), warnning_fields, options)) {
+      return {std::move(error_code), 0};
+    }
+    size = message->ByteSizeLong();
+    if (size <= out.size()) {
+      message->SerializeWithCachedSizesToArray(out.data());
+    }
+  }
+  if (runtime.sizes) {
+    runtime.sizes->Record(descriptor, size);
+  }
+  return {CommonError::SUCCESS, size};
+}
+
+template <typename Object, typename Buffer = std::vector<uint8_t>>
+std::pair<ErrorCode, Buffer> to_pb(Object object,
+                                   const PBRuntime<Object>& runtime,
+                                   std::string_view pb_type,
+                                   WarnningFields* warnning_fields = nullptr,
+                                   const PBOptions& options = {}) {
+  Buffer pb_buffer;
+  auto error_code = to_pb_into<Object>(object, runtime, pb_type, &pb_buffer,
+                                       warnning_fields, options);
   return {std::move(error_code), std::move(pb_buffer)};
 }
+
+template <typename Object, typename Buffer = std::vector<uint8_t>>
+std::pair<ErrorCode, Buffer> to_pb(Object object,
+                                   DescriptorPool* descriptor_pool,
+                                   std::string_view pb_type,
+                                   WarnningFields* warnning_fields = nullptr,
+                                   const PBOptions& options = {}) {
+  MessagePool message_pool;
+  PlanCache<Object> plans;
+  return to_pb<Object, Buffer>(
+      object,
+      PBRuntime<Object>{.descriptor_pool = descriptor_pool,
+                        .message_pool = &message_pool,
+                        .plans = &plans},
+      pb_type, warnning_fields, options);
+}
 // END TO_PB IMPL
 }  // namespace magic::pb
 
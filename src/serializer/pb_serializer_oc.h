@@ -1,8 +1,11 @@
 #ifndef CONVERT_SRC_SERIALIZER_PB_SERIALIZER_OC_H_
 #define CONVERT_SRC_SERIALIZER_PB_SERIALIZER_OC_H_
 
+#include "magic/serializer.h"
 #include "serializer/oc_serializer.h"
 #include "serializer/pb_serializer.h"
+#include "serializer/pb_wire_decoder.h"
+#include "serializer/pb_wire_encoder.h"
 
 namespace magic::pb {
 using PlatformObject = NSObject*;
@@ -10,6 +13,13 @@ using PlatformObject = NSObject*;
 template <>
 const FromPbFunctionMap<PlatformObject>& GetFromPbFunctionMap();
 
+// NSArray/NSDictionary subclasses backing PBOptions::lazy.
+PlatformObject NewLazyArray(
+    std::shared_ptr<LazyRepeated<PlatformObject>> repeated);
+
+PlatformObject NewLazyDictionary(
+    std::shared_ptr<LazyMessage<PlatformObject>> message);
+
 template <bool reader>
 struct ArrayWrapper<PlatformObject, reader> {
   using Array = std::conditional_t<reader, NSArray, NSMutableArray>;
@@ -24,6 +34,17 @@ struct ArrayWrapper<PlatformObject, reader> {
 
   operator PlatformObject() const noexcept { return array_; }
 
+  static PlatformObject Lazy(
+      std::shared_ptr<LazyRepeated<PlatformObject>> repeated) {
+    return NewLazyArray(std::move(repeated));
+  }
+
+  static void RunOnWorker(const std::function<void()>& fn) {
+    @autoreleasepool {
+      fn();
+    }
+  }
+
   void Add(PlatformObject value) { [array_ addObject:value]; }
 
   std::vector<PlatformObject> Values() const {
@@ -34,6 +55,18 @@ struct ArrayWrapper<PlatformObject, reader> {
     return res;
   }
 
+  std::size_t Size() const { return array_.count; }
+
+  template <typename Fn>
+  bool ForEach(Fn&& fn) const {
+    for (NSObject* v in array_) {
+      if (!fn(v)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
  private:
   Array* array_;
 };
@@ -52,11 +85,28 @@ struct DictWrapper<PlatformObject, reader> {
 
   operator PlatformObject() const noexcept { return dict_; }
 
+  static PlatformObject Lazy(
+      std::shared_ptr<LazyMessage<PlatformObject>> message) {
+    return NewLazyDictionary(std::move(message));
+  }
+
+  // Converted messages only hold property list types, so the cached
+  // defaults are copied with fresh mutable containers and shared leaves.
+  static PlatformObject Copy(PlatformObject dict) {
+    return CFBridgingRelease(CFPropertyListCreateDeepCopy(
+        kCFAllocatorDefault, (__bridge CFPropertyListRef)dict,
+        kCFPropertyListMutableContainers));
+  }
+
   void Add(PlatformObject key, PlatformObject value) {
     assert([key isKindOfClass:[NSString class]]);
     [dict_ setValue:value forKey:(NSString*)(key)];
   }
 
+  void Add(NSString* key, PlatformObject value) {
+    [dict_ setValue:value forKey:key];
+  }
+
   void Add(const char* key, PlatformObject value) {
     [dict_ setValue:value forKey:detail::to_oc(key)];
   }
@@ -69,10 +119,42 @@ struct DictWrapper<PlatformObject, reader> {
     return res;
   }
 
+  std::size_t Size() const { return dict_.count; }
+
+  // Keys and values come together, without a lookup per key.
+  template <typename Fn>
+  bool ForEach(Fn&& fn) const {
+    auto* callback = &fn;
+    __block bool completed = true;
+    [dict_ enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL* stop) {
+      if (!(*callback)(key, value)) {
+        completed = false;
+        *stop = YES;
+      }
+    }];
+    return completed;
+  }
+
  private:
   Dict* dict_;
 };
 
+// Field name keys are made once per plan, dictionaries copy them by retain.
+template <>
+struct KeySerializer<PlatformObject> {
+  using Key = NSString*;
+  Key to_platform(std::string_view name) {
+    return [[NSString alloc] initWithBytes:name.data()
+                                    length:name.size()
+                                  encoding:NSUTF8StringEncoding];
+  }
+  std::string_view from_platform(PlatformObject key, std::string* scratch) {
+    std::string_view name;
+    detail::from_oc(key, name);
+    return name;
+  }
+};
+
 template <>
 struct TypeCheck<PlatformObject> {
   TypeCheck(PlatformObject obj) : obj_(obj) {}
@@ -91,6 +173,61 @@ struct TypeCheck<PlatformObject> {
   PlatformObject obj_;
 };
 
+template <>
+struct FieldSerializer<PlatformObject> {
+  explicit FieldSerializer(const PBOptions& options)
+      : int64_format_(options.int64_format),
+        number_forms_(options.lenient_numbers
+                          ? detail::kNumberHex | detail::kNumberExponent
+                          : detail::kNumberDecimal) {}
+  PlatformObject to_platform(const FieldDescriptor* field, int32_t value);
+  PlatformObject to_platform(const FieldDescriptor* field, uint32_t value);
+  PlatformObject to_platform(const FieldDescriptor* field, int64_t value);
+  PlatformObject to_platform(const FieldDescriptor* field, uint64_t value);
+  PlatformObject to_platform(const FieldDescriptor* field, float value);
+  PlatformObject to_platform(const FieldDescriptor* field, double value);
+  PlatformObject to_platform(const FieldDescriptor* field, bool value);
+  PlatformObject to_platform(const FieldDescriptor* field,
+                             std::string_view value);
+  // NSString or NSData over |value| that keeps |owner| until released.
+  PlatformObject to_platform(const FieldDescriptor* field,
+                             std::string_view value,
+                             const std::shared_ptr<const void>& owner);
+
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          int32_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          uint32_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          int64_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          uint64_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          float* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          double* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          bool* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          const EnumValueDescriptor** value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          PlatformObject object,
+                          std::string_view* value,
+                          std::string* scratch);
+
+ private:
+  PBInt64Format int64_format_;
+  unsigned number_forms_;
+};
+
 template <typename T>
 struct Serializer<PlatformObject, T> {
   T from_platform(PlatformObject object) {
@@ -105,25 +242,48 @@ struct Serializer<PlatformObject, T> {
 }  // namespace magic::pb
 
 namespace magic {
+using pb::ArenaConfig;
 using pb::DescriptorPool;
+using pb::MessagePool;
+using pb::PBEngine;
 using pb::PBInfo;
 using pb::PBOptions;
 using pb::PlatformObject;
 using pb::WarnningFields;
+using pb::WorkerPool;
+using PBRuntime = pb::PBRuntime<PlatformObject>;
+using PlanCache = pb::PlanCache<PlatformObject>;
 
+// The overloads taking a DescriptorPool compile the types they reach on
+// every call, pass a PBRuntime to keep plans across calls.
 std::pair<ErrorCode, PlatformObject> from_pb(DescriptorPool* descriptor_pool,
                                              const PBInfo& pb_info,
                                              const PBOptions& options = {});
 
+std::pair<ErrorCode, PlatformObject> from_pb(const PBRuntime& runtime,
+                                             const PBInfo& pb_info,
+                                             const PBOptions& options = {});
+
 std::pair<ErrorCode, PlatformObject> from_default_pb(
     DescriptorPool* descriptor_pool,
     std::string_view pb_type,
     const PBOptions& options = {});
 
+std::pair<ErrorCode, PlatformObject> from_default_pb(
+    const PBRuntime& runtime,
+    std::string_view pb_type,
+    const PBOptions& options = {});
+
 std::pair<ErrorCode, NSData*> to_pb(PlatformObject object,
                                     DescriptorPool* descriptor_pool,
                                     std::string_view pb_type,
                                     WarnningFields* warnning_fields = nullptr);
+
+std::pair<ErrorCode, NSData*> to_pb(PlatformObject object,
+                                    const PBRuntime& runtime,
+                                    std::string_view pb_type,
+                                    WarnningFields* warnning_fields = nullptr,
+                                    const PBOptions& options = {});
 }  // namespace magic
 
 #endif  // CONVERT_SRC_SERIALIZER_PB_SERIALIZER_OC_H_
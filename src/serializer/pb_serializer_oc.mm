@@ -1,10 +1,109 @@
 #include "serializer/pb_serializer_oc.h"
 
+#include <charconv>
 #include <fstream>
 
 #include "magic/serializer.h"
 
+using magic::pb::LazyMessage;
+using magic::pb::LazyRepeated;
+using magic::pb::PlatformObject;
+
+@interface PBLazyArray : NSArray
+- (instancetype)initWithRepeated:
+    (std::shared_ptr<LazyRepeated<PlatformObject>>)repeated;
+@end
+
+@implementation PBLazyArray {
+  std::shared_ptr<LazyRepeated<PlatformObject>> _repeated;
+}
+
+- (instancetype)initWithRepeated:
+    (std::shared_ptr<LazyRepeated<PlatformObject>>)repeated {
+  self = [super init];
+  _repeated = std::move(repeated);
+  return self;
+}
+
+- (NSUInteger)count {
+  return _repeated->size();
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+  if (index >= _repeated->size()) {
+    [NSException raise:NSRangeException format:@"index %lu", index];
+  }
+  id item = _repeated->At(index);
+  if (!item) {
+    // The bytes were checked by the decode, only conversion failed.
+    [NSException raise:NSInternalInconsistencyException
+                format:@"lazy element %lu failed to convert", index];
+  }
+  return item;
+}
+
+- (id)copyWithZone:(NSZone*)zone {
+  return self;
+}
+@end
+
+@interface PBLazyDictionary : NSDictionary
+- (instancetype)initWithMessage:
+    (std::shared_ptr<LazyMessage<PlatformObject>>)message;
+@end
+
+@implementation PBLazyDictionary {
+  std::shared_ptr<LazyMessage<PlatformObject>> _message;
+}
+
+- (instancetype)initWithMessage:
+    (std::shared_ptr<LazyMessage<PlatformObject>>)message {
+  self = [super init];
+  _message = std::move(message);
+  return self;
+}
+
+// The bytes were checked by the decode, a message that still fails to
+// convert raises rather than reads as an empty one.
+- (NSDictionary*)resolved {
+  PlatformObject value = _message->Get();
+  if (![value isKindOfClass:[NSDictionary class]]) {
+    [NSException
+         raise:NSInternalInconsistencyException
+        format:@"lazy message %s failed to convert",
+               _message->descriptor()->full_name().c_str()];
+  }
+  return (NSDictionary*)value;
+}
+
+- (NSUInteger)count {
+  return [self resolved].count;
+}
+
+- (id)objectForKey:(id)key {
+  return [[self resolved] objectForKey:key];
+}
+
+- (NSEnumerator*)keyEnumerator {
+  return [[self resolved] keyEnumerator];
+}
+
+- (id)copyWithZone:(NSZone*)zone {
+  return self;
+}
+@end
+
 namespace magic::pb {
+PlatformObject NewLazyArray(
+    std::shared_ptr<LazyRepeated<PlatformObject>> repeated) {
+  return [[PBLazyArray alloc] initWithRepeated:std::move(repeated)];
+}
+
+PlatformObject NewLazyDictionary(
+    std::shared_ptr<LazyMessage<PlatformObject>> message) {
+  return [[PBLazyDictionary alloc] initWithMessage:std::move(message)];
+}
+
 // BEGIN FROM_PB IMPL
 #define MACRO_FROM_PB_IMPL(type, name, dname)                             \
   template <>                                                             \
@@ -26,7 +125,7 @@ namespace magic::pb {
                                *pb_context.message, pb_context.field)     \
                          : pb_context.field->default_value_##dname();     \
     }                                                                     \
-    PlatformObject obj = to_oc(value);                                    \
+    PlatformObject obj = to_oc(value, pb_context.options);                \
     return {obj ? CommonError::SUCCESS : CommonError::FAILED, obj};       \
   }
 
@@ -36,15 +135,90 @@ namespace magic::pb {
         from_pb<FieldDescriptor::CPPTYPE_##type, PlatformObject> \
   }
 
+#define MACRO_FIELD_SERIALIZER_IMPL(type)                      \
+  PlatformObject FieldSerializer<PlatformObject>::to_platform( \
+      const FieldDescriptor* field, type value) {              \
+    return detail::to_oc(value);                               \
+  }
+
+MACRO_FIELD_SERIALIZER_IMPL(int32_t)
+MACRO_FIELD_SERIALIZER_IMPL(uint32_t)
+MACRO_FIELD_SERIALIZER_IMPL(float)
+MACRO_FIELD_SERIALIZER_IMPL(double)
+MACRO_FIELD_SERIALIZER_IMPL(bool)
+
+template <typename T>
+PlatformObject int64_to_oc(T value, PBInt64Format format) {
+  constexpr uint64_t kMaxExactDouble = uint64_t{1} << 53;
+  uint64_t magnitude = value;
+  if constexpr (std::is_signed_v<T>) {
+    magnitude = value < 0 ? 0 - magnitude : magnitude;
+  }
+  if (format == PBInt64Format::kNative ||
+      (format == PBInt64Format::kHybrid && magnitude <= kMaxExactDouble)) {
+    return detail::to_oc(value);
+  }
+  char buffer[24];
+  auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+  return [[NSString alloc] initWithBytes:buffer
+                                  length:end - buffer
+                                encoding:NSASCIIStringEncoding];
+}
+
+PlatformObject FieldSerializer<PlatformObject>::to_platform(
+    const FieldDescriptor* field,
+    int64_t value) {
+  return int64_to_oc(value, int64_format_);
+}
+
+PlatformObject FieldSerializer<PlatformObject>::to_platform(
+    const FieldDescriptor* field,
+    uint64_t value) {
+  return int64_to_oc(value, int64_format_);
+}
+
+PlatformObject FieldSerializer<PlatformObject>::to_platform(
+    const FieldDescriptor* field,
+    std::string_view value) {
+  if (field->type() == FieldDescriptor::TYPE_BYTES) {
+    return detail::to_oc(std::span<const uint8_t>(
+        reinterpret_cast<const uint8_t*>(value.data()), value.size()));
+  }
+  return detail::to_oc(value);
+}
+
+PlatformObject FieldSerializer<PlatformObject>::to_platform(
+    const FieldDescriptor* field,
+    std::string_view value,
+    const std::shared_ptr<const void>& owner) {
+  if (value.empty()) {
+    return to_platform(field, value);
+  }
+  void* bytes = const_cast<char*>(value.data());
+  std::shared_ptr<const void> keep = owner;
+  if (field->type() == FieldDescriptor::TYPE_BYTES) {
+    return [[NSData alloc] initWithBytesNoCopy:bytes
+                                        length:value.size()
+                                   deallocator:^(void*, NSUInteger) {
+                                     (void)keep;
+                                   }];
+  }
+  return [[NSString alloc] initWithBytesNoCopy:bytes
+                                        length:value.size()
+                                      encoding:NSUTF8StringEncoding
+                                   deallocator:^(void*, NSUInteger) {
+                                     (void)keep;
+                                   }];
+}
+
 template <typename T>
-PlatformObject to_oc(const std::pair<const FieldDescriptor*, T>& value) {
+PlatformObject to_oc(const std::pair<const FieldDescriptor*, T>& value,
+                     const PBOptions& options) {
+  FieldSerializer<PlatformObject> serializer(options);
   if constexpr (std::is_same_v<T, const EnumValueDescriptor*>) {
-    return detail::to_oc(value.second->number());
-  } else if constexpr (std::is_same_v<T, int64_t> ||
-                       std::is_same_v<T, uint64_t>) {
-    return detail::to_oc(std::to_string(value.second));
+    return serializer.to_platform(value.first, value.second->number());
   } else {
-    return detail::to_oc(value.second);
+    return serializer.to_platform(value.first, value.second);
   }
 }
 
@@ -74,13 +248,8 @@ from_pb<FieldDescriptor::CPPTYPE_STRING, PlatformObject>(
             : pb_context.field->default_value_string();
   }
 
-  PlatformObject obj = nil;
-  if (pb_context.field->type() == FieldDescriptor::TYPE_BYTES) {
-    obj = detail::to_oc(std::span<const uint8_t>(
-        reinterpret_cast<const uint8_t*>(view.data()), view.size()));
-  } else {
-    obj = detail::to_oc(view.data());
-  }
+  PlatformObject obj = FieldSerializer<PlatformObject>(pb_context.options)
+                           .to_platform(pb_context.field, view);
   return {obj ? CommonError::SUCCESS : CommonError::FAILED, obj};
 }
 
@@ -88,29 +257,12 @@ template <>
 std::pair<ErrorCode, PlatformObject>
 from_pb<FieldDescriptor::CPPTYPE_MESSAGE, PlatformObject>(
     const Context& pb_context) {
-  const Message* message =
-      pb_context.reflection->HasField(*pb_context.message, pb_context.field)
-          ? &(pb_context.reflection->GetMessage(*pb_context.message,
-                                                pb_context.field))
-          : nullptr;
-
-  if (message) {
-    return from_pb<PlatformObject>(const_cast<Message*>(message),
-                                   pb_context.options);
-  } else {
-    DynamicMessageFactory factory;
-    std::unique_ptr<Message> msg_ptr(
-        factory.GetPrototype(pb_context.field->message_type())
-            ->New());  // new message
-    if (msg_ptr) {
-      return from_pb<PlatformObject>(msg_ptr.get(), pb_context.options);
-    } else {
-      PB_LOG(ERROR) << "pb_to_v8_impl<FieldDescriptor::CPPTYPE_MESSAGE> "
-                       "message not exist and create Message failed: "
-                    << pb_context.field->message_type();
-      return {PBError::kPBNoExistAndNoDefaultValue, {}};
-    }
-  }
+  // An absent field yields the default instance owned by the factory that
+  // created the parent, so no message is built for it.
+  const Message& message = pb_context.reflection->GetMessage(
+      *pb_context.message, pb_context.field);
+  return from_pb<PlatformObject>(const_cast<Message*>(&message),
+                                 pb_context.options);
 }
 
 template <>
@@ -135,17 +287,17 @@ const FromPbFunctionMap<PlatformObject>& GetFromPbFunctionMap() {
   template <>                                                              \
   ErrorCode to_pb<FieldDescriptor::CPPTYPE_##type, PlatformObject>(        \
       PlatformObject object, Context & pb_context) {                       \
-    std::pair<const FieldDescriptor*,                                      \
-              decltype(std::declval<Reflection>().Get##type_name(          \
-                  std::declval<Message>(), nullptr))>                      \
-        value{};                                                           \
-    value.first = pb_context.field;                                        \
-    if (auto error_code = from_oc(object, value); !error_code) {           \
+    decltype(std::declval<Reflection>().Get##type_name(                    \
+        std::declval<Message>(), nullptr)) value{};                        \
+    if (auto error_code =                                                  \
+            FieldSerializer<PlatformObject>(pb_context.options)            \
+                .from_platform(pb_context.field, object, &value);          \
+        !error_code) {                                                     \
       auto func = pb_context.field->is_repeated()                          \
                       ? &Reflection::Add##type_name                        \
                       : &Reflection::Set##type_name;                       \
       (pb_context.reflection->*func)(pb_context.message, pb_context.field, \
-                                     std::move(value.second));             \
+                                     std::move(value));                    \
       return CommonError::SUCCESS;                                         \
     } else {                                                               \
       PB_LOG(ERROR) << "binary_to_pb_impl error, name: "                   \
@@ -162,7 +314,8 @@ const FromPbFunctionMap<PlatformObject>& GetFromPbFunctionMap() {
 
 template <typename T>
 ErrorCode from_oc(PlatformObject object,
-                  std::pair<const FieldDescriptor*, T>& value) {
+                  std::pair<const FieldDescriptor*, T>& value,
+                  unsigned number_forms) {
   using Type = std::decay_t<T>;
   if constexpr (std::is_same_v<T, const EnumValueDescriptor*>) {
     const EnumDescriptor* enum_desc = value.first->enum_type();
@@ -179,9 +332,9 @@ ErrorCode from_oc(PlatformObject object,
     return value.second ? CommonError::SUCCESS : CommonError::ARG_TYPE_ERROR;
   } else if constexpr (std::is_arithmetic_v<Type>) {
     if ([object isKindOfClass:[NSString class]]) {
-      std::string str;
+      std::string_view str;
       detail::from_oc(object, str);
-      if (auto v = detail::string_to_number<Type>(str)) {
+      if (auto v = detail::string_to_number<Type>(str, number_forms)) {
         value.second = *v;
         return CommonError::SUCCESS;
       } else {
@@ -195,6 +348,49 @@ ErrorCode from_oc(PlatformObject object,
   }
 }
 
+#define MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(type)                   \
+  ErrorCode FieldSerializer<PlatformObject>::from_platform(               \
+      const FieldDescriptor* field, PlatformObject object, type* value) { \
+    std::pair<const FieldDescriptor*, type> result{field, {}};            \
+    auto error_code = from_oc(object, result, number_forms_);             \
+    if (!error_code) {                                                    \
+      *value = result.second;                                             \
+    }                                                                     \
+    return error_code;                                                    \
+  }
+
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(int32_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(uint32_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(int64_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(uint64_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(float)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(double)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(bool)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(const EnumValueDescriptor*)
+
+ErrorCode FieldSerializer<PlatformObject>::from_platform(
+    const FieldDescriptor* field,
+    PlatformObject object,
+    std::string_view* value,
+    std::string* scratch) {
+  if ([object isKindOfClass:[NSString class]]) {
+    return detail::from_oc(object, *value);
+  } else if ([object isKindOfClass:[NSNumber class]]) {
+    detail::from_oc([(NSNumber*)(object) stringValue], *scratch);
+    *value = *scratch;
+    return CommonError::SUCCESS;
+  } else {
+    std::span<const uint8_t> data;
+    if (auto error_code = detail::from_oc(object, data); !error_code) {
+      *value = std::string_view(reinterpret_cast<const char*>(data.data()),
+                                data.size());
+      return CommonError::SUCCESS;
+    } else {
+      return CommonError::ARG_TYPE_ERROR;
+    }
+  }
+}
+
 MACRO_TO_PB_IMPL(INT32, Int32)
 MACRO_TO_PB_IMPL(UINT32, UInt32)
 MACRO_TO_PB_IMPL(INT64, Int64)
@@ -210,29 +406,18 @@ ErrorCode to_pb<FieldDescriptor::CPPTYPE_STRING, PlatformObject>(
     Context& pb_context) {
   auto func = pb_context.field->is_repeated() ? &Reflection::AddString
                                               : &Reflection::SetString;
-  std::string str;
-  if ([object isKindOfClass:[NSString class]]) {
-    detail::from_oc(object, str);
-    (pb_context.reflection->*func)(pb_context.message, pb_context.field,
-                                   std::move(str));
-    return CommonError::SUCCESS;
-  } else if ([object isKindOfClass:[NSNumber class]]) {
-    detail::from_oc([(NSNumber*)(object) stringValue], str);
-    (pb_context.reflection->*func)(pb_context.message, pb_context.field,
-                                   std::move(str));
-    return CommonError::SUCCESS;
-  } else {
-    std::span<const uint8_t> data;
-    if (auto error_code = detail::from_oc(object, data); !error_code) {
-      (pb_context.reflection->*func)(pb_context.message, pb_context.field,
-                                     std::string(data.begin(), data.end()));
-      return CommonError::SUCCESS;
-    } else {
-      PB_LOG(ERROR) << "v8_to_pb_impl string error"
-                    << ", name: " << pb_context.field->name();
-      return CommonError::ARG_TYPE_ERROR;
-    }
+  std::string_view value;
+  std::string scratch;
+  if (auto error_code = FieldSerializer<PlatformObject>(pb_context.options)
+                            .from_platform(pb_context.field, object, &value,
+                                           &scratch)) {
+    PB_LOG(ERROR) << "v8_to_pb_impl string error"
+                  << ", name: " << pb_context.field->name();
+    return error_code;
   }
+  (pb_context.reflection->*func)(pb_context.message, pb_context.field,
+                                 std::string(value));
+  return CommonError::SUCCESS;
 }
 
 template <>
@@ -276,6 +461,12 @@ std::pair<ErrorCode, PlatformObject> from_pb(DescriptorPool* descriptor_pool,
   return pb::from_pb<PlatformObject>(descriptor_pool, pb_info, options);
 }
 
+std::pair<ErrorCode, PlatformObject> from_pb(const PBRuntime& runtime,
+                                             const PBInfo& pb_info,
+                                             const PBOptions& options) {
+  return pb::from_pb<PlatformObject>(runtime, pb_info, options);
+}
+
 std::pair<ErrorCode, PlatformObject> from_default_pb(
     DescriptorPool* descriptor_pool,
     std::string_view pb_type,
@@ -283,12 +474,26 @@ std::pair<ErrorCode, PlatformObject> from_default_pb(
   return pb::from_default_pb<PlatformObject>(descriptor_pool, pb_type, options);
 }
 
+std::pair<ErrorCode, PlatformObject> from_default_pb(
+    const PBRuntime& runtime,
+    std::string_view pb_type,
+    const PBOptions& options) {
+  return pb::from_default_pb<PlatformObject>(runtime, pb_type, options);
+}
+
 struct NSDataWrapper {
   using value_type = void;
 
   NSDataWrapper() = default;
   ~NSDataWrapper() { data_ = nil; }
-  void resize(std::size_t size) { data_ = [NSMutableData dataWithLength:size]; }
+  // The encoder fills every byte, so skip the zeroing of dataWithLength:.
+  void resize(std::size_t size) {
+    void* bytes = size ? malloc(size) : nullptr;
+    data_ = bytes ? [NSData dataWithBytesNoCopy:bytes
+                                         length:size
+                                   freeWhenDone:YES]
+                  : [NSData data];
+  }
 
   const void* data() const noexcept { return [data_ bytes]; }
 
@@ -303,4 +508,14 @@ std::pair<ErrorCode, NSData*> to_pb(PlatformObject object,
                                                       pb_type, warnning_fields);
   return {res.first, res.second.data_};
 }
+
+std::pair<ErrorCode, NSData*> to_pb(PlatformObject object,
+                                    const PBRuntime& runtime,
+                                    std::string_view pb_type,
+                                    WarnningFields* warnning_fields,
+                                    const PBOptions& options) {
+  auto res = pb::to_pb<PlatformObject, NSDataWrapper>(
+      object, runtime, pb_type, warnning_fields, options);
+  return {res.first, res.second.data_};
+}
 }  // namespace magic
@@ -0,0 +1,409 @@
+#include "serializer/pb_serializer_value.h"
+
+#include <charconv>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "magic/serializer.h"
+
+namespace magic::pb {
+namespace {
+template <typename T>
+Value* int64_to_value(T value, PBInt64Format format) {
+  constexpr uint64_t kMaxExactDouble = uint64_t{1} << 53;
+  uint64_t magnitude = value;
+  if constexpr (std::is_signed_v<T>) {
+    magnitude = value < 0 ? 0 - magnitude : magnitude;
+  }
+  if (format == PBInt64Format::kNative ||
+      (format == PBInt64Format::kHybrid && magnitude <= kMaxExactDouble)) {
+    return Serializer<Value*, T>().to_platform(value);
+  }
+  char buffer[24];
+  auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+  return Value::NewString(ValueArena::Current(),
+                          std::string_view(buffer, end - buffer));
+}
+
+// |number| as a T, false if T cannot hold it: integers out of range, doubles
+// that are not integral for integer types, and finite doubles past the
+// float range. Any non-zero number is true.
+template <typename T, typename N>
+bool narrow_number(N number, T* value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    *value = number != 0;
+  } else if constexpr (std::is_integral_v<T> && std::is_integral_v<N>) {
+    if (!std::in_range<T>(number)) {
+      return false;
+    }
+    *value = static_cast<T>(number);
+  } else if constexpr (std::is_integral_v<T>) {
+    // The bounds are powers of two, exact as doubles; NaN fails every test.
+    if (!(number >= static_cast<double>(std::numeric_limits<T>::min()) &&
+          number < static_cast<double>(std::numeric_limits<T>::max()) + 1.0 &&
+          std::trunc(number) == number)) {
+      return false;
+    }
+    *value = static_cast<T>(number);
+  } else {
+    *value = static_cast<T>(number);
+    if (std::isinf(*value) && !std::isinf(number)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+ErrorCode value_to_number(const Value* object,
+                          unsigned number_forms,
+                          T* value) {
+  bool ok = false;
+  switch (object->kind()) {
+    case Value::Kind::kBool:
+      *value = static_cast<T>(object->bool_value());
+      return CommonError::SUCCESS;
+    case Value::Kind::kInt:
+      ok = narrow_number(object->int_value(), value);
+      break;
+    case Value::Kind::kUint:
+      ok = narrow_number(object->uint_value(), value);
+      break;
+    case Value::Kind::kDouble:
+      ok = narrow_number(object->double_value(), value);
+      break;
+    case Value::Kind::kString:
+      if (auto number = detail::string_to_number<T>(object->string_value(),
+                                                    number_forms)) {
+        *value = *number;
+        return CommonError::SUCCESS;
+      }
+      return CommonError::ARG_TYPE_ERROR;
+    default:
+      break;
+  }
+  return ok ? CommonError::SUCCESS : CommonError::ARG_TYPE_ERROR;
+}
+
+// Decimal form of a bool or number value, empty for anything else.
+std::string_view number_to_string(const Value* object, std::string* scratch) {
+  char buffer[32];
+  char* end = buffer;
+  switch (object->kind()) {
+    case Value::Kind::kBool:
+      return object->bool_value() ? "true" : "false";
+    case Value::Kind::kInt:
+      end = std::to_chars(buffer, std::end(buffer), object->int_value()).ptr;
+      break;
+    case Value::Kind::kUint:
+      end = std::to_chars(buffer, std::end(buffer), object->uint_value()).ptr;
+      break;
+    case Value::Kind::kDouble:
+      end = std::to_chars(buffer, std::end(buffer), object->double_value()).ptr;
+      break;
+    default:
+      return {};
+  }
+  scratch->assign(buffer, end);
+  return *scratch;
+}
+}  // namespace
+
+std::string_view KeySerializer<Value*>::from_platform(Value* key,
+                                                      std::string* scratch) {
+  if (key->is_string() || key->is_bytes()) {
+    return key->string_value();
+  }
+  return number_to_string(key, scratch);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            int32_t value) {
+  return Value::NewInt(ValueArena::Current(), value);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            uint32_t value) {
+  return Value::NewUint(ValueArena::Current(), value);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            int64_t value) {
+  return int64_to_value(value, int64_format_);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            uint64_t value) {
+  return int64_to_value(value, int64_format_);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            float value) {
+  return Value::NewDouble(ValueArena::Current(), value);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            double value) {
+  return Value::NewDouble(ValueArena::Current(), value);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            bool value) {
+  return Value::NewBool(ValueArena::Current(), value);
+}
+
+Value* FieldSerializer<Value*>::to_platform(const FieldDescriptor* field,
+                                            std::string_view value) {
+  if (field->type() == FieldDescriptor::TYPE_BYTES) {
+    return Value::NewBytes(ValueArena::Current(), value);
+  }
+  return Value::NewString(ValueArena::Current(), value);
+}
+
+#define MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(type)          \
+  ErrorCode FieldSerializer<Value*>::from_platform(              \
+      const FieldDescriptor* field, Value* object, type* value) { \
+    return value_to_number(object, number_forms_, value);        \
+  }
+
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(int32_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(uint32_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(int64_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(uint64_t)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(float)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(double)
+MACRO_FIELD_SERIALIZER_FROM_PLATFORM_IMPL(bool)
+
+ErrorCode FieldSerializer<Value*>::from_platform(
+    const FieldDescriptor* field,
+    Value* object,
+    const EnumValueDescriptor** value) {
+  const EnumDescriptor* enum_desc = field->enum_type();
+  if (!enum_desc) {
+    return CommonError::CORRUPTED_DATA;
+  }
+  if (object->is_string()) {
+    *value = enum_desc->FindValueByName(std::string(object->string_value()));
+  } else if (int number = 0;
+             !value_to_number(object, detail::kNumberDecimal, &number)) {
+    *value = enum_desc->FindValueByNumber(number);
+  } else {
+    *value = nullptr;
+  }
+  return *value ? CommonError::SUCCESS : CommonError::ARG_TYPE_ERROR;
+}
+
+ErrorCode FieldSerializer<Value*>::from_platform(const FieldDescriptor* field,
+                                                 Value* object,
+                                                 std::string_view* value,
+                                                 std::string* scratch) {
+  if (object->is_string() || object->is_bytes()) {
+    *value = object->string_value();
+    return CommonError::SUCCESS;
+  }
+  if (!object->is_number()) {
+    return CommonError::ARG_TYPE_ERROR;
+  }
+  *value = number_to_string(object, scratch);
+  return CommonError::SUCCESS;
+}
+
+// BEGIN FROM_PB IMPL
+template <typename T>
+Value* to_value(const std::pair<const FieldDescriptor*, T>& value,
+                const PBOptions& options) {
+  FieldSerializer<Value*> serializer(options);
+  if constexpr (std::is_same_v<T, const EnumValueDescriptor*>) {
+    return serializer.to_platform(value.first, value.second->number());
+  } else {
+    return serializer.to_platform(value.first, value.second);
+  }
+}
+
+#define MACRO_FROM_PB_IMPL(type, name, dname)                               \
+  template <>                                                               \
+  std::pair<ErrorCode, Value*> from_pb<FieldDescriptor::CPPTYPE_##type,     \
+                                       Value*>(const Context& pb_context) { \
+    std::pair<const FieldDescriptor*,                                       \
+              decltype(std::declval<Reflection>().Get##name(                \
+                  std::declval<Message>(), nullptr))>                       \
+        value{};                                                            \
+    value.first = pb_context.field;                                         \
+    if (pb_context.index) {                                                 \
+      value.second = pb_context.reflection->GetRepeated##name(              \
+          *pb_context.message, pb_context.field, *pb_context.index);        \
+    } else {                                                                \
+      value.second = pb_context.reflection->HasField(*pb_context.message,   \
+                                                     pb_context.field)      \
+                         ? pb_context.reflection->Get##name(                \
+                               *pb_context.message, pb_context.field)       \
+                         : pb_context.field->default_value_##dname();       \
+    }                                                                       \
+    Value* obj = to_value(value, pb_context.options);                       \
+    return {obj ? CommonError::SUCCESS : CommonError::FAILED, obj};         \
+  }
+
+#define MACRO_FROM_PB_FUNCTION_MAP_ITEM(type)                  \
+  {                                                            \
+    FieldDescriptor::CPPTYPE_##type,                           \
+        from_pb<FieldDescriptor::CPPTYPE_##type, Value*>       \
+  }
+
+MACRO_FROM_PB_IMPL(INT32, Int32, int32)
+MACRO_FROM_PB_IMPL(UINT32, UInt32, uint32)
+MACRO_FROM_PB_IMPL(INT64, Int64, int64)
+MACRO_FROM_PB_IMPL(UINT64, UInt64, uint64)
+MACRO_FROM_PB_IMPL(FLOAT, Float, float)
+MACRO_FROM_PB_IMPL(DOUBLE, Double, double)
+MACRO_FROM_PB_IMPL(BOOL, Bool, bool)
+MACRO_FROM_PB_IMPL(ENUM, Enum, enum)
+
+template <>
+std::pair<ErrorCode, Value*> from_pb<FieldDescriptor::CPPTYPE_STRING, Value*>(
+    const Context& pb_context) {
+  std::string_view view;
+  std::string scratch;
+  if (pb_context.index) {
+    view = pb_context.reflection->GetRepeatedStringReference(
+        *pb_context.message, pb_context.field, *pb_context.index, &scratch);
+  } else {
+    view =
+        pb_context.reflection->HasField(*pb_context.message, pb_context.field)
+            ? pb_context.reflection->GetStringReference(
+                  *pb_context.message, pb_context.field, &scratch)
+            : pb_context.field->default_value_string();
+  }
+  return {CommonError::SUCCESS, FieldSerializer<Value*>(pb_context.options)
+                                    .to_platform(pb_context.field, view)};
+}
+
+template <>
+std::pair<ErrorCode, Value*> from_pb<FieldDescriptor::CPPTYPE_MESSAGE, Value*>(
+    const Context& pb_context) {
+  const Message& message = pb_context.reflection->GetMessage(
+      *pb_context.message, pb_context.field);
+  return from_pb<Value*>(const_cast<Message*>(&message), pb_context.options);
+}
+
+template <>
+const FromPbFunctionMap<Value*>& GetFromPbFunctionMap() {
+  static const auto* map = new FromPbFunctionMap<Value*>{
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(INT32),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(UINT32),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(INT64),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(UINT64),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(FLOAT),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(DOUBLE),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(BOOL),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(STRING),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(MESSAGE),
+      MACRO_FROM_PB_FUNCTION_MAP_ITEM(ENUM)};
+  return *map;
+}
+// END FROM_PB IMPL
+
+// BEGIN TO_PB IMPL
+#define MACRO_TO_PB_IMPL(type, type_name)                                  \
+  template <>                                                              \
+  ErrorCode to_pb<FieldDescriptor::CPPTYPE_##type, Value*>(                \
+      Value * object, Context & pb_context) {                              \
+    decltype(std::declval<Reflection>().Get##type_name(                    \
+        std::declval<Message>(), nullptr)) value{};                        \
+    if (auto error_code = FieldSerializer<Value*>(pb_context.options)      \
+                              .from_platform(pb_context.field, object,     \
+                                             &value);                      \
+        !error_code) {                                                     \
+      auto func = pb_context.field->is_repeated()                          \
+                      ? &Reflection::Add##type_name                        \
+                      : &Reflection::Set##type_name;                       \
+      (pb_context.reflection->*func)(pb_context.message, pb_context.field, \
+                                     std::move(value));                    \
+      return CommonError::SUCCESS;                                         \
+    } else {                                                               \
+      PB_LOG(ERROR) << "to_pb error, name: " << pb_context.field->name()   \
+                    << ", " << error_code;                                 \
+      return error_code;                                                   \
+    }                                                                      \
+  }
+
+#define MACRO_TO_PB_FUNCTION_MAP_ITEM(type)                    \
+  {                                                            \
+    FieldDescriptor::CPPTYPE_##type,                           \
+        to_pb<FieldDescriptor::CPPTYPE_##type, Value*>         \
+  }
+
+MACRO_TO_PB_IMPL(INT32, Int32)
+MACRO_TO_PB_IMPL(UINT32, UInt32)
+MACRO_TO_PB_IMPL(INT64, Int64)
+MACRO_TO_PB_IMPL(UINT64, UInt64)
+MACRO_TO_PB_IMPL(FLOAT, Float)
+MACRO_TO_PB_IMPL(DOUBLE, Double)
+MACRO_TO_PB_IMPL(BOOL, Bool)
+MACRO_TO_PB_IMPL(ENUM, Enum)
+
+template <>
+ErrorCode to_pb<FieldDescriptor::CPPTYPE_STRING, Value*>(Value* object,
+                                                         Context& pb_context) {
+  auto func = pb_context.field->is_repeated() ? &Reflection::AddString
+                                              : &Reflection::SetString;
+  std::string_view value;
+  std::string scratch;
+  if (auto error_code = FieldSerializer<Value*>(pb_context.options)
+                            .from_platform(pb_context.field, object, &value,
+                                           &scratch)) {
+    PB_LOG(ERROR) << "to_pb string error, name: " << pb_context.field->name();
+    return error_code;
+  }
+  (pb_context.reflection->*func)(pb_context.message, pb_context.field,
+                                 std::string(value));
+  return CommonError::SUCCESS;
+}
+
+template <>
+ErrorCode to_pb<FieldDescriptor::CPPTYPE_MESSAGE, Value*>(Value* object,
+                                                          Context& pb_context) {
+  Message* message =
+      pb_context.field->is_repeated()
+          ? pb_context.reflection->AddMessage(pb_context.message,
+                                              pb_context.field)
+          : pb_context.reflection->MutableMessage(pb_context.message,
+                                                  pb_context.field);
+  return to_pb<Value*>(object, message, pb_context.warnning_fields);
+}
+
+template <>
+const ToPbFunctionMap<Value*>& GetToPbFunctionMap<Value*>() {
+  static const auto* map = new ToPbFunctionMap<Value*>{
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(INT32),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(UINT32),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(INT64),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(UINT64),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(FLOAT),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(DOUBLE),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(BOOL),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(STRING),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(MESSAGE),
+      MACRO_TO_PB_FUNCTION_MAP_ITEM(ENUM)};
+  return *map;
+}
+// END TO_PB IMPL
+
+std::pair<ErrorCode, Value*> from_pb(const PBRuntime<Value*>& runtime,
+                                     const PBInfo& pb_info,
+                                     ValueArena* arena,
+                                     const PBOptions& options) {
+  ValueArena::Scope scope(arena);
+  return from_pb<Value*>(runtime, pb_info, options);
+}
+
+std::pair<ErrorCode, Value*> from_default_pb(const PBRuntime<Value*>& runtime,
+                                             std::string_view pb_type,
+                                             ValueArena* arena,
+                                             const PBOptions& options) {
+  ValueArena::Scope scope(arena);
+  return from_default_pb<Value*>(runtime, pb_type, options);
+}
+}  // namespace magic::pb
@@ -0,0 +1,249 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_SERIALIZER_VALUE_H_
+#define CONVERT_SRC_SERIALIZER_PB_SERIALIZER_VALUE_H_
+
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "magic/serializer.h"
+#include "serializer/pb_serializer.h"
+#include "serializer/pb_value.h"
+#include "serializer/pb_wire_decoder.h"
+#include "serializer/pb_wire_encoder.h"
+
+// Portable backend over the Value tree of pb_value.h, for builds without
+// Objective-C. New values are allocated from ValueArena::Current(); run
+// conversions inside a ValueArena::Scope, or use the overloads at the end
+// that take the arena. Decoding without either fails with INVALID_ARG.
+namespace magic::pb {
+template <>
+const FromPbFunctionMap<Value*>& GetFromPbFunctionMap();
+
+template <>
+const ToPbFunctionMap<Value*>& GetToPbFunctionMap();
+
+// Entries copy the key bytes, so field names are added as views of the
+// plan's names.
+template <>
+struct KeySerializer<Value*> {
+  using Key = std::string_view;
+  Key to_platform(std::string_view name) { return name; }
+  std::string_view from_platform(Value* key, std::string* scratch);
+};
+
+template <bool reader>
+struct ArrayWrapper<Value*, reader> {
+  ArrayWrapper() : array_(Value::NewArray(ValueArena::Current())) {}
+
+  ArrayWrapper(Value* array) : array_(array) {
+    assert(array->is_array());
+  }
+
+  operator Value*() const noexcept { return array_; }
+
+  // Each chunk of a parallel conversion allocates from a child of the
+  // starting thread's arena.
+  static WorkerRunner BindWorker() {
+    return [arena = ValueArena::Current()](const std::function<void()>& fn) {
+      ValueArena::Scope scope(arena->NewChild());
+      fn();
+    };
+  }
+
+  void Add(Value* value) { array_->Append(ValueArena::Current(), value); }
+
+  std::vector<Value*> Values() const {
+    auto items = array_->items();
+    return {items.begin(), items.end()};
+  }
+
+  std::size_t Size() const { return array_->size(); }
+
+  template <typename Fn>
+  bool ForEach(Fn&& fn) const {
+    for (Value* value : array_->items()) {
+      if (!fn(value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  Value* array_;
+};
+
+template <bool reader>
+struct DictWrapper<Value*, reader> {
+  DictWrapper() : dict_(Value::NewDict(ValueArena::Current())) {}
+
+  DictWrapper(Value* dict) : dict_(dict) { assert(dict->is_dict()); }
+
+  operator Value*() const noexcept { return dict_; }
+
+  static Value* Copy(Value* dict) {
+    return dict->Clone(ValueArena::Current());
+  }
+
+  static bool CanCreate() { return ValueArena::Current(); }
+
+  static std::shared_ptr<void> Retain(const std::function<void()>& fn) {
+    auto arena = std::make_shared<ValueArena>();
+    ValueArena::Scope scope(arena.get());
+    fn();
+    return arena;
+  }
+
+  // Map keys that are not strings are added as their decimal form.
+  void Add(Value* key, Value* value) {
+    std::string scratch;
+    Add(KeySerializer<Value*>().from_platform(key, &scratch), value);
+  }
+
+  void Add(std::string_view key, Value* value) {
+    dict_->Set(ValueArena::Current(), key, value);
+  }
+
+  std::vector<std::pair<Value*, Value*>> KeyAndValues() const {
+    std::vector<std::pair<Value*, Value*>> result;
+    result.reserve(dict_->size());
+    for (auto& entry : dict_->entries()) {
+      result.emplace_back(&entry.key, entry.value);
+    }
+    return result;
+  }
+
+  std::size_t Size() const { return dict_->size(); }
+
+  template <typename Fn>
+  bool ForEach(Fn&& fn) const {
+    for (auto& entry : dict_->entries()) {
+      if (!fn(&entry.key, entry.value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  Value* dict_;
+};
+
+template <>
+struct TypeCheck<Value*> {
+  TypeCheck(const Value* value) : value_(value) {}
+
+  bool IsNullOrUndefined() const { return !value_ || value_->is_null(); }
+
+  bool IsArray() const { return value_ && value_->is_array(); }
+
+  bool IsDict() const { return value_ && value_->is_dict(); }
+
+  const Value* value_;
+};
+
+template <>
+struct FieldSerializer<Value*> {
+  explicit FieldSerializer(const PBOptions& options)
+      : int64_format_(options.int64_format),
+        number_forms_(options.lenient_numbers
+                          ? detail::kNumberHex | detail::kNumberExponent
+                          : detail::kNumberDecimal) {}
+  Value* to_platform(const FieldDescriptor* field, int32_t value);
+  Value* to_platform(const FieldDescriptor* field, uint32_t value);
+  Value* to_platform(const FieldDescriptor* field, int64_t value);
+  Value* to_platform(const FieldDescriptor* field, uint64_t value);
+  Value* to_platform(const FieldDescriptor* field, float value);
+  Value* to_platform(const FieldDescriptor* field, double value);
+  Value* to_platform(const FieldDescriptor* field, bool value);
+  Value* to_platform(const FieldDescriptor* field, std::string_view value);
+
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          int32_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          uint32_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          int64_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          uint64_t* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          float* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          double* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          bool* value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          const EnumValueDescriptor** value);
+  ErrorCode from_platform(const FieldDescriptor* field,
+                          Value* object,
+                          std::string_view* value,
+                          std::string* scratch);
+
+ private:
+  PBInt64Format int64_format_;
+  unsigned number_forms_;
+};
+
+// Numbers from any number value, strings from string and bytes values.
+template <typename T>
+struct Serializer<Value*, T> {
+  T from_platform(Value* object) {
+    if constexpr (std::is_arithmetic_v<T>) {
+      switch (object->kind()) {
+        case Value::Kind::kBool:
+          return static_cast<T>(object->bool_value());
+        case Value::Kind::kInt:
+          return static_cast<T>(object->int_value());
+        case Value::Kind::kUint:
+          return static_cast<T>(object->uint_value());
+        case Value::Kind::kDouble:
+          return static_cast<T>(object->double_value());
+        default:
+          return T{};
+      }
+    } else {
+      return T(object->string_value());
+    }
+  }
+
+  Value* to_platform(const T& v) {
+    auto* arena = ValueArena::Current();
+    if constexpr (std::is_same_v<T, bool>) {
+      return Value::NewBool(arena, v);
+    } else if constexpr (std::is_floating_point_v<T>) {
+      return Value::NewDouble(arena, v);
+    } else if constexpr (std::is_signed_v<T>) {
+      return Value::NewInt(arena, v);
+    } else if constexpr (std::is_unsigned_v<T>) {
+      return Value::NewUint(arena, v);
+    } else {
+      return Value::NewString(arena, v);
+    }
+  }
+};
+
+// Conversions whose new values are allocated from |arena|.
+std::pair<ErrorCode, Value*> from_pb(const PBRuntime<Value*>& runtime,
+                                     const PBInfo& pb_info,
+                                     ValueArena* arena,
+                                     const PBOptions& options = {});
+
+std::pair<ErrorCode, Value*> from_default_pb(const PBRuntime<Value*>& runtime,
+                                             std::string_view pb_type,
+                                             ValueArena* arena,
+                                             const PBOptions& options = {});
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_SERIALIZER_VALUE_H_
@@ -0,0 +1,55 @@
+#include "serializer/pb_size_estimator.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace magic::pb {
+SizeEstimator::Entry* SizeEstimator::Find(const Descriptor* descriptor) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = entries_.find(descriptor);
+  return it != entries_.end() ? it->second.get() : nullptr;
+}
+
+std::size_t SizeEstimator::Estimate(const Descriptor* descriptor,
+                                    std::size_t fallback) const {
+  const auto* entry = Find(descriptor);
+  return entry && entry->count.load(std::memory_order_relaxed)
+             ? entry->peak.load(std::memory_order_relaxed)
+             : fallback;
+}
+
+void SizeEstimator::Record(const Descriptor* descriptor, std::size_t size) {
+  auto* entry = Find(descriptor);
+  if (!entry) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto& slot = entries_[descriptor];
+    if (!slot) {
+      slot = std::make_unique<Entry>();
+    }
+    entry = slot.get();
+  }
+  auto count = entry->count.fetch_add(1, std::memory_order_relaxed);
+  auto mean = entry->mean.load(std::memory_order_relaxed);
+  auto peak = entry->peak.load(std::memory_order_relaxed);
+  if (count == 0) {
+    mean = size;
+  } else if (size > mean) {
+    mean += (size - mean) / 16;
+  } else {
+    mean -= (mean - size) / 16;
+  }
+  entry->mean.store(mean, std::memory_order_relaxed);
+  entry->peak.store(std::max(size, peak - peak / 64),
+                    std::memory_order_relaxed);
+}
+
+SizeEstimator::Stats SizeEstimator::stats(const Descriptor* descriptor) const {
+  const auto* entry = Find(descriptor);
+  if (!entry) {
+    return {};
+  }
+  return {.count = entry->count.load(std::memory_order_relaxed),
+          .mean = entry->mean.load(std::memory_order_relaxed),
+          .peak = entry->peak.load(std::memory_order_relaxed)};
+}
+}  // namespace magic::pb
@@ -0,0 +1,59 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_SIZE_ESTIMATOR_H_
+#define CONVERT_SRC_SERIALIZER_PB_SIZE_ESTIMATOR_H_
+
+#include <google/protobuf/descriptor.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace magic::pb {
+using google::protobuf::Descriptor;
+
+// Learns the encoded sizes of each message type so encode buffers can be
+// sized before the first attempt. The estimate is a peak that decays by
+// 1/64 per message, so it covers the recent large messages of a type and
+// shrinks slowly once they stop.
+//
+// Thread safe. Updates race benignly, a lost one only skews the estimate.
+class SizeEstimator {
+ public:
+  struct Stats {
+    uint64_t count = 0;
+    std::size_t mean = 0;
+    std::size_t peak = 0;
+  };
+
+  SizeEstimator() = default;
+
+  SizeEstimator(const SizeEstimator&) = delete;
+  SizeEstimator& operator=(const SizeEstimator&) = delete;
+
+  // Bytes likely to hold the next message of |descriptor|, |fallback| until
+  // one was recorded.
+  std::size_t Estimate(const Descriptor* descriptor,
+                       std::size_t fallback = kDefaultEstimate) const;
+
+  void Record(const Descriptor* descriptor, std::size_t size);
+
+  Stats stats(const Descriptor* descriptor) const;
+
+  static constexpr std::size_t kDefaultEstimate = 256;
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> count{0};
+    std::atomic<std::size_t> mean{0};
+    std::atomic<std::size_t> peak{0};
+  };
+
+  Entry* Find(const Descriptor* descriptor) const;
+
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<const Descriptor*, std::unique_ptr<Entry>> entries_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_SIZE_ESTIMATOR_H_
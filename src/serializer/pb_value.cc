@@ -0,0 +1,259 @@
+#include "serializer/pb_value.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <utility>
+
+namespace magic::pb {
+namespace {
+constexpr std::size_t kMaxBlockSize = 1024 * 1024;
+
+thread_local ValueArena* current_arena = nullptr;
+
+std::size_t HashKey(std::string_view key) {
+  return std::hash<std::string_view>()(key);
+}
+}  // namespace
+
+ValueArena::ValueArena(std::size_t initial_block_size)
+    : next_block_size_(std::max<std::size_t>(initial_block_size, 256)) {}
+
+ValueArena::~ValueArena() {
+  while (blocks_) {
+    ::operator delete(std::exchange(blocks_, blocks_->next));
+  }
+}
+
+void* ValueArena::AllocateSlow(std::size_t size, std::size_t align) {
+  // Oversized requests get a block of their own and leave the current one
+  // in use.
+  const std::size_t needed = sizeof(Block) + size + align;
+  const bool dedicated = needed > next_block_size_;
+  const std::size_t block_size = dedicated ? needed : next_block_size_;
+  auto* block = static_cast<Block*>(::operator new(block_size));
+  block->size = block_size;
+  block->next = blocks_;
+  blocks_ = block;
+  space_allocated_ += block_size;
+
+  char* begin = reinterpret_cast<char*>(block + 1);
+  char* end = reinterpret_cast<char*>(block) + block_size;
+  auto offset = (align - reinterpret_cast<uintptr_t>(begin)) & (align - 1);
+  if (!dedicated) {
+    next_block_size_ = std::min(next_block_size_ * 2, kMaxBlockSize);
+    ptr_ = begin + offset + size;
+    end_ = end;
+  }
+  return begin + offset;
+}
+
+ValueArena* ValueArena::NewChild() {
+  auto child = std::make_unique<ValueArena>(next_block_size_);
+  std::lock_guard lock(children_mutex_);
+  return children_.emplace_back(std::move(child)).get();
+}
+
+ValueArena* ValueArena::Current() {
+  return current_arena;
+}
+
+ValueArena::Scope::Scope(ValueArena* arena)
+    : previous_(std::exchange(current_arena, arena)) {}
+
+ValueArena::Scope::~Scope() {
+  current_arena = previous_;
+}
+
+Value* Value::New(ValueArena* arena, Kind kind) {
+  auto* value = arena->AllocateArray<Value>(1);
+  value->kind_ = kind;
+  value->size_ = 0;
+  value->uint_ = 0;
+  return value;
+}
+
+Value* Value::NewNull(ValueArena* arena) {
+  return New(arena, Kind::kNull);
+}
+
+Value* Value::NewBool(ValueArena* arena, bool value) {
+  auto* result = New(arena, Kind::kBool);
+  result->bool_ = value;
+  return result;
+}
+
+Value* Value::NewInt(ValueArena* arena, int64_t value) {
+  auto* result = New(arena, Kind::kInt);
+  result->int_ = value;
+  return result;
+}
+
+Value* Value::NewUint(ValueArena* arena, uint64_t value) {
+  auto* result = New(arena, Kind::kUint);
+  result->uint_ = value;
+  return result;
+}
+
+Value* Value::NewDouble(ValueArena* arena, double value) {
+  auto* result = New(arena, Kind::kDouble);
+  result->double_ = value;
+  return result;
+}
+
+Value* Value::NewString(ValueArena* arena, std::string_view value) {
+  auto* result = arena->AllocateArray<Value>(1);
+  result->InitString(arena, Kind::kString, value);
+  return result;
+}
+
+Value* Value::NewBytes(ValueArena* arena, std::string_view value) {
+  auto* result = arena->AllocateArray<Value>(1);
+  result->InitString(arena, Kind::kBytes, value);
+  return result;
+}
+
+Value* Value::NewArray(ValueArena* arena) {
+  auto* result = New(arena, Kind::kArray);
+  result->array_ = {};
+  return result;
+}
+
+Value* Value::NewDict(ValueArena* arena) {
+  auto* result = New(arena, Kind::kDict);
+  result->dict_ = {};
+  return result;
+}
+
+void Value::InitString(ValueArena* arena, Kind kind, std::string_view value) {
+  kind_ = kind;
+  size_ = static_cast<uint32_t>(value.size());
+  if (value.size() <= kInlineSize) {
+    std::memcpy(inline_, value.data(), value.size());
+    return;
+  }
+  auto* data = arena->AllocateArray<char>(value.size());
+  std::memcpy(data, value.data(), value.size());
+  data_ = data;
+}
+
+void Value::Append(ValueArena* arena, Value* value) {
+  if (size_ == array_.capacity) {
+    const uint32_t capacity = std::max<uint32_t>(4, array_.capacity * 2);
+    auto* items = arena->AllocateArray<Value*>(capacity);
+    std::copy_n(array_.items, size_, items);
+    array_ = {items, capacity};
+  }
+  array_.items[size_++] = value;
+}
+
+uint32_t* Value::index() const {
+  return dict_.capacity > kLinearEntries
+             ? reinterpret_cast<uint32_t*>(dict_.entries + dict_.capacity)
+             : nullptr;
+}
+
+ValueEntry* Value::FindEntry(std::string_view key) const {
+  if (const uint32_t* slots = index()) {
+    const std::size_t mask = dict_.capacity * 2 - 1;
+    for (auto slot = HashKey(key) & mask; slots[slot];
+         slot = (slot + 1) & mask) {
+      auto& entry = dict_.entries[slots[slot] - 1];
+      if (entry.key.string_value() == key) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+  for (auto& entry : entries()) {
+    if (entry.key.string_value() == key) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+Value* Value::Find(std::string_view key) const {
+  auto* entry = FindEntry(key);
+  return entry ? entry->value : nullptr;
+}
+
+void Value::IndexEntry(uint32_t position) {
+  uint32_t* slots = index();
+  const std::size_t mask = dict_.capacity * 2 - 1;
+  auto slot = HashKey(dict_.entries[position].key.string_value()) & mask;
+  while (slots[slot]) {
+    slot = (slot + 1) & mask;
+  }
+  slots[slot] = position + 1;
+}
+
+void Value::GrowDict(ValueArena* arena) {
+  const uint32_t capacity = std::max<uint32_t>(4, dict_.capacity * 2);
+  std::size_t bytes = sizeof(ValueEntry) * capacity;
+  if (capacity > kLinearEntries) {
+    bytes += sizeof(uint32_t) * capacity * 2;
+  }
+  auto* entries = static_cast<ValueEntry*>(
+      arena->Allocate(bytes, alignof(ValueEntry)));
+  std::copy_n(dict_.entries, size_, entries);
+  dict_ = {entries, capacity};
+  if (uint32_t* slots = index()) {
+    std::fill_n(slots, capacity * 2, 0);
+    for (uint32_t position = 0; position < size_; ++position) {
+      IndexEntry(position);
+    }
+  }
+}
+
+void Value::Set(ValueArena* arena, std::string_view key, Value* value) {
+  if (auto* entry = FindEntry(key)) {
+    entry->value = value;
+    return;
+  }
+  if (size_ == dict_.capacity) {
+    GrowDict(arena);
+  }
+  auto& entry = dict_.entries[size_];
+  entry.key.InitString(arena, Kind::kString, key);
+  entry.value = value;
+  if (index()) {
+    IndexEntry(size_);
+  }
+  ++size_;
+}
+
+Value* Value::Clone(ValueArena* arena) const {
+  switch (kind_) {
+    case Kind::kString:
+    case Kind::kBytes: {
+      auto* result = arena->AllocateArray<Value>(1);
+      result->InitString(arena, kind_, string_value());
+      return result;
+    }
+    case Kind::kArray: {
+      auto* result = NewArray(arena);
+      if (size_) {
+        result->array_ = {arena->AllocateArray<Value*>(size_), size_};
+        for (auto* item : items()) {
+          result->array_.items[result->size_++] = item->Clone(arena);
+        }
+      }
+      return result;
+    }
+    case Kind::kDict: {
+      auto* result = NewDict(arena);
+      for (const auto& entry : entries()) {
+        result->Set(arena, entry.key.string_value(), entry.value->Clone(arena));
+      }
+      return result;
+    }
+    default: {
+      auto* result = arena->AllocateArray<Value>(1);
+      *result = *this;
+      return result;
+    }
+  }
+}
+}  // namespace magic::pb
@@ -0,0 +1,200 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_VALUE_H_
+#define CONVERT_SRC_SERIALIZER_PB_VALUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace magic::pb {
+// Bump allocator the portable value tree lives in. Values are trivially
+// destructible, so everything allocated is freed at once when the arena is
+// destroyed.
+//
+// An arena is used by one thread at a time. Conversions fanned out to a
+// WorkerPool give each chunk a child arena, which is freed with its parent.
+class ValueArena {
+ public:
+  explicit ValueArena(std::size_t initial_block_size = 4096);
+  ~ValueArena();
+
+  ValueArena(const ValueArena&) = delete;
+  ValueArena& operator=(const ValueArena&) = delete;
+
+  void* Allocate(std::size_t size, std::size_t align) {
+    auto offset = (align - reinterpret_cast<uintptr_t>(ptr_)) & (align - 1);
+    if (static_cast<std::size_t>(end_ - ptr_) < offset + size) {
+      return AllocateSlow(size, align);
+    }
+    void* memory = ptr_ + offset;
+    ptr_ += offset + size;
+    return memory;
+  }
+
+  template <typename T>
+  T* AllocateArray(std::size_t count) {
+    return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  // A new arena owned by this one. Thread safe.
+  ValueArena* NewChild();
+
+  // Bytes taken from the system by this arena, children excluded.
+  std::size_t SpaceAllocated() const { return space_allocated_; }
+
+  // The arena values made on this thread are allocated from, that of the
+  // innermost Scope. nullptr outside of any Scope.
+  static ValueArena* Current();
+
+  // Makes |arena| current on this thread until destroyed.
+  class Scope {
+   public:
+    explicit Scope(ValueArena* arena);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    ValueArena* previous_;
+  };
+
+ private:
+  struct Block {
+    Block* next;
+    std::size_t size;
+  };
+
+  void* AllocateSlow(std::size_t size, std::size_t align);
+
+  char* ptr_ = nullptr;
+  char* end_ = nullptr;
+  Block* blocks_ = nullptr;
+  std::size_t next_block_size_;
+  std::size_t space_allocated_ = 0;
+
+  std::mutex children_mutex_;
+  std::vector<std::unique_ptr<ValueArena>> children_;
+};
+
+struct ValueEntry;
+
+// Node of a JSON-like tree: null, bool, int64, uint64, double, string, bytes,
+// array or dictionary with string keys. 24 bytes; strings up to
+// kInlineSize bytes are stored in the node itself.
+//
+// Arrays and dictionaries are flat vectors grown in the arena. Dictionaries
+// keep insertion order, and past kLinearEntries entries also a hash index,
+// so setting an existing key replaces its value at any size.
+class Value {
+ public:
+  enum class Kind : uint8_t {
+    kNull,
+    kBool,
+    kInt,
+    kUint,
+    kDouble,
+    kString,
+    kBytes,
+    kArray,
+    kDict,
+  };
+
+  static constexpr std::size_t kInlineSize = 16;
+  static constexpr std::size_t kLinearEntries = 8;
+
+  static Value* NewNull(ValueArena* arena);
+  static Value* NewBool(ValueArena* arena, bool value);
+  static Value* NewInt(ValueArena* arena, int64_t value);
+  static Value* NewUint(ValueArena* arena, uint64_t value);
+  static Value* NewDouble(ValueArena* arena, double value);
+  static Value* NewString(ValueArena* arena, std::string_view value);
+  static Value* NewBytes(ValueArena* arena, std::string_view value);
+  static Value* NewArray(ValueArena* arena);
+  static Value* NewDict(ValueArena* arena);
+
+  Kind kind() const { return kind_; }
+  bool is_null() const { return kind_ == Kind::kNull; }
+  bool is_array() const { return kind_ == Kind::kArray; }
+  bool is_dict() const { return kind_ == Kind::kDict; }
+  bool is_number() const {
+    return kind_ >= Kind::kBool && kind_ <= Kind::kDouble;
+  }
+  bool is_string() const { return kind_ == Kind::kString; }
+  bool is_bytes() const { return kind_ == Kind::kBytes; }
+
+  bool bool_value() const { return bool_; }
+  int64_t int_value() const { return int_; }
+  uint64_t uint_value() const { return uint_; }
+  double double_value() const { return double_; }
+  // Contents of a string or bytes value.
+  std::string_view string_value() const {
+    return {size_ <= kInlineSize ? inline_ : data_, size_};
+  }
+
+  // Elements of an array or entries of a dictionary.
+  std::size_t size() const { return size_; }
+
+  std::span<Value* const> items() const { return {array_.items, size_}; }
+  void Append(ValueArena* arena, Value* value);
+
+  std::span<ValueEntry> entries() const;
+  // Value of the entry for |key|, nullptr if there is none.
+  Value* Find(std::string_view key) const;
+  // Adds an entry for |key|, which is copied, or replaces its value.
+  void Set(ValueArena* arena, std::string_view key, Value* value);
+
+  // A copy of the whole tree allocated from |arena|.
+  Value* Clone(ValueArena* arena) const;
+
+ private:
+  struct ArrayData {
+    Value** items;
+    uint32_t capacity;
+  };
+
+  struct DictData {
+    ValueEntry* entries;
+    uint32_t capacity;
+  };
+
+  static Value* New(ValueArena* arena, Kind kind);
+
+  void InitString(ValueArena* arena, Kind kind, std::string_view value);
+
+  // Past kLinearEntries, |capacity| * 2 slots of entry position + 1 follow
+  // the entries, 0 for free slots.
+  uint32_t* index() const;
+  ValueEntry* FindEntry(std::string_view key) const;
+  void GrowDict(ValueArena* arena);
+  void IndexEntry(uint32_t position);
+
+  Kind kind_;
+  uint32_t size_;
+  union {
+    bool bool_;
+    int64_t int_;
+    uint64_t uint_;
+    double double_;
+    char inline_[kInlineSize];
+    const char* data_;
+    ArrayData array_;
+    DictData dict_;
+  };
+};
+
+struct ValueEntry {
+  // Always a string.
+  Value key;
+  Value* value;
+};
+
+inline std::span<ValueEntry> Value::entries() const {
+  return {dict_.entries, size_};
+}
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_VALUE_H_
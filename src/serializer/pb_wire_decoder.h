@@ -0,0 +1,788 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_WIRE_DECODER_H_
+#define CONVERT_SRC_SERIALIZER_PB_WIRE_DECODER_H_
+
+#include <bit>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "serializer/pb_lazy.h"
+#include "serializer/pb_serializer.h"
+#include "serializer/pb_wire_format.h"
+
+namespace magic::pb {
+inline bool IsClosedEnum(const FieldDescriptor* field) {
+  return field->type() == FieldDescriptor::TYPE_ENUM &&
+         field->file()->syntax() ==
+             google::protobuf::FileDescriptor::SYNTAX_PROTO2;
+}
+
+inline bool RequiresUtf8Validation(const FieldDescriptor* field) {
+  return field->type() == FieldDescriptor::TYPE_STRING &&
+         field->file()->syntax() ==
+             google::protobuf::FileDescriptor::SYNTAX_PROTO3;
+}
+
+// Decodes protobuf wire format straight into platform objects, guided by a
+// MessagePlan. The result matches ParseFromArray into a DynamicMessage
+// followed by from_pb: same presence rules and defaults, last-one-wins
+// scalars, merged sub message occurrences, oneofs and closed enums.
+//
+// Given the owner of the bytes it decodes as |lazy_bytes| and
+// PBOptions::lazy, sub messages and repeated message fields become lazy
+// containers over slices of those bytes instead. The slices are checked
+// when recorded, so malformed ones fail Decode as they would eagerly;
+// |validated| skips that for bytes a previous decoder already checked.
+// With PBOptions::borrow_bytes, string and bytes values borrow from
+// |data_owner|, or from |lazy_bytes| when lazy.
+template <typename Object>
+class WireDecoder {
+ public:
+  explicit WireDecoder(const PBOptions& options,
+                       LazyBytes lazy_bytes = {},
+                       std::shared_ptr<const void> data_owner = {},
+                       bool validated = false)
+      : options_(options),
+        serializer_(options),
+        lazy_bytes_(options.lazy ? std::move(lazy_bytes) : nullptr),
+        validated_(validated) {
+    if (options.borrow_bytes) {
+      data_owner_ = data_owner ? std::move(data_owner) : lazy_bytes_;
+    }
+  }
+
+  std::pair<ErrorCode, Object> Decode(
+      const MessagePlan<Object>& plan,
+      std::string_view data,
+      const std::vector<std::string_view>& more = {}) {
+    auto result = DecodeMessage(plan, data, more);
+    if (parse_error_) {
+      PB_LOG(ERROR) << "WireDecoder parse error, pb.size(): " << data.size();
+      return {PBError::kPBParseError, {}};
+    }
+    return result;
+  }
+
+  // Field by field decoding of one top level message whose bytes arrive
+  // piecemeal. Bytes the top level keeps until End() are copied to |kept|,
+  // everything else is converted while its field is fed.
+  void Begin(const MessagePlan<Object>& plan, std::deque<std::string>* kept) {
+    plan_ = &plan;
+    kept_ = kept;
+    ++depth_;
+    base_ = PushFrame(plan.fields.size());
+  }
+
+  // |reader| is positioned after the tag of a complete field.
+  bool Field(uint32_t number, WireType wire_type, WireReader& reader) {
+    const auto* entry = plan_->FindByNumber(number);
+    bool ok = wire_type != WireType::kEndGroup &&
+              (entry ? ScanField(*plan_, *entry, base_, number, wire_type,
+                                 reader)
+                     : reader.SkipField(number, wire_type));
+    if (!ok) {
+      parse_error_ = true;
+    }
+    return ok;
+  }
+
+  std::pair<ErrorCode, Object> End() {
+    std::pair<ErrorCode, Object> result{PBError::kPBParseError, {}};
+    if (!parse_error_ && CheckRequired(*plan_, base_)) {
+      result = Emit(*plan_, base_);
+    } else {
+      parse_error_ = true;
+    }
+    PopFrame(base_);
+    --depth_;
+    if (parse_error_) {
+      PB_LOG(ERROR) << "WireDecoder parse error";
+      return {PBError::kPBParseError, {}};
+    }
+    return result;
+  }
+
+ private:
+  struct FieldState {
+    bool seen = false;
+    // A repeated element failed to convert, later elements are dropped.
+    bool broken = false;
+    // A closed enum value was unknown, map entries holding it are dropped.
+    bool unknown_enum = false;
+    uint64_t bits = 0;
+    std::string_view bytes;
+    // Later occurrences of a singular sub message, merged into |bytes|.
+    std::vector<std::string_view> more;
+    // Elements of a lazy repeated message field.
+    std::vector<std::string_view> elements;
+    Object container{};
+  };
+
+  // Nesting allowed below the top level message, as in CodedInputStream.
+  static constexpr int kMaxDepth = 100;
+
+  // Occurrences of a sub message are scanned one by one into the same frame,
+  // which is what parsing each of them into one message does.
+  std::pair<ErrorCode, Object> DecodeMessage(
+      const MessagePlan<Object>& plan,
+      std::string_view data,
+      const std::vector<std::string_view>& more = {}) {
+    std::pair<ErrorCode, Object> result{PBError::kPBParseError, {}};
+    if (depth_ > kMaxDepth) {
+      parse_error_ = true;
+      return result;
+    }
+    ++depth_;
+    auto base = PushFrame(plan.fields.size());
+    bool ok = Scan(plan, data, base);
+    for (auto it = more.begin(); ok && it != more.end(); ++it) {
+      ok = Scan(plan, *it, base);
+    }
+    if (ok && CheckRequired(plan, base)) {
+      result = Emit(plan, base);
+    } else {
+      parse_error_ = true;
+    }
+    PopFrame(base);
+    --depth_;
+    return result;
+  }
+
+  // Walks a sub message as DecodeMessage does, required fields included
+  // unless |validating_|, without converting anything.
+  bool Check(const MessagePlan<Object>& plan,
+             std::string_view data,
+             const std::vector<std::string_view>& more = {}) {
+    if (depth_ > kMaxDepth) {
+      parse_error_ = true;
+      return false;
+    }
+    ++depth_;
+    ++checking_;
+    auto base = PushFrame(plan.fields.size());
+    bool ok = Scan(plan, data, base);
+    for (auto it = more.begin(); ok && it != more.end(); ++it) {
+      ok = Scan(plan, *it, base);
+    }
+    ok = ok && CheckRequired(plan, base);
+    for (std::size_t i = 0; ok && i < plan.fields.size(); ++i) {
+      const auto& entry = plan.fields[i];
+      if (!entry.Has(kFieldMessage) || entry.Has(kFieldRepeated) ||
+          !frames_[base + i].seen) {
+        continue;
+      }
+      // Nested frames may reallocate |frames_|.
+      auto bytes = frames_[base + i].bytes;
+      auto rest = std::move(frames_[base + i].more);
+      ok = Check(*entry.message, bytes, rest);
+    }
+    PopFrame(base);
+    --checking_;
+    --depth_;
+    if (!ok) {
+      parse_error_ = true;
+    }
+    return ok;
+  }
+
+  // Returns false if the entry must be dropped.
+  bool DecodeMapEntry(const MessagePlan<Object>& plan,
+                      std::string_view data,
+                      std::tuple<ErrorCode, Object, Object>* result) {
+    if (depth_ > kMaxDepth) {
+      parse_error_ = true;
+      return false;
+    }
+    ++depth_;
+    auto base = PushFrame(plan.fields.size());
+    bool keep = false;
+    if (!Scan(plan, data, base)) {
+      parse_error_ = true;
+    } else if (!frames_[base + 1].unknown_enum) {
+      keep = true;
+      auto key = EmitValue(plan.fields[0], base);
+      if (key.first) {
+        ValidateAbsent(plan, base, 1);
+        *result = {std::move(key.first), std::move(key.second), {}};
+      } else {
+        auto value = EmitValue(plan.fields[1], base + 1);
+        *result = {std::move(value.first), std::move(key.second),
+                   std::move(value.second)};
+      }
+    }
+    PopFrame(base);
+    --depth_;
+    return keep;
+  }
+
+  std::size_t PushFrame(std::size_t count) {
+    auto base = top_;
+    top_ += count;
+    if (frames_.size() < top_) {
+      frames_.resize(top_);
+    }
+    for (auto i = base; i < top_; ++i) {
+      frames_[i] = FieldState{};
+    }
+    return base;
+  }
+
+  void PopFrame(std::size_t base) { top_ = base; }
+
+  bool Scan(const MessagePlan<Object>& plan,
+            std::string_view data,
+            std::size_t base) {
+    WireReader reader(data);
+    uint32_t number = 0;
+    WireType wire_type;
+    while (!reader.done()) {
+      if (!reader.ReadTag(&number, &wire_type) ||
+          wire_type == WireType::kEndGroup) {
+        return false;
+      }
+      const auto* entry = plan.FindByNumber(number);
+      if (!entry) {
+        if (!reader.SkipField(number, wire_type)) {
+          return false;
+        }
+      } else if (!ScanField(plan, *entry, base, number, wire_type, reader)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool ScanField(const MessagePlan<Object>& plan,
+                 const FieldPlan<Object>& entry,
+                 std::size_t base,
+                 uint32_t number,
+                 WireType wire_type,
+                 WireReader& reader) {
+    uint64_t u64 = 0;
+    uint32_t u32 = 0;
+    std::string_view view;
+    const auto expected = ExpectedWireType(entry.type);
+    if (wire_type != expected) {
+      if (entry.Has(kFieldRepeated) &&
+          wire_type == WireType::kLengthDelimited &&
+          (expected == WireType::kVarint || expected == WireType::kFixed32 ||
+           expected == WireType::kFixed64)) {
+        return reader.ReadLengthDelimited(&view) &&
+               ScanPacked(plan, entry, base, expected, view);
+      }
+      return reader.SkipField(number, wire_type);
+    }
+    if (entry.Has(kFieldMasked)) {
+      // Only scanned to clear the other members of its oneof.
+      return SelectOneof(plan, entry, base) &&
+             reader.SkipField(number, wire_type);
+    }
+    switch (wire_type) {
+      case WireType::kVarint:
+        return reader.ReadVarint(&u64) && OnScalar(plan, entry, base, u64);
+      case WireType::kFixed32:
+        return reader.ReadFixed32(&u32) && OnScalar(plan, entry, base, u32);
+      case WireType::kFixed64:
+        return reader.ReadFixed64(&u64) && OnScalar(plan, entry, base, u64);
+      case WireType::kLengthDelimited:
+        return reader.ReadLengthDelimited(&view) &&
+               OnBytes(plan, entry, base, view);
+      case WireType::kStartGroup:
+        return reader.ReadGroup(number, &view) &&
+               OnBytes(plan, entry, base, view);
+      case WireType::kEndGroup:
+        return false;
+    }
+    return false;
+  }
+
+  bool ScanPacked(const MessagePlan<Object>& plan,
+                  const FieldPlan<Object>& entry,
+                  std::size_t base,
+                  WireType element,
+                  std::string_view run) {
+    WireReader reader(run);
+    uint64_t u64 = 0;
+    uint32_t u32 = 0;
+    while (!reader.done()) {
+      bool ok = false;
+      if (element == WireType::kVarint) {
+        ok = reader.ReadVarint(&u64);
+      } else if (element == WireType::kFixed32) {
+        ok = reader.ReadFixed32(&u32);
+        u64 = u32;
+      } else {
+        ok = reader.ReadFixed64(&u64);
+      }
+      if (!ok || !OnScalar(plan, entry, base, u64)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool OnScalar(const MessagePlan<Object>& plan,
+                const FieldPlan<Object>& entry,
+                std::size_t base,
+                uint64_t bits) {
+    const auto slot = base + entry.field->index();
+    switch (entry.field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32:
+      case FieldDescriptor::CPPTYPE_UINT32:
+      case FieldDescriptor::CPPTYPE_ENUM:
+        // 32 bit varints keep the low bits only.
+        bits = static_cast<uint32_t>(bits);
+        break;
+      default:
+        break;
+    }
+    if (entry.type == FieldDescriptor::TYPE_ENUM && IsClosedEnum(entry.field) &&
+        !entry.field->enum_type()->FindValueByNumber(
+            static_cast<int32_t>(bits))) {
+      // Unknown values of closed enums go to the unknown field set.
+      frames_[slot].unknown_enum = true;
+      return true;
+    }
+    if (entry.Has(kFieldRepeated)) {
+      auto& state = frames_[slot];
+      if (!state.broken && !checking_) {
+        Append(entry, state, Convert(entry, bits));
+      }
+      return true;
+    }
+    if (!SelectOneof(plan, entry, base)) {
+      return false;
+    }
+    auto& state = frames_[slot];
+    state.seen = true;
+    state.bits = bits;
+    return true;
+  }
+
+  bool OnBytes(const MessagePlan<Object>& plan,
+               const FieldPlan<Object>& entry,
+               std::size_t base,
+               std::string_view view) {
+    const auto slot = base + entry.field->index();
+    if (!entry.Has(kFieldMessage)) {
+      if (RequiresUtf8Validation(entry.field) && !IsValidUtf8(view)) {
+        PB_LOG(ERROR) << "WireDecoder invalid UTF-8, name: "
+                      << entry.field->name();
+        return false;
+      }
+      if (entry.Has(kFieldRepeated)) {
+        auto& state = frames_[slot];
+        if (!state.broken && !checking_) {
+          Append(entry, state, Bytes(entry.field, view));
+        }
+        return true;
+      }
+      if (!SelectOneof(plan, entry, base)) {
+        return false;
+      }
+      auto& state = frames_[slot];
+      state.seen = true;
+      state.bytes = Keep(view);
+      return true;
+    }
+
+    // Elements are decoded even after the field broke, a malformed one still
+    // fails the whole parse.
+    if (entry.Has(kFieldRepeated)) {
+      if (checking_) {
+        return Check(*entry.message, view);
+      }
+      if (entry.Has(kFieldMap)) {
+        std::tuple<ErrorCode, Object, Object> item;
+        if (!DecodeMapEntry(*entry.message, view, &item)) {
+          return !parse_error_;
+        }
+        auto& state = frames_[slot];
+        if (state.broken) {
+          return true;
+        }
+        if (std::get<0>(item)) {
+          state.broken = true;
+        } else {
+          if (!state.container) {
+            state.container = DictWrapper<Object, false>();
+          }
+          DictWrapper<Object, false>(state.container)
+              .Add(std::get<1>(item), std::get<2>(item));
+        }
+      } else if (lazy_bytes_) {
+        if (!validated_ && !Check(*entry.message, view)) {
+          return false;
+        }
+        frames_[slot].elements.push_back(view);
+      } else {
+        auto item = DecodeMessage(*entry.message, view);
+        if (parse_error_) {
+          return false;
+        }
+        auto& state = frames_[slot];
+        if (state.broken) {
+          return true;
+        }
+        if (item.first) {
+          state.broken = true;
+        } else {
+          Append(entry, state, item.second);
+        }
+      }
+      return true;
+    }
+
+    if (!SelectOneof(plan, entry, base)) {
+      return false;
+    }
+    auto& state = frames_[slot];
+    if (!state.seen) {
+      state.bytes = Keep(view);
+    } else {
+      state.more.push_back(Keep(view));
+    }
+    state.seen = true;
+    return true;
+  }
+
+  std::string_view Keep(std::string_view view) {
+    if (!kept_ || depth_ != 1) {
+      return view;
+    }
+    return kept_->emplace_back(view);
+  }
+
+  // Setting a oneof member clears the other members. The bytes of a cleared
+  // sub message are still validated, the parser would have read them.
+  bool SelectOneof(const MessagePlan<Object>& plan,
+                   const FieldPlan<Object>& entry,
+                   std::size_t base) {
+    const auto* oneof = entry.field->containing_oneof();
+    if (!oneof) {
+      return true;
+    }
+    for (int i = 0; i < oneof->field_count(); ++i) {
+      const auto* member = oneof->field(i);
+      if (member != entry.field && !Discard(plan.fields[member->index()],
+                                            base + member->index())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Drops the value of a singular field. Returns false if it was a malformed
+  // sub message.
+  bool Discard(const FieldPlan<Object>& entry, std::size_t slot) {
+    auto& state = frames_[slot];
+    if (!state.seen) {
+      return true;
+    }
+    state.seen = false;
+    if (!entry.Has(kFieldMessage) || validated_) {
+      return true;
+    }
+    auto bytes = state.bytes;
+    auto more = std::move(state.more);
+    ++validating_;
+    Check(*entry.message, bytes, more);
+    --validating_;
+    return !parse_error_;
+  }
+
+  // Validates the sub messages that emission starting at |index| will not
+  // decode any more.
+  void ValidateAbsent(const MessagePlan<Object>& plan,
+                      std::size_t base,
+                      std::size_t index) {
+    for (; index < plan.fields.size() && !parse_error_; ++index) {
+      const auto& entry = plan.fields[index];
+      if (!entry.Has(kFieldRepeated)) {
+        Discard(entry, base + index);
+      }
+    }
+  }
+
+  void Append(const FieldPlan<Object>& entry,
+              FieldState& state,
+              Object value) {
+    if (!value) {
+      state.broken = true;
+      return;
+    }
+    if (!state.container) {
+      state.container = ArrayWrapper<Object, false>();
+    }
+    ArrayWrapper<Object, false>(state.container).Add(value);
+  }
+
+  bool CheckRequired(const MessagePlan<Object>& plan, std::size_t base) {
+    if (validating_) {
+      return true;
+    }
+    for (const auto& entry : plan.fields) {
+      if (entry.Has(kFieldRequired) && !entry.Has(kFieldMasked) &&
+          !frames_[base + entry.field->index()].seen) {
+        PB_LOG(ERROR) << "WireDecoder missing required field: "
+                      << entry.field->full_name();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool IsPresent(const FieldPlan<Object>& entry,
+                        const FieldState& state) {
+    if (!state.seen) {
+      return false;
+    }
+    if (entry.Has(kFieldHasPresence)) {
+      return true;
+    }
+    // Fields without presence are only set when they differ from zero.
+    return entry.type == FieldDescriptor::TYPE_STRING ||
+                   entry.type == FieldDescriptor::TYPE_BYTES
+               ? !state.bytes.empty()
+               : state.bits != 0;
+  }
+
+  std::pair<ErrorCode, Object> Emit(const MessagePlan<Object>& plan,
+                                    std::size_t base) {
+    DictWrapper<Object, false> object_wrapper;
+    std::pair<ErrorCode, Object> result;
+
+    for (std::size_t i = 0; i < plan.fields.size(); ++i) {
+      const auto& entry = plan.fields[i];
+      const auto slot = base + i;
+      if (entry.Has(kFieldMasked)) {
+        continue;
+      } else if (entry.Has(kFieldRepeated)) {
+        auto& container = frames_[slot].container;
+        if (lazy_bytes_ && entry.Has(kFieldMessage) && !entry.Has(kFieldMap)) {
+          container = MakeLazy(std::make_shared<LazyRepeated<Object>>(
+              *entry.message, options_, lazy_bytes_,
+              std::move(frames_[slot].elements)));
+        } else if (!container) {
+          container = entry.Has(kFieldMap)
+                          ? static_cast<Object>(DictWrapper<Object, false>())
+                          : static_cast<Object>(ArrayWrapper<Object, false>());
+        }
+        result = {container ? CommonError::SUCCESS : CommonError::FAILED,
+                  container};
+      } else if (entry.Has(kFieldSkipIfAbsent) &&
+                 !IsPresent(entry, frames_[slot])) {
+        continue;
+      } else {
+        result = EmitValue(entry, slot);
+      }
+      if (result.first) {
+        ValidateAbsent(plan, base, i + 1);
+        break;
+      } else {
+        object_wrapper.Add(entry.platform_key, result.second);
+      }
+    }
+    return {std::move(result.first), object_wrapper};
+  }
+
+  // Converts a singular field, falling back to its default when absent.
+  std::pair<ErrorCode, Object> EmitValue(const FieldPlan<Object>& entry,
+                                         std::size_t slot) {
+    const bool present = IsPresent(entry, frames_[slot]);
+    if (entry.Has(kFieldMessage) && lazy_bytes_) {
+      std::vector<std::string_view> slices;
+      if (present) {
+        auto& state = frames_[slot];
+        state.seen = false;
+        auto bytes = state.bytes;
+        auto more = std::move(state.more);
+        if (!validated_ && !Check(*entry.message, bytes, more)) {
+          return {PBError::kPBParseError, {}};
+        }
+        slices.push_back(bytes);
+        slices.insert(slices.end(), more.begin(), more.end());
+      }
+      auto object = MakeLazy(std::make_shared<LazyMessage<Object>>(
+          *entry.message, options_, lazy_bytes_, std::move(slices)));
+      return {object ? CommonError::SUCCESS : CommonError::FAILED, object};
+    }
+    if (entry.Has(kFieldMessage)) {
+      if (!present && !entry.message->has_required) {
+        return DefaultObject(*entry.message, options_, [&] {
+          return DecodeMessage(*entry.message, {});
+        });
+      } else if (!present) {
+        return DecodeMessage(*entry.message, {});
+      }
+      // Nested frames may reallocate |frames_|.
+      auto& state = frames_[slot];
+      state.seen = false;
+      auto bytes = state.bytes;
+      auto more = std::move(state.more);
+      return DecodeMessage(*entry.message, bytes, more);
+    }
+
+    Object object{};
+    if (entry.type == FieldDescriptor::TYPE_STRING ||
+        entry.type == FieldDescriptor::TYPE_BYTES) {
+      object = present ? Bytes(entry.field, frames_[slot].bytes)
+                       : serializer_.to_platform(
+                             entry.field, entry.field->default_value_string());
+    } else if (present) {
+      object = Convert(entry, frames_[slot].bits);
+    } else {
+      object = ConvertDefault(entry);
+    }
+    return {object ? CommonError::SUCCESS : CommonError::FAILED, object};
+  }
+
+  Object Convert(const FieldPlan<Object>& entry, uint64_t bits) {
+    const auto* field = entry.field;
+    switch (entry.type) {
+      case FieldDescriptor::TYPE_INT32:
+      case FieldDescriptor::TYPE_SFIXED32:
+      case FieldDescriptor::TYPE_ENUM:
+        return serializer_.to_platform(field, static_cast<int32_t>(bits));
+      case FieldDescriptor::TYPE_SINT32:
+        return serializer_.to_platform(
+            field, ZigZagDecode32(static_cast<uint32_t>(bits)));
+      case FieldDescriptor::TYPE_UINT32:
+      case FieldDescriptor::TYPE_FIXED32:
+        return serializer_.to_platform(field, static_cast<uint32_t>(bits));
+      case FieldDescriptor::TYPE_INT64:
+      case FieldDescriptor::TYPE_SFIXED64:
+        return serializer_.to_platform(field, static_cast<int64_t>(bits));
+      case FieldDescriptor::TYPE_SINT64:
+        return serializer_.to_platform(field, ZigZagDecode64(bits));
+      case FieldDescriptor::TYPE_UINT64:
+      case FieldDescriptor::TYPE_FIXED64:
+        return serializer_.to_platform(field, bits);
+      case FieldDescriptor::TYPE_FLOAT:
+        return serializer_.to_platform(
+            field, std::bit_cast<float>(static_cast<uint32_t>(bits)));
+      case FieldDescriptor::TYPE_DOUBLE:
+        return serializer_.to_platform(field, std::bit_cast<double>(bits));
+      case FieldDescriptor::TYPE_BOOL:
+        return serializer_.to_platform(field, bits != 0);
+      default:
+        return {};
+    }
+  }
+
+  Object ConvertDefault(const FieldPlan<Object>& entry) {
+    const auto* field = entry.field;
+    switch (field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        return serializer_.to_platform(field, field->default_value_int32());
+      case FieldDescriptor::CPPTYPE_UINT32:
+        return serializer_.to_platform(field, field->default_value_uint32());
+      case FieldDescriptor::CPPTYPE_INT64:
+        return serializer_.to_platform(field, field->default_value_int64());
+      case FieldDescriptor::CPPTYPE_UINT64:
+        return serializer_.to_platform(field, field->default_value_uint64());
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        return serializer_.to_platform(field, field->default_value_float());
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        return serializer_.to_platform(field, field->default_value_double());
+      case FieldDescriptor::CPPTYPE_BOOL:
+        return serializer_.to_platform(field, field->default_value_bool());
+      case FieldDescriptor::CPPTYPE_ENUM:
+        return serializer_.to_platform(field,
+                                       field->default_value_enum()->number());
+      default:
+        return {};
+    }
+  }
+
+  // A string or bytes value of the payload, borrowed when possible.
+  Object Bytes(const FieldDescriptor* field, std::string_view view) {
+    if constexpr (requires {
+                    serializer_.to_platform(field, view, data_owner_);
+                  }) {
+      if (data_owner_) {
+        return serializer_.to_platform(field, view, data_owner_);
+      }
+    }
+    return serializer_.to_platform(field, view);
+  }
+
+  const PBOptions& options_;
+  FieldSerializer<Object> serializer_;
+  std::vector<FieldState> frames_;
+  std::size_t top_ = 0;
+  int depth_ = 0;
+  // Nonzero while checking bytes whose value is dropped.
+  int validating_ = 0;
+  // Nonzero while walking bytes without converting them, see Check().
+  int checking_ = 0;
+  bool parse_error_ = false;
+  LazyBytes lazy_bytes_;
+  // Sub messages of |lazy_bytes_| were checked already.
+  bool validated_ = false;
+  std::shared_ptr<const void> data_owner_;
+  // Set between Begin() and End().
+  const MessagePlan<Object>* plan_ = nullptr;
+  std::deque<std::string>* kept_ = nullptr;
+  std::size_t base_ = 0;
+};
+
+template <typename Object>
+std::pair<ErrorCode, Object> from_wire(
+    const MessagePlan<Object>& plan,
+    std::string_view data,
+    const PBOptions& options,
+    const std::shared_ptr<const void>& owner,
+    const std::shared_ptr<const void>& data_owner) {
+  if (options.lazy) {
+    // Lazy containers keep the payload, copied only when nothing owns it,
+    // and |owner|, and with it |plan|, alive.
+    struct Payload {
+      std::string copy;
+      std::shared_ptr<const void> data_owner;
+      std::shared_ptr<const void> owner;
+    };
+    auto payload = std::make_shared<const Payload>(
+        Payload{.copy = data_owner ? std::string() : std::string(data),
+                .data_owner = data_owner,
+                .owner = owner});
+    if (!data_owner) {
+      data = payload->copy;
+    }
+    return WireDecoder<Object>(options, payload).Decode(plan, data);
+  }
+  return WireDecoder<Object>(options, nullptr, data_owner).Decode(plan, data);
+}
+
+template <typename Object>
+Object LazyMessage<Object>::Get() {
+  std::call_once(once_, [this] {
+    std::string_view data = slices_.empty() ? std::string_view() : slices_[0];
+    std::vector<std::string_view> more;
+    if (slices_.size() > 1) {
+      more.assign(slices_.begin() + 1, slices_.end());
+    }
+    auto result = WireDecoder<Object>(options_, bytes_, nullptr, true)
+                      .Decode(plan_, data, more);
+    if (!result.first) {
+      value_ = result.second;
+    }
+  });
+  return value_;
+}
+
+template <typename Object>
+Object LazyRepeated<Object>::At(std::size_t index) {
+  std::call_once(once_[index], [this, index] {
+    values_[index] = MakeLazy(std::make_shared<LazyMessage<Object>>(
+        plan_, options_, bytes_, std::vector<std::string_view>{
+                                     elements_[index]}));
+  });
+  return values_[index];
+}
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_WIRE_DECODER_H_
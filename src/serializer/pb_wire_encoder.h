@@ -0,0 +1,664 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_WIRE_ENCODER_H_
+#define CONVERT_SRC_SERIALIZER_PB_WIRE_ENCODER_H_
+
+#include <google/protobuf/descriptor.pb.h>
+
+#include <list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "serializer/pb_serializer.h"
+#include "serializer/pb_wire_format.h"
+
+namespace magic::pb {
+// Encodes platform objects straight to wire format, guided by a MessagePlan.
+// The first pass walks the object like to_pb does, converting values and
+// computing every sub message size into a side table; the second pass writes
+// the bytes. Output, errors and WarnningFields match to_pb followed by
+// SerializeWithCachedSizesToArray.
+template <typename Object>
+class WireEncoder {
+ public:
+  WireEncoder(const PBOptions& options, WarnningFields* warnning_fields)
+      : serializer_(options), warnning_fields_(warnning_fields) {
+    SwapReused();
+  }
+
+  ~WireEncoder() {
+    Recycle(&values_);
+    Recycle(&slots_);
+    Recycle(&fields_);
+    Recycle(&nodes_);
+    Recycle(&pinned_);
+    SwapReused();
+  }
+
+  WireEncoder(const WireEncoder&) = delete;
+  WireEncoder& operator=(const WireEncoder&) = delete;
+
+  template <typename Buffer>
+  ErrorCode Encode(const MessagePlan<Object>& plan,
+                   Object object,
+                   Buffer* buffer) {
+    auto root = NewNode(plan);
+    if (auto error_code = EncodeMessage(plan, object, root)) {
+      return error_code;
+    }
+    buffer->resize(nodes_[root].size);
+    WireWriter writer(reinterpret_cast<uint8_t*>(
+        const_cast<typename Buffer::value_type*>(buffer->data())));
+    Write(root, writer);
+    return CommonError::SUCCESS;
+  }
+
+  // Writes to |out| only if the message fits, |size| gets its size either
+  // way.
+  ErrorCode Encode(const MessagePlan<Object>& plan,
+                   Object object,
+                   std::span<uint8_t> out,
+                   std::size_t* size) {
+    auto root = NewNode(plan);
+    if (auto error_code = EncodeMessage(plan, object, root)) {
+      return error_code;
+    }
+    *size = nodes_[root].size;
+    if (*size <= out.size()) {
+      WireWriter writer(out.data());
+      Write(root, writer);
+    }
+    return CommonError::SUCCESS;
+  }
+
+ private:
+  struct Value {
+    uint64_t bits = 0;
+    std::string_view bytes;
+    // Node of a sub message or map entry.
+    int32_t node = -1;
+    // Next value of the same field.
+    int32_t next = -1;
+  };
+
+  struct Slot {
+    int32_t first = -1;
+    int32_t last = -1;
+  };
+
+  // A field that is serialized, in field number order within its node.
+  struct Field {
+    const FieldPlan<Object>* entry = nullptr;
+    int32_t first = -1;
+    // Packed payload, or the merged body of a singular sub message.
+    std::size_t size = 0;
+  };
+
+  struct Node {
+    const MessagePlan<Object>* plan = nullptr;
+    std::size_t size = 0;
+    std::size_t fields_begin = 0;
+    std::size_t fields_end = 0;
+    // Required fields of this message and all sub messages are set.
+    bool initialized = true;
+  };
+
+  // Capacity in bytes a container keeps for the next encoder on the thread,
+  // as ArenaConfig::max_retained_size does for arenas.
+  static constexpr std::size_t kMaxRetainedSize = 1024 * 1024;
+
+  // Empties |items|, releasing its storage past kMaxRetainedSize.
+  template <typename T>
+  static void Recycle(std::vector<T>* items) {
+    if (items->capacity() * sizeof(T) > kMaxRetainedSize) {
+      std::vector<T>().swap(*items);
+    } else {
+      items->clear();
+    }
+  }
+
+  // The containers of the last encoder on this thread, so steady state
+  // encodes reuse their capacity instead of allocating.
+  struct Reused {
+    std::vector<Value> values;
+    std::vector<Slot> slots;
+    std::vector<Field> fields;
+    std::vector<Node> nodes;
+    std::vector<Object> pinned;
+  };
+
+  void SwapReused() {
+    thread_local Reused reused;
+    values_.swap(reused.values);
+    slots_.swap(reused.slots);
+    fields_.swap(reused.fields);
+    nodes_.swap(reused.nodes);
+    pinned_.swap(reused.pinned);
+  }
+
+  int32_t NewNode(const MessagePlan<Object>& plan) {
+    nodes_.push_back(Node{.plan = &plan});
+    return static_cast<int32_t>(nodes_.size() - 1);
+  }
+
+  std::size_t PushSlots(std::size_t count) {
+    auto base = top_;
+    top_ += count;
+    if (slots_.size() < top_) {
+      slots_.resize(top_);
+    }
+    std::fill(slots_.begin() + base, slots_.begin() + top_, Slot{});
+    return base;
+  }
+
+  void PopSlots(std::size_t base) { top_ = base; }
+
+  void Append(std::size_t slot, const Value& value) {
+    values_.push_back(value);
+    auto index = static_cast<int32_t>(values_.size() - 1);
+    auto& state = slots_[slot];
+    if (state.last < 0) {
+      state.first = index;
+    } else {
+      values_[state.last].next = index;
+    }
+    state.last = index;
+  }
+
+  void Set(std::size_t slot, const Value& value) {
+    slots_[slot] = Slot{};
+    Append(slot, value);
+  }
+
+  // Setting a oneof member clears the other members.
+  void SelectOneof(const MessagePlan<Object>& plan,
+                   const FieldPlan<Object>& entry,
+                   std::size_t base) {
+    if (const auto* oneof = entry.field->containing_oneof()) {
+      for (int i = 0; i < oneof->field_count(); ++i) {
+        if (oneof->field(i) != entry.field) {
+          slots_[base + oneof->field(i)->index()] = Slot{};
+        }
+      }
+    }
+  }
+
+  ErrorCode EncodeMessage(const MessagePlan<Object>& plan,
+                          Object object,
+                          int32_t node) {
+    auto base = PushSlots(plan.slot_count());
+    bool empty = false;
+    auto error_code = Walk(plan, object, base, &empty);
+    Finish(plan, base, node);
+    PopSlots(base);
+    if (error_code || nodes_[node].initialized) {
+      return error_code;
+    }
+    if (empty) {
+      return CommonError::MISSING_ARG;
+    }
+    return MakeErrorCode(CommonError::MISSING_ARG,
+                         InitializationErrorString(node),
+                         plan.descriptor->full_name());
+  }
+
+  ErrorCode Walk(const MessagePlan<Object>& plan,
+                 Object object,
+                 std::size_t base,
+                 bool* empty) {
+    *empty = true;
+    ErrorCode error_code = CommonError::SUCCESS;
+    std::string key;
+    ForEachEntry<Object>(object, [&](Object k, Object v) {
+      *empty = false;
+      if (TypeCheck<Object>(k).IsNullOrUndefined() ||
+          TypeCheck<Object>(v).IsNullOrUndefined()) {
+        return true;
+      }
+      const auto* entry =
+          plan.FindByName(KeySerializer<Object>().from_platform(k, &key));
+      if (!entry) {
+        return true;
+      }
+      error_code = WalkField(plan, entry, v, base);
+      return !error_code;
+    });
+    return error_code;
+  }
+
+  // Records the value |v| of the key that resolved to |entry|.
+  ErrorCode WalkField(const MessagePlan<Object>& plan,
+                      const FieldPlan<Object>* entry,
+                      Object v,
+                      std::size_t base) {
+    const auto* descriptor = plan.descriptor;
+    const auto* field = entry->field;
+    if (!entry->Has(kFieldMessage) && !entry->to_pb) {
+      assert(false);
+      PB_LOG(ERROR) << "to_wire field ConvertFunction not found: "
+                    << field->cpp_type() << ", " << field->name() << ", "
+                    << descriptor->full_name();
+      return MakeErrorCode(PBError::kNoConvertFunction, field->name(),
+                           descriptor->full_name());
+    }
+    const auto slot = base + plan.SlotOf(entry);
+
+    if (entry->Has(kFieldRepeated)) {
+      TypeCheck<Object> type_check(v);
+      const bool is_map = entry->Has(kFieldMap);
+      if ((is_map && (type_check.IsArray() || !type_check.IsDict())) ||
+          (!is_map && !type_check.IsArray())) {
+        PB_LOG(ERROR) << "to_wire MESSAGE error: "
+                      << "name: " << field->name();
+        return MakeErrorCode(CommonError::ARG_TYPE_ERROR, field->name(),
+                             descriptor->full_name());
+      }
+      ErrorCode error_code = CommonError::SUCCESS;
+      if (is_map) {
+        ForEachEntry<Object>(v, [&](Object property_key,
+                                    Object property_value) {
+          auto item = NewNode(*entry->message);
+          Append(slot, Value{.node = item});
+          error_code = EncodeMapEntry(*entry->message, property_key,
+                                      property_value, item);
+          return !error_code;
+        });
+      } else {
+        if (auto size = SizeHint<Object>(v)) {
+          values_.reserve(values_.size() + size);
+          if (entry->Has(kFieldMessage)) {
+            nodes_.reserve(nodes_.size() + size);
+          }
+        }
+        ForEachElement<Object>(v, [&](Object array_item) {
+          if (entry->Has(kFieldMessage)) {
+            auto item = NewNode(*entry->message);
+            Append(slot, Value{.node = item});
+            error_code = EncodeMessage(*entry->message, array_item, item);
+          } else {
+            Value value;
+            error_code = Convert(*entry, array_item, &value);
+            if (!error_code) {
+              Append(slot, value);
+            }
+          }
+          return !error_code;
+        });
+      }
+      return error_code ? MakeErrorCode(error_code, field->name(),
+                                        descriptor->full_name())
+                        : error_code;
+    }
+
+    ErrorCode error_code;
+    if (entry->Has(kFieldMessage)) {
+      // Like MutableMessage, a repeated key merges into the same message.
+      SelectOneof(plan, *entry, base);
+      auto item = NewNode(*entry->message);
+      Append(slot, Value{.node = item});
+      error_code = EncodeMessage(*entry->message, v, item);
+    } else {
+      Value value;
+      error_code = Convert(*entry, v, &value);
+      if (!error_code) {
+        SelectOneof(plan, *entry, base);
+        Set(slot, value);
+      }
+    }
+    if (error_code &&
+        (!IngoreErrorWhenConvertToPbOptionalField<Object>::value ||
+         !entry->Has(kFieldOptional))) {
+      return MakeErrorCode(error_code, field->name(), descriptor->full_name());
+    } else if (error_code) {
+      AddWarnningField(warnning_fields_, descriptor, field);
+    }
+    return CommonError::SUCCESS;
+  }
+
+  ErrorCode EncodeMapEntry(const MessagePlan<Object>& plan,
+                           Object k,
+                           Object v,
+                           int32_t node) {
+    const auto& key = plan.fields[0];
+    const auto& value = plan.fields[1];
+    auto base = PushSlots(plan.slot_count());
+    ErrorCode error_code;
+    Value item;
+    if (!key.to_pb) {
+      assert(false);
+      PB_LOG(ERROR) << "to_wire map key ConvertFunction not found: "
+                    << key.field->cpp_type();
+      error_code = PBError::kNoConvertFunction;
+    } else if (!(error_code = Convert(key, k, &item))) {
+      Set(base, item);
+      if (value.Has(kFieldMessage)) {
+        item = Value{.node = NewNode(*value.message)};
+        Set(base + 1, item);
+        error_code = EncodeMessage(*value.message, v, item.node);
+      } else if (!value.to_pb) {
+        assert(false);
+        PB_LOG(ERROR) << "to_wire map value ConvertFunction not found: "
+                      << value.field->cpp_type();
+        error_code = PBError::kNoConvertFunction;
+      } else if (!(error_code = Convert(value, v, &item))) {
+        Set(base + 1, item);
+      }
+    }
+    Finish(plan, base, node);
+    PopSlots(base);
+    return error_code;
+  }
+
+  template <typename T>
+  ErrorCode FromPlatform(const FieldPlan<Object>& entry,
+                         Object object,
+                         T* value) {
+    return serializer_.from_platform(entry.field, object, value);
+  }
+
+  // Converts |object| to the value written on the wire for |entry|.
+  ErrorCode Convert(const FieldPlan<Object>& entry,
+                    Object object,
+                    Value* value) {
+    ErrorCode error_code;
+    switch (entry.field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32: {
+        int32_t v = 0;
+        error_code = FromPlatform(entry, object, &v);
+        value->bits = entry.type == FieldDescriptor::TYPE_SINT32
+                          ? ZigZagEncode32(v)
+                      : entry.type == FieldDescriptor::TYPE_SFIXED32
+                          ? static_cast<uint32_t>(v)
+                          : static_cast<uint64_t>(static_cast<int64_t>(v));
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_UINT32: {
+        uint32_t v = 0;
+        error_code = FromPlatform(entry, object, &v);
+        value->bits = v;
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_INT64: {
+        int64_t v = 0;
+        error_code = FromPlatform(entry, object, &v);
+        value->bits = entry.type == FieldDescriptor::TYPE_SINT64
+                          ? ZigZagEncode64(v)
+                          : static_cast<uint64_t>(v);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_UINT64:
+        error_code = FromPlatform(entry, object, &value->bits);
+        break;
+      case FieldDescriptor::CPPTYPE_FLOAT: {
+        float v = 0;
+        error_code = FromPlatform(entry, object, &v);
+        value->bits = std::bit_cast<uint32_t>(v);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_DOUBLE: {
+        double v = 0;
+        error_code = FromPlatform(entry, object, &v);
+        value->bits = std::bit_cast<uint64_t>(v);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_BOOL: {
+        bool v = false;
+        error_code = FromPlatform(entry, object, &v);
+        value->bits = v;
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_ENUM: {
+        const EnumValueDescriptor* v = nullptr;
+        error_code = FromPlatform(entry, object, &v);
+        value->bits =
+            v ? static_cast<uint64_t>(static_cast<int64_t>(v->number())) : 0;
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_STRING: {
+        std::string scratch;
+        error_code = serializer_.from_platform(entry.field, object,
+                                               &value->bytes, &scratch);
+        if (!scratch.empty()) {
+          value->bytes = scratch_.emplace_back(std::move(scratch));
+        } else if (!error_code) {
+          pinned_.push_back(object);
+        }
+        break;
+      }
+      default:
+        error_code = PBError::kNoConvertFunction;
+        break;
+    }
+    return error_code;
+  }
+
+  static bool IsZero(const FieldPlan<Object>& entry, const Value& value) {
+    return entry.type == FieldDescriptor::TYPE_STRING ||
+                   entry.type == FieldDescriptor::TYPE_BYTES
+               ? value.bytes.empty()
+               : value.bits == 0;
+  }
+
+  std::size_t ValueSize(const FieldPlan<Object>& entry, const Value& value) {
+    switch (ExpectedWireType(entry.type)) {
+      case WireType::kFixed32:
+        return 4;
+      case WireType::kFixed64:
+        return 8;
+      case WireType::kLengthDelimited:
+        if (value.node >= 0) {
+          return VarintSize(nodes_[value.node].size) + nodes_[value.node].size;
+        }
+        return VarintSize(value.bytes.size()) + value.bytes.size();
+      case WireType::kStartGroup:
+        return nodes_[value.node].size;
+      default:
+        return VarintSize(value.bits);
+    }
+  }
+
+  // Lays out the fields of a finished message in field number order and
+  // computes its size.
+  void Finish(const MessagePlan<Object>& plan, std::size_t base, int32_t node) {
+    std::size_t size = 0;
+    bool initialized = true;
+    // Map entry keys and values are written even when zero.
+    const bool map_entry = plan.descriptor->options().map_entry();
+    const auto fields_begin = fields_.size();
+    for (auto index : plan.order) {
+      const auto& entry = plan.AtSlot(index);
+      const auto& slot = slots_[base + index];
+      if (slot.first < 0) {
+        initialized &= !entry.Has(kFieldRequired);
+        continue;
+      }
+      if (!map_entry && !entry.Has(kFieldRepeated) &&
+          !entry.Has(kFieldHasPresence) && IsZero(entry, values_[slot.first])) {
+        continue;
+      }
+
+      Field field{.entry = &entry, .first = slot.first};
+      const auto number = static_cast<uint32_t>(entry.field->number());
+      const auto tag_size = VarintSize(MakeTag(number, WireType::kVarint));
+      for (auto i = slot.first; i >= 0; i = values_[i].next) {
+        if (values_[i].node >= 0) {
+          initialized &= nodes_[values_[i].node].initialized;
+        }
+      }
+      if (entry.Has(kFieldPacked)) {
+        for (auto i = slot.first; i >= 0; i = values_[i].next) {
+          field.size += ValueSize(entry, values_[i]);
+        }
+        size += tag_size + VarintSize(field.size) + field.size;
+      } else if (entry.Has(kFieldMessage) && !entry.Has(kFieldRepeated)) {
+        for (auto i = slot.first; i >= 0; i = values_[i].next) {
+          field.size += nodes_[values_[i].node].size;
+        }
+        size += entry.type == FieldDescriptor::TYPE_GROUP
+                    ? 2 * tag_size + field.size
+                    : tag_size + VarintSize(field.size) + field.size;
+      } else {
+        const auto element_tag_size =
+            entry.type == FieldDescriptor::TYPE_GROUP ? 2 * tag_size
+                                                      : tag_size;
+        for (auto i = slot.first; i >= 0; i = values_[i].next) {
+          size += element_tag_size + ValueSize(entry, values_[i]);
+        }
+      }
+      fields_.push_back(field);
+    }
+    auto& result = nodes_[node];
+    result.size = size;
+    result.fields_begin = fields_begin;
+    result.fields_end = fields_.size();
+    result.initialized = initialized;
+  }
+
+  void WriteValue(const FieldPlan<Object>& entry,
+                  const Value& value,
+                  WireWriter& writer) {
+    switch (ExpectedWireType(entry.type)) {
+      case WireType::kFixed32:
+        writer.WriteFixed32(static_cast<uint32_t>(value.bits));
+        break;
+      case WireType::kFixed64:
+        writer.WriteFixed64(value.bits);
+        break;
+      case WireType::kLengthDelimited:
+        if (value.node >= 0) {
+          writer.WriteVarint(nodes_[value.node].size);
+          Write(value.node, writer);
+        } else {
+          writer.WriteVarint(value.bytes.size());
+          writer.WriteBytes(value.bytes);
+        }
+        break;
+      case WireType::kStartGroup:
+        Write(value.node, writer);
+        break;
+      default:
+        writer.WriteVarint(value.bits);
+        break;
+    }
+  }
+
+  void Write(int32_t node, WireWriter& writer) {
+    const auto fields_begin = nodes_[node].fields_begin;
+    const auto fields_end = nodes_[node].fields_end;
+    for (auto f = fields_begin; f < fields_end; ++f) {
+      const auto& field = fields_[f];
+      const auto& entry = *field.entry;
+      const auto number = static_cast<uint32_t>(entry.field->number());
+      const auto wire_type = ExpectedWireType(entry.type);
+      if (entry.Has(kFieldPacked)) {
+        writer.WriteTag(number, WireType::kLengthDelimited);
+        writer.WriteVarint(field.size);
+        for (auto i = field.first; i >= 0; i = values_[i].next) {
+          WriteValue(entry, values_[i], writer);
+        }
+      } else if (entry.Has(kFieldMessage) && !entry.Has(kFieldRepeated)) {
+        writer.WriteTag(number, wire_type);
+        if (wire_type == WireType::kLengthDelimited) {
+          writer.WriteVarint(field.size);
+        }
+        for (auto i = field.first; i >= 0; i = values_[i].next) {
+          Write(values_[i].node, writer);
+        }
+        if (wire_type == WireType::kStartGroup) {
+          writer.WriteTag(number, WireType::kEndGroup);
+        }
+      } else {
+        for (auto i = field.first; i >= 0; i = values_[i].next) {
+          writer.WriteTag(number, wire_type);
+          WriteValue(entry, values_[i], writer);
+          if (wire_type == WireType::kStartGroup) {
+            writer.WriteTag(number, WireType::kEndGroup);
+          }
+        }
+      }
+    }
+  }
+
+  // Same text as Message::InitializationErrorString.
+  std::string InitializationErrorString(int32_t node) {
+    std::vector<std::string> errors;
+    FindInitializationErrors(node, "", &errors);
+    std::string result;
+    for (const auto& error : errors) {
+      if (!result.empty()) {
+        result += ", ";
+      }
+      result += error;
+    }
+    return result;
+  }
+
+  void FindInitializationErrors(int32_t node,
+                                const std::string& prefix,
+                                std::vector<std::string>* errors) {
+    const auto& plan = *nodes_[node].plan;
+    const auto fields_begin = fields_.begin() + nodes_[node].fields_begin;
+    const auto fields_end = fields_.begin() + nodes_[node].fields_end;
+    for (const auto& entry : plan.fields) {
+      if (entry.Has(kFieldRequired) &&
+          std::none_of(fields_begin, fields_end, [&entry](const Field& field) {
+            return field.entry == &entry;
+          })) {
+        errors->push_back(prefix + entry.field->name());
+      }
+    }
+    for (auto it = fields_begin; it != fields_end; ++it) {
+      const auto* field = it->entry->field;
+      if (!it->entry->Has(kFieldMessage)) {
+        continue;
+      }
+      auto name = prefix + (field->is_extension()
+                                ? "(" + field->full_name() + ")"
+                                : field->name());
+      int index = 0;
+      for (auto i = it->first; i >= 0; i = values_[i].next, ++index) {
+        FindInitializationErrors(
+            values_[i].node,
+            field->is_repeated() ? name + "[" + std::to_string(index) + "]."
+                                 : name + ".",
+            errors);
+      }
+    }
+  }
+
+  FieldSerializer<Object> serializer_;
+  WarnningFields* warnning_fields_ = nullptr;
+  std::vector<Value> values_;
+  std::vector<Slot> slots_;
+  std::size_t top_ = 0;
+  std::vector<Field> fields_;
+  std::vector<Node> nodes_;
+  // Stable storage for converted strings that have no bytes of their own.
+  std::list<std::string> scratch_;
+  // Objects whose bytes are referenced until the write pass.
+  std::vector<Object> pinned_;
+};
+
+template <typename Object, typename Buffer>
+ErrorCode to_wire(const MessagePlan<Object>& plan,
+                  Object object,
+                  Buffer* buffer,
+                  WarnningFields* warnning_fields,
+                  const PBOptions& options) {
+  return WireEncoder<Object>(options, warnning_fields)
+      .Encode(plan, object, buffer);
+}
+
+template <typename Object>
+ErrorCode to_wire(const MessagePlan<Object>& plan,
+                  Object object,
+                  std::span<uint8_t> out,
+                  std::size_t* size,
+                  WarnningFields* warnning_fields,
+                  const PBOptions& options) {
+  return WireEncoder<Object>(options, warnning_fields)
+      .Encode(plan, object, out, size);
+}
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_WIRE_ENCODER_H_
@@ -0,0 +1,126 @@
+#include "serializer/pb_wire_format.h"
+
+#include <google/protobuf/stubs/common.h>
+
+#include <algorithm>
+
+namespace magic::pb {
+namespace {
+constexpr int kMaxGroupDepth = 100;
+
+// Whether |data| may be the beginning of a varint of at most |max| bytes.
+bool IsVarintPrefix(std::string_view data, std::size_t max) {
+  return data.size() < max &&
+         std::all_of(data.begin(), data.end(),
+                     [](char c) { return static_cast<uint8_t>(c) >= 0x80; });
+}
+}  // namespace
+
+bool WireReader::ReadVarintSlow(uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && ptr_ < end_; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*ptr_++);
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      return true;
+    }
+  }
+  ptr_ = end_;
+  return false;
+}
+
+bool WireReader::ReadGroup(uint32_t field_number, std::string_view* body) {
+  const char* begin = ptr_;
+  int depth = 1;
+  uint32_t number = 0;
+  WireType wire_type;
+  while (depth > 0) {
+    const char* tag_begin = ptr_;
+    if (!ReadTag(&number, &wire_type)) {
+      return false;
+    }
+    if (wire_type == WireType::kStartGroup) {
+      if (++depth > kMaxGroupDepth) {
+        return false;
+      }
+    } else if (wire_type == WireType::kEndGroup) {
+      if (--depth == 0) {
+        if (number != field_number) {
+          return false;
+        }
+        *body = std::string_view(begin, tag_begin - begin);
+      }
+    } else if (!SkipField(number, wire_type)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WireReader::SkipField(uint32_t field_number, WireType wire_type) {
+  uint64_t u64 = 0;
+  uint32_t u32 = 0;
+  std::string_view view;
+  switch (wire_type) {
+    case WireType::kVarint:
+      return ReadVarint(&u64);
+    case WireType::kFixed64:
+      return ReadFixed64(&u64);
+    case WireType::kLengthDelimited:
+      return ReadLengthDelimited(&view);
+    case WireType::kStartGroup:
+      return ReadGroup(field_number, &view);
+    case WireType::kFixed32:
+      return ReadFixed32(&u32);
+    case WireType::kEndGroup:
+      return false;
+  }
+  return false;
+}
+
+FieldStatus ProbeField(std::string_view data, std::size_t* size) {
+  WireReader reader(data);
+  uint32_t number = 0;
+  WireType wire_type;
+  if (!reader.ReadTag(&number, &wire_type)) {
+    return IsVarintPrefix(data, 5) ? FieldStatus::kIncomplete
+                                   : FieldStatus::kMalformed;
+  }
+  auto rest = data.substr(reader.position() - data.data());
+  uint64_t u64 = 0;
+  uint32_t u32 = 0;
+  bool ok = true;
+  switch (wire_type) {
+    case WireType::kVarint:
+      if (!reader.ReadVarint(&u64)) {
+        return IsVarintPrefix(rest, 10) ? FieldStatus::kIncomplete
+                                        : FieldStatus::kMalformed;
+      }
+      break;
+    case WireType::kLengthDelimited:
+      if (!reader.ReadSize(&u32)) {
+        return IsVarintPrefix(rest, 5) ? FieldStatus::kIncomplete
+                                       : FieldStatus::kMalformed;
+      }
+      *size = reader.position() - data.data() + u32;
+      return *size <= data.size() ? FieldStatus::kComplete
+                                  : FieldStatus::kIncomplete;
+    case WireType::kEndGroup:
+      return FieldStatus::kMalformed;
+    default:
+      ok = reader.SkipField(number, wire_type);
+      break;
+  }
+  if (!ok) {
+    return FieldStatus::kIncomplete;
+  }
+  *size = reader.position() - data.data();
+  return FieldStatus::kComplete;
+}
+
+bool IsValidUtf8(std::string_view data) {
+  return google::protobuf::internal::IsStructurallyValidUTF8(
+      data.data(), static_cast<int>(data.size()));
+}
+}  // namespace magic::pb
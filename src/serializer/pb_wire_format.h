@@ -0,0 +1,223 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_WIRE_FORMAT_H_
+#define CONVERT_SRC_SERIALIZER_PB_WIRE_FORMAT_H_
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <google/protobuf/descriptor.h>
+
+namespace magic::pb {
+using google::protobuf::FieldDescriptor;
+
+enum class WireType : uint32_t {
+  kVarint = 0,
+  kFixed64 = 1,
+  kLengthDelimited = 2,
+  kStartGroup = 3,
+  kEndGroup = 4,
+  kFixed32 = 5,
+};
+
+inline constexpr uint32_t kMaxFieldNumber = (1u << 29) - 1;
+
+inline int32_t ZigZagDecode32(uint32_t n) {
+  return static_cast<int32_t>((n >> 1) ^ (~(n & 1) + 1));
+}
+
+inline int64_t ZigZagDecode64(uint64_t n) {
+  return static_cast<int64_t>((n >> 1) ^ (~(n & 1) + 1));
+}
+
+inline uint32_t ZigZagEncode32(int32_t n) {
+  return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+}
+
+inline uint64_t ZigZagEncode64(int64_t n) {
+  return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+inline std::size_t VarintSize(uint64_t value) {
+  return (std::bit_width(value | 1) + 6) / 7;
+}
+
+inline uint32_t MakeTag(uint32_t field_number, WireType wire_type) {
+  return field_number << 3 | static_cast<uint32_t>(wire_type);
+}
+
+inline WireType ExpectedWireType(FieldDescriptor::Type type) {
+  switch (type) {
+    case FieldDescriptor::TYPE_FIXED64:
+    case FieldDescriptor::TYPE_SFIXED64:
+    case FieldDescriptor::TYPE_DOUBLE:
+      return WireType::kFixed64;
+    case FieldDescriptor::TYPE_FIXED32:
+    case FieldDescriptor::TYPE_SFIXED32:
+    case FieldDescriptor::TYPE_FLOAT:
+      return WireType::kFixed32;
+    case FieldDescriptor::TYPE_STRING:
+    case FieldDescriptor::TYPE_BYTES:
+    case FieldDescriptor::TYPE_MESSAGE:
+      return WireType::kLengthDelimited;
+    case FieldDescriptor::TYPE_GROUP:
+      return WireType::kStartGroup;
+    default:
+      return WireType::kVarint;
+  }
+}
+
+// Bounds checked reader over protobuf wire format. Every Read* returns false
+// on truncated or malformed input and leaves the reader unusable.
+class WireReader {
+ public:
+  WireReader() = default;
+  explicit WireReader(std::string_view data)
+      : ptr_(data.data()), end_(data.data() + data.size()) {}
+
+  bool done() const { return ptr_ == end_; }
+
+  const char* position() const { return ptr_; }
+
+  bool ReadVarint(uint64_t* value) {
+    if (ptr_ < end_ && static_cast<uint8_t>(*ptr_) < 0x80) {
+      *value = static_cast<uint8_t>(*ptr_++);
+      return true;
+    }
+    return ReadVarintSlow(value);
+  }
+
+  // Tags are at most five bytes, bits past 32 are dropped like protobuf does.
+  bool ReadTag(uint32_t* field_number, WireType* wire_type) {
+    uint32_t tag = 0;
+    for (int i = 0; i < 5 && ptr_ < end_; ++i) {
+      uint8_t byte = static_cast<uint8_t>(*ptr_++);
+      tag |= static_cast<uint32_t>(byte & 0x7f) << (7 * i);
+      if (byte < 0x80) {
+        *field_number = tag >> 3;
+        *wire_type = static_cast<WireType>(tag & 7);
+        return *field_number != 0 && (tag & 7) <= 5;
+      }
+    }
+    return false;
+  }
+
+  bool ReadFixed32(uint32_t* value) {
+    if (end_ - ptr_ < 4) {
+      return false;
+    }
+    std::memcpy(value, ptr_, 4);
+    ptr_ += 4;
+    return true;
+  }
+
+  bool ReadFixed64(uint64_t* value) {
+    if (end_ - ptr_ < 8) {
+      return false;
+    }
+    std::memcpy(value, ptr_, 8);
+    ptr_ += 8;
+    return true;
+  }
+
+  // Length prefixes are at most five bytes and stay clear of 2GB, which is
+  // how protobuf reads them.
+  bool ReadSize(uint32_t* size) {
+    uint32_t result = 0;
+    for (int i = 0; i < 5 && ptr_ < end_; ++i) {
+      uint8_t byte = static_cast<uint8_t>(*ptr_++);
+      if (i == 4 && byte >= 8) {
+        return false;
+      }
+      result |= static_cast<uint32_t>(byte & 0x7f) << (7 * i);
+      if (byte < 0x80) {
+        *size = result;
+        return result <= kMaxSize;
+      }
+    }
+    return false;
+  }
+
+  bool ReadLengthDelimited(std::string_view* value) {
+    uint32_t size = 0;
+    if (!ReadSize(&size) || size > static_cast<std::size_t>(end_ - ptr_)) {
+      return false;
+    }
+    *value = std::string_view(ptr_, size);
+    ptr_ += size;
+    return true;
+  }
+
+  // Reads the body of group |field_number| whose start tag was just read,
+  // consuming the matching end tag.
+  bool ReadGroup(uint32_t field_number, std::string_view* body);
+
+  // Skips the value of a field whose tag was just read.
+  bool SkipField(uint32_t field_number, WireType wire_type);
+
+ private:
+  static constexpr uint32_t kMaxSize = INT32_MAX - 16;
+
+  bool ReadVarintSlow(uint64_t* value);
+
+  const char* ptr_ = nullptr;
+  const char* end_ = nullptr;
+};
+
+// Unchecked writer into a buffer already sized by a size pass.
+class WireWriter {
+ public:
+  explicit WireWriter(uint8_t* ptr) : ptr_(ptr) {}
+
+  uint8_t* position() const { return ptr_; }
+
+  void WriteVarint(uint64_t value) {
+    while (value >= 0x80) {
+      *ptr_++ = static_cast<uint8_t>(value | 0x80);
+      value >>= 7;
+    }
+    *ptr_++ = static_cast<uint8_t>(value);
+  }
+
+  void WriteTag(uint32_t field_number, WireType wire_type) {
+    WriteVarint(MakeTag(field_number, wire_type));
+  }
+
+  void WriteFixed32(uint32_t value) {
+    std::memcpy(ptr_, &value, 4);
+    ptr_ += 4;
+  }
+
+  void WriteFixed64(uint64_t value) {
+    std::memcpy(ptr_, &value, 8);
+    ptr_ += 8;
+  }
+
+  void WriteBytes(std::string_view value) {
+    if (!value.empty()) {
+      std::memcpy(ptr_, value.data(), value.size());
+      ptr_ += value.size();
+    }
+  }
+
+ private:
+  uint8_t* ptr_ = nullptr;
+};
+
+enum class FieldStatus {
+  kComplete,
+  kIncomplete,
+  kMalformed,
+};
+
+// Checks whether |data| starts with a whole field, tag included. |size| is
+// set to the field's length whenever it is known, which for an incomplete
+// length delimited field tells how many bytes are needed. Fields that no
+// appended bytes can complete are kMalformed, except inside groups.
+FieldStatus ProbeField(std::string_view data, std::size_t* size);
+
+bool IsValidUtf8(std::string_view data);
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_WIRE_FORMAT_H_
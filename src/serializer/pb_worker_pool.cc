@@ -0,0 +1,150 @@
+#include "serializer/pb_worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace magic::pb {
+namespace {
+// A range [begin, end) packed into one word so owner and thieves can race
+// on it with compare-exchange.
+uint64_t Pack(uint32_t begin, uint32_t end) {
+  return static_cast<uint64_t>(begin) << 32 | end;
+}
+
+uint32_t Begin(uint64_t range) {
+  return static_cast<uint32_t>(range >> 32);
+}
+
+uint32_t End(uint64_t range) {
+  return static_cast<uint32_t>(range);
+}
+}  // namespace
+
+struct WorkerPool::Job {
+  Job(const std::function<void(std::size_t, std::size_t)>* fn,
+      std::size_t count,
+      std::size_t slots)
+      : fn(fn), ranges(slots), pending(count) {
+    for (std::size_t i = 0; i < slots; ++i) {
+      ranges[i].store(Pack(static_cast<uint32_t>(count * i / slots),
+                           static_cast<uint32_t>(count * (i + 1) / slots)));
+    }
+  }
+
+  bool Take(std::size_t slot, std::size_t* index) {
+    uint64_t range = ranges[slot].load();
+    while (Begin(range) < End(range)) {
+      if (ranges[slot].compare_exchange_weak(
+              range, Pack(Begin(range) + 1, End(range)))) {
+        *index = Begin(range);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool Steal(std::size_t slot, std::size_t* index) {
+    for (std::size_t i = 1; i < ranges.size(); ++i) {
+      auto& victim = ranges[(slot + i) % ranges.size()];
+      uint64_t range = victim.load();
+      while (Begin(range) < End(range)) {
+        uint32_t middle = Begin(range) + (End(range) - Begin(range)) / 2;
+        if (victim.compare_exchange_weak(range,
+                                         Pack(Begin(range), middle))) {
+          ranges[slot].store(Pack(middle + 1, End(range)));
+          *index = middle;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  const std::function<void(std::size_t, std::size_t)>* fn;
+  std::vector<std::atomic<uint64_t>> ranges;
+  std::atomic<std::size_t> next_slot{1};
+  std::atomic<std::size_t> pending;
+  std::mutex mutex;
+  std::condition_variable done;
+};
+
+WorkerPool::WorkerPool(std::size_t size) {
+  for (std::size_t i = 1; i < size; ++i) {
+    threads_.emplace_back([this] { Run(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::ParallelFor(
+    std::size_t count,
+    const std::function<void(std::size_t, std::size_t)>& fn) {
+  if (count == 0) {
+    return;
+  }
+  std::size_t slots = std::min(count, size());
+  auto job = std::make_shared<Job>(&fn, count, slots);
+  if (slots > 1) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(job);
+    }
+    wake_.notify_all();
+  }
+
+  Work(job.get(), 0);
+
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->done.wait(lock, [&] { return job->pending.load() == 0; });
+  lock.unlock();
+  if (slots > 1) {
+    std::lock_guard<std::mutex> pool_lock(mutex_);
+    auto it = std::find(jobs_.begin(), jobs_.end(), job);
+    if (it != jobs_.end()) {
+      jobs_.erase(it);
+    }
+  }
+}
+
+void WorkerPool::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+    if (stop_) {
+      return;
+    }
+    auto job = jobs_.front();
+    std::size_t slot = job->next_slot++;
+    if (slot + 1 >= job->ranges.size()) {
+      jobs_.pop_front();
+    }
+    if (slot >= job->ranges.size()) {
+      continue;
+    }
+    lock.unlock();
+    Work(job.get(), slot);
+    lock.lock();
+  }
+}
+
+void WorkerPool::Work(Job* job, std::size_t slot) {
+  std::size_t index = 0;
+  while (job->Take(slot, &index) || job->Steal(slot, &index)) {
+    (*job->fn)(index, slot);
+    if (--job->pending == 0) {
+      std::lock_guard<std::mutex> lock(job->mutex);
+      job->done.notify_all();
+    }
+  }
+}
+}  // namespace magic::pb
@@ -0,0 +1,54 @@
+#ifndef CONVERT_SRC_SERIALIZER_PB_WORKER_POOL_H_
+#define CONVERT_SRC_SERIALIZER_PB_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace magic::pb {
+// Fixed set of threads running index loops. Each participant of a loop owns
+// a contiguous range of indices and steals half of another participant's
+// remaining range once its own runs dry.
+//
+// The calling thread always takes part, so loops make progress even when
+// every worker is busy, including loops started from inside a loop.
+class WorkerPool {
+ public:
+  // |size| counts the calling thread, |size| - 1 threads are started.
+  explicit WorkerPool(std::size_t size = std::thread::hardware_concurrency());
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  std::size_t size() const { return threads_.size() + 1; }
+
+  // Calls |fn|(index, slot) once for every index in [0, |count|) and
+  // returns when all calls are done. Calls made by the same thread share a
+  // |slot| below size(), so per-slot scratch needs no locking. |fn| must not
+  // throw.
+  void ParallelFor(
+      std::size_t count,
+      const std::function<void(std::size_t index, std::size_t slot)>& fn);
+
+ private:
+  struct Job;
+
+  void Run();
+
+  static void Work(Job* job, std::size_t slot);
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
+}  // namespace magic::pb
+
+#endif  // CONVERT_SRC_SERIALIZER_PB_WORKER_POOL_H_
@@ -0,0 +1,123 @@
+// PushParser against from_pb on the whole payload, for every chunk size.
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "serializer/pb_push_parser.h"
+#include "test_schema.h"
+
+namespace magic::test {
+namespace {
+using pb::PBEngine;
+using pb::PBOptions;
+
+class PushParserTest : public ::testing::TestWithParam<PBEngine> {
+ protected:
+  PBOptions options() const {
+    PBOptions options;
+    options.engine = GetParam();
+    return options;
+  }
+
+  // Feeds |payload| in chunks of |chunk_size| bytes, and returns the Dump
+  // of the result.
+  std::pair<ErrorCode, std::string> Push(std::string_view payload,
+                                         std::size_t chunk_size) {
+    pb::ValueArena arena;
+    pb::ValueArena::Scope scope(&arena);
+    pb::PushParser<pb::Value*> parser(decoder_.runtime(), "test.All",
+                                      options());
+    for (std::size_t i = 0; i < payload.size(); i += chunk_size) {
+      if (!parser.Feed(payload.substr(i, chunk_size))) {
+        break;
+      }
+    }
+    auto result = parser.Finish();
+    if (result.first) {
+      return {result.first, {}};
+    }
+    return {result.first, Dump(result.second)};
+  }
+
+  Decoder decoder_;
+};
+
+TEST_P(PushParserTest, MatchesFromPbForEveryChunkSize) {
+  // Large enough that fields, including the group, span many chunks.
+  std::string big_leaf = "leaf { name: \"" + std::string(100, 'x') + "\" }";
+  std::string group = "Grp { a: 1";
+  for (int i = 0; i < 20; ++i) {
+    group += " b { id: " + std::to_string(i) + " name: \"leaf\" }";
+  }
+  group += " }";
+  const auto payload = decoder_.schema().Payload(
+      "test.All", big_leaf + group +
+                      R"pb(
+                        f_int64: -5000000000
+                        f_fixed64: 9
+                        f_double: 0.5
+                        f_string: "text"
+                        leaves { id: 2 }
+                        leaves { name: "three" }
+                        packed: [ 1, -1, 300 ]
+                        unpacked: [ 4, 5 ]
+                        by_name {
+                          key: "a"
+                          value { id: 6 }
+                        }
+                        names { key: 2 value: "two" }
+                        s: "chosen"
+                        reqs { x: 11 }
+                      )pb");
+  auto expected = decoder_.Decode(payload, options());
+  ASSERT_FALSE(expected.first) << expected.first.message();
+  for (std::size_t chunk_size = 1; chunk_size <= payload.size();
+       ++chunk_size) {
+    auto pushed = Push(payload, chunk_size);
+    ASSERT_FALSE(pushed.first) << "chunk size " << chunk_size;
+    EXPECT_EQ(expected.second, pushed.second) << "chunk size " << chunk_size;
+  }
+}
+
+TEST_P(PushParserTest, RejectsTruncatedAndMalformed) {
+  // Cut inside every field, a cut between fields leaves a valid payload.
+  std::string payload;
+  std::vector<std::size_t> ends;
+  for (const char* field :
+       {"f_string: \"text\"", "Grp { a: 1 }", "leaf { id: 2 }"}) {
+    payload += decoder_.schema().Payload("test.All", field);
+    ends.push_back(payload.size());
+  }
+  for (std::size_t size = 1; size < payload.size(); ++size) {
+    if (std::find(ends.begin(), ends.end(), size) != ends.end()) {
+      continue;
+    }
+    for (std::size_t chunk_size : {std::size_t{1}, std::size_t{3}, size}) {
+      EXPECT_TRUE(Push(payload.substr(0, size), chunk_size).first)
+          << "size " << size << ", chunk size " << chunk_size;
+    }
+  }
+  // A leaf whose varint runs past its length.
+  const std::string malformed("\x8a\x01\x02\x08\x80", 5);
+  for (std::size_t chunk_size = 1; chunk_size <= malformed.size();
+       ++chunk_size) {
+    EXPECT_TRUE(Push(malformed, chunk_size).first)
+        << "chunk size " << chunk_size;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines,
+                         PushParserTest,
+                         ::testing::Values(PBEngine::kReflection,
+                                           PBEngine::kWireFormat),
+                         [](const auto& info) {
+                           return info.param == PBEngine::kReflection
+                                      ? "Reflection"
+                                      : "WireFormat";
+                         });
+}  // namespace
+}  // namespace magic::test
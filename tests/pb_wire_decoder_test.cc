@@ -0,0 +1,188 @@
+// The wire engine against the reflection engine it must match, on valid
+// payloads and on malformed ones both must reject, and lazy decodes against
+// eager ones.
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "test_schema.h"
+
+namespace magic::test {
+namespace {
+using pb::PBEngine;
+using pb::PBOptions;
+
+constexpr const char kFull[] = R"pb(
+  f_int32: -5
+  f_int64: -5000000000
+  f_uint32: 4000000000
+  f_uint64: 18000000000000000000
+  f_sint32: -7
+  f_sint64: -7000000000
+  f_fixed32: 9
+  f_fixed64: 9000000000
+  f_sfixed32: -11
+  f_sfixed64: -11000000000
+  f_float: 0.25
+  f_double: 0.1
+  f_bool: true
+  f_string: "text"
+  f_bytes: "\x00\xff"
+  f_enum: BLUE
+  leaf { id: 1 name: "one" }
+  leaves { id: 2 }
+  leaves { name: "three" }
+  leaves {}
+  packed: [ 1, -1, 300 ]
+  unpacked: [ 4, 5 ]
+  by_name {
+    key: "a"
+    value { id: 6 }
+  }
+  by_name { key: "b" }
+  names { key: -1 value: "minus one" }
+  names { key: 2 value: "two" }
+  Grp {
+    a: 7
+    b { id: 8 }
+    b { name: "nine" }
+  }
+  s: "chosen"
+  req { x: 10 }
+  reqs { x: 11 }
+)pb";
+
+PBOptions Options(PBEngine engine, bool lazy = false) {
+  PBOptions options;
+  options.engine = engine;
+  options.lazy = lazy;
+  return options;
+}
+
+// Varint of |value| as protobuf writes it.
+std::string Varint(uint64_t value) {
+  std::string bytes;
+  while (value >= 0x80) {
+    bytes += static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  bytes += static_cast<char>(value);
+  return bytes;
+}
+
+std::string Tag(uint32_t number, int wire_type) {
+  return Varint(number << 3 | wire_type);
+}
+
+class WireDecoderTest : public ::testing::Test {
+ protected:
+  // Payloads every engine and mode must decode alike.
+  std::vector<std::string> Valid() {
+    auto& schema = decoder_.schema();
+    return {
+        "",
+        schema.Payload("test.All", kFull),
+        schema.Payload("test.All", "n: 3 leaf {} Grp {}"),
+        // Later occurrences replace scalars and merge into messages.
+        schema.Payload("test.All", "leaf { id: 1 } f_int32: 1") +
+            schema.Payload("test.All", "leaf { name: \"x\" } f_int32: 2"),
+        // Packed and unpacked forms are both taken for repeated scalars.
+        Tag(19, 0) + Varint(1) + Tag(20, 2) + Varint(2) + Varint(2) +
+            Varint(3),
+        // Unknown fields, and an unknown closed enum value, are skipped.
+        Tag(100, 0) + Varint(1) + Tag(101, 2) + Varint(1) + "x" +
+            Tag(102, 3) + Tag(1, 0) + Varint(1) + Tag(102, 4) + Tag(16, 0) +
+            Varint(7),
+    };
+  }
+
+  Decoder decoder_;
+};
+
+TEST_F(WireDecoderTest, MatchesReflection) {
+  for (const auto& payload : Valid()) {
+    auto reflection = decoder_.Decode(payload, Options(PBEngine::kReflection));
+    auto wire = decoder_.Decode(payload, Options(PBEngine::kWireFormat));
+    ASSERT_FALSE(reflection.first) << reflection.first.message();
+    ASSERT_FALSE(wire.first) << wire.first.message();
+    EXPECT_EQ(reflection.second, wire.second);
+  }
+}
+
+TEST_F(WireDecoderTest, MatchesReflectionWithOptions) {
+  const auto payload = decoder_.schema().Payload("test.All", kFull);
+  for (auto int64_format : {pb::PBInt64Format::kString,
+                            pb::PBInt64Format::kNative,
+                            pb::PBInt64Format::kHybrid}) {
+    for (bool camelcase : {false, true}) {
+      PBOptions reflection_options = Options(PBEngine::kReflection);
+      reflection_options.int64_format = int64_format;
+      reflection_options.use_camelcase = camelcase;
+      PBOptions wire_options = reflection_options;
+      wire_options.engine = PBEngine::kWireFormat;
+      wire_options.borrow_bytes = true;
+      auto reflection = decoder_.Decode(payload, reflection_options);
+      auto wire = decoder_.Decode(payload, wire_options);
+      ASSERT_FALSE(reflection.first) << reflection.first.message();
+      ASSERT_FALSE(wire.first) << wire.first.message();
+      EXPECT_EQ(reflection.second, wire.second);
+    }
+  }
+}
+
+TEST_F(WireDecoderTest, RejectsMalformed) {
+  const std::string overlong_varint = Tag(1, 0) + std::string(10, '\x80') +
+                                      "\x01";
+  const std::string leaf = Tag(17, 2);
+  const struct {
+    const char* name;
+    std::string payload;
+  } cases[] = {
+      {"truncated varint", Tag(1, 0) + "\x80"},
+      {"truncated fixed64", Tag(8, 1) + "\x01\x02"},
+      {"truncated tag", "\x80"},
+      {"overlong varint", overlong_varint},
+      {"overlong length", Tag(14, 2) + "\x80\x80\x80\x80\x80\x00"},
+      {"oversized length", Tag(14, 2) + Varint(INT32_MAX)},
+      {"length past end", Tag(14, 2) + Varint(5) + "ab"},
+      {"field number zero", Tag(0, 0) + Varint(1)},
+      {"wire type 6", Tag(1, 6)},
+      {"wire type 7", Tag(1, 7)},
+      {"end group without start", Tag(23, 4)},
+      {"unterminated group", Tag(23, 3) + Tag(1, 0) + Varint(1)},
+      {"mismatched end group", Tag(23, 3) + Tag(24, 4)},
+      {"malformed sub message", leaf + Varint(2) + Tag(1, 0) + "\x80"},
+      {"overlong varint in sub message",
+       leaf + Varint(overlong_varint.size()) + overlong_varint},
+      {"malformed repeated element",
+       Tag(18, 2) + Varint(0) + Tag(18, 2) + Varint(1) + Tag(1, 0)},
+      {"malformed map entry", Tag(21, 2) + Varint(2) + Tag(1, 2) + "\x05"},
+      {"missing required field", Tag(26, 2) + Varint(0)},
+      {"missing required field in element", Tag(27, 2) + Varint(0)},
+  };
+  for (const auto& [name, payload] : cases) {
+    for (auto engine : {PBEngine::kReflection, PBEngine::kWireFormat}) {
+      for (bool lazy : {false, true}) {
+        EXPECT_TRUE(decoder_.Decode(payload, Options(engine, lazy)).first)
+            << name << ", engine " << static_cast<int>(engine)
+            << (lazy ? ", lazy" : "");
+      }
+    }
+  }
+}
+
+TEST_F(WireDecoderTest, LazyMatchesEager) {
+  for (const auto& payload : Valid()) {
+    for (auto engine : {PBEngine::kReflection, PBEngine::kWireFormat}) {
+      auto eager = decoder_.Decode(payload, Options(engine));
+      auto lazy = decoder_.Decode(payload, Options(engine, true));
+      ASSERT_FALSE(eager.first) << eager.first.message();
+      ASSERT_FALSE(lazy.first) << lazy.first.message();
+      EXPECT_EQ(eager.second, lazy.second);
+    }
+  }
+}
+}  // namespace
+}  // namespace magic::test
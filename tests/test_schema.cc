@@ -0,0 +1,272 @@
+#include "test_schema.h"
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/text_format.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace magic::test {
+namespace {
+using google::protobuf::DynamicMessageFactory;
+using google::protobuf::FileDescriptorProto;
+using google::protobuf::Message;
+using google::protobuf::TextFormat;
+using pb::Value;
+
+constexpr const char kSchema[] = R"pb(
+  name: "test.proto"
+  package: "test"
+  syntax: "proto2"
+  enum_type {
+    name: "Color"
+    value { name: "RED" number: 0 }
+    value { name: "GREEN" number: 1 }
+    value { name: "BLUE" number: 2 }
+  }
+  message_type {
+    name: "Leaf"
+    field { name: "id" number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }
+    field { name: "name" number: 2 label: LABEL_OPTIONAL type: TYPE_STRING }
+  }
+  message_type {
+    name: "Req"
+    field { name: "x" number: 1 label: LABEL_REQUIRED type: TYPE_INT32 }
+  }
+  message_type {
+    name: "All"
+    field { name: "f_int32" number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }
+    field { name: "f_int64" number: 2 label: LABEL_OPTIONAL type: TYPE_INT64 }
+    field { name: "f_uint32" number: 3 label: LABEL_OPTIONAL type: TYPE_UINT32 }
+    field { name: "f_uint64" number: 4 label: LABEL_OPTIONAL type: TYPE_UINT64 }
+    field { name: "f_sint32" number: 5 label: LABEL_OPTIONAL type: TYPE_SINT32 }
+    field { name: "f_sint64" number: 6 label: LABEL_OPTIONAL type: TYPE_SINT64 }
+    field {
+      name: "f_fixed32" number: 7 label: LABEL_OPTIONAL type: TYPE_FIXED32
+    }
+    field {
+      name: "f_fixed64" number: 8 label: LABEL_OPTIONAL type: TYPE_FIXED64
+    }
+    field {
+      name: "f_sfixed32" number: 9 label: LABEL_OPTIONAL type: TYPE_SFIXED32
+    }
+    field {
+      name: "f_sfixed64" number: 10 label: LABEL_OPTIONAL type: TYPE_SFIXED64
+    }
+    field { name: "f_float" number: 11 label: LABEL_OPTIONAL type: TYPE_FLOAT }
+    field {
+      name: "f_double" number: 12 label: LABEL_OPTIONAL type: TYPE_DOUBLE
+    }
+    field { name: "f_bool" number: 13 label: LABEL_OPTIONAL type: TYPE_BOOL }
+    field {
+      name: "f_string" number: 14 label: LABEL_OPTIONAL type: TYPE_STRING
+    }
+    field { name: "f_bytes" number: 15 label: LABEL_OPTIONAL type: TYPE_BYTES }
+    field {
+      name: "f_enum"
+      number: 16
+      label: LABEL_OPTIONAL
+      type: TYPE_ENUM
+      type_name: ".test.Color"
+    }
+    field {
+      name: "leaf"
+      number: 17
+      label: LABEL_OPTIONAL
+      type: TYPE_MESSAGE
+      type_name: ".test.Leaf"
+    }
+    field {
+      name: "leaves"
+      number: 18
+      label: LABEL_REPEATED
+      type: TYPE_MESSAGE
+      type_name: ".test.Leaf"
+    }
+    field {
+      name: "packed"
+      number: 19
+      label: LABEL_REPEATED
+      type: TYPE_INT32
+      options { packed: true }
+    }
+    field { name: "unpacked" number: 20 label: LABEL_REPEATED type: TYPE_INT32 }
+    field {
+      name: "by_name"
+      number: 21
+      label: LABEL_REPEATED
+      type: TYPE_MESSAGE
+      type_name: ".test.All.ByNameEntry"
+    }
+    field {
+      name: "names"
+      number: 22
+      label: LABEL_REPEATED
+      type: TYPE_MESSAGE
+      type_name: ".test.All.NamesEntry"
+    }
+    field {
+      name: "grp"
+      number: 23
+      label: LABEL_OPTIONAL
+      type: TYPE_GROUP
+      type_name: ".test.All.Grp"
+    }
+    field {
+      name: "n"
+      number: 24
+      label: LABEL_OPTIONAL
+      type: TYPE_INT32
+      oneof_index: 0
+    }
+    field {
+      name: "s"
+      number: 25
+      label: LABEL_OPTIONAL
+      type: TYPE_STRING
+      oneof_index: 0
+    }
+    field {
+      name: "req"
+      number: 26
+      label: LABEL_OPTIONAL
+      type: TYPE_MESSAGE
+      type_name: ".test.Req"
+    }
+    field {
+      name: "reqs"
+      number: 27
+      label: LABEL_REPEATED
+      type: TYPE_MESSAGE
+      type_name: ".test.Req"
+    }
+    nested_type {
+      name: "ByNameEntry"
+      options { map_entry: true }
+      field { name: "key" number: 1 label: LABEL_OPTIONAL type: TYPE_STRING }
+      field {
+        name: "value"
+        number: 2
+        label: LABEL_OPTIONAL
+        type: TYPE_MESSAGE
+        type_name: ".test.Leaf"
+      }
+    }
+    nested_type {
+      name: "NamesEntry"
+      options { map_entry: true }
+      field { name: "key" number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }
+      field { name: "value" number: 2 label: LABEL_OPTIONAL type: TYPE_STRING }
+    }
+    nested_type {
+      name: "Grp"
+      field { name: "a" number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }
+      field {
+        name: "b"
+        number: 2
+        label: LABEL_REPEATED
+        type: TYPE_MESSAGE
+        type_name: ".test.Leaf"
+      }
+    }
+    oneof_decl { name: "choice" }
+  }
+)pb";
+
+void DumpTo(const Value* value, std::ostream& out) {
+  switch (value->kind()) {
+    case Value::Kind::kNull:
+      out << "null";
+      break;
+    case Value::Kind::kBool:
+      out << (value->bool_value() ? "true" : "false");
+      break;
+    case Value::Kind::kInt:
+      out << value->int_value();
+      break;
+    case Value::Kind::kUint:
+      out << value->uint_value() << "u";
+      break;
+    case Value::Kind::kDouble:
+      out << value->double_value() << "d";
+      break;
+    case Value::Kind::kString:
+      out << '"' << value->string_value() << '"';
+      break;
+    case Value::Kind::kBytes:
+      out << "b\"" << value->string_value() << '"';
+      break;
+    case Value::Kind::kArray: {
+      out << '[';
+      for (const Value* item : value->items()) {
+        DumpTo(item, out);
+        out << ',';
+      }
+      out << ']';
+      break;
+    }
+    case Value::Kind::kDict: {
+      std::vector<std::pair<std::string_view, const Value*>> entries;
+      for (const auto& entry : value->entries()) {
+        entries.emplace_back(entry.key.string_value(), entry.value);
+      }
+      std::sort(entries.begin(), entries.end());
+      out << '{';
+      for (const auto& [key, item] : entries) {
+        out << key << ':';
+        DumpTo(item, out);
+        out << ',';
+      }
+      out << '}';
+      break;
+    }
+  }
+}
+}  // namespace
+
+TestSchema::TestSchema() {
+  FileDescriptorProto file;
+  if (!TextFormat::ParseFromString(kSchema, &file) || !pool_.BuildFile(file)) {
+    std::abort();
+  }
+}
+
+std::string TestSchema::Payload(std::string_view type, std::string_view text) {
+  DynamicMessageFactory factory(&pool_);
+  const auto* descriptor = pool_.FindMessageTypeByName(std::string(type));
+  if (!descriptor) {
+    std::abort();
+  }
+  std::unique_ptr<Message> message(factory.GetPrototype(descriptor)->New());
+  if (!TextFormat::ParseFromString(std::string(text), message.get())) {
+    std::abort();
+  }
+  return message->SerializePartialAsString();
+}
+
+std::string Dump(const Value* value) {
+  std::ostringstream out;
+  out.precision(17);
+  DumpTo(value, out);
+  return out.str();
+}
+
+std::pair<ErrorCode, std::string> Decoder::Decode(
+    std::string_view payload,
+    const pb::PBOptions& options,
+    std::string_view type) {
+  pb::ValueArena arena;
+  auto owner = std::make_shared<std::string>(payload);
+  auto result = pb::from_pb(
+      runtime_, pb::PBInfo{.type = type, .data = *owner, .owner = owner},
+      &arena, options);
+  if (result.first) {
+    return {result.first, {}};
+  }
+  return {result.first, Dump(result.second)};
+}
+}  // namespace magic::test
@@ -0,0 +1,75 @@
+#ifndef CONVERT_TESTS_TEST_SCHEMA_H_
+#define CONVERT_TESTS_TEST_SCHEMA_H_
+
+#include <google/protobuf/descriptor.h>
+
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "serializer/pb_serializer_value.h"
+
+namespace magic::test {
+// The proto2 schema the tests decode, built in its own DescriptorPool.
+//
+//   enum Color { RED = 0; GREEN = 1; BLUE = 2; }
+//   message Leaf { optional int32 id = 1; optional string name = 2; }
+//   message Req { required int32 x = 1; }
+//   message All {
+//     <one optional field of every scalar type, 1 to 16>
+//     optional Leaf leaf = 17;
+//     repeated Leaf leaves = 18;
+//     repeated int32 packed = 19 [packed = true];
+//     repeated int32 unpacked = 20;
+//     map<string, Leaf> by_name = 21;
+//     map<int32, string> names = 22;
+//     optional group Grp = 23 { optional int32 a = 1; repeated Leaf b = 2; }
+//     oneof choice { int32 n = 24; string s = 25; }
+//     optional Req req = 26;
+//     repeated Req reqs = 27;
+//   }
+class TestSchema {
+ public:
+  TestSchema();
+
+  TestSchema(const TestSchema&) = delete;
+  TestSchema& operator=(const TestSchema&) = delete;
+
+  google::protobuf::DescriptorPool* pool() { return &pool_; }
+
+  // Wire format of the |type| message written as |text| in text format.
+  std::string Payload(std::string_view type, std::string_view text);
+
+ private:
+  google::protobuf::DescriptorPool pool_;
+};
+
+// |value| as text with dictionary keys sorted, so decodes that add fields
+// in different orders compare equal. Strings and bytes are told apart.
+std::string Dump(const pb::Value* value);
+
+// A TestSchema with the state conversions run against.
+class Decoder {
+ public:
+  Decoder()
+      : runtime_{.descriptor_pool = schema_.pool(),
+                 .message_pool = &message_pool_,
+                 .plans = &plans_} {}
+
+  TestSchema& schema() { return schema_; }
+  const pb::PBRuntime<pb::Value*>& runtime() const { return runtime_; }
+
+  // from_pb of |payload| as a |type| message, and the Dump of its result.
+  std::pair<ErrorCode, std::string> Decode(std::string_view payload,
+                                           const pb::PBOptions& options,
+                                           std::string_view type = "test.All");
+
+ private:
+  TestSchema schema_;
+  pb::MessagePool message_pool_;
+  pb::PlanCache<pb::Value*> plans_;
+  pb::PBRuntime<pb::Value*> runtime_;
+};
+}  // namespace magic::test
+
+#endif  // CONVERT_TESTS_TEST_SCHEMA_H_